@@ -0,0 +1,70 @@
+#include "base64.h"
+
+#include <cstdint>
+
+static const char kBase64Enc[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Both characters for each 12 bit half of a 3 byte group, so a group
+// takes two lookups instead of four.
+struct Base64PairTable {
+    char pairs[4096][2];
+    
+    Base64PairTable()
+    {
+        for (unsigned i = 0; i < 4096; ++i) {
+            pairs[i][0] = kBase64Enc[i >> 6];
+            pairs[i][1] = kBase64Enc[i & 0x3f];
+        }
+    }
+};
+
+size_t EncodeBase64(const unsigned char* data, size_t size, char* buffer)
+{
+    static const Base64PairTable table;
+    
+    char* out = buffer;
+    
+    // whole groups, four at a time
+    size_t i = 0;
+    for (; i + 12 <= size; i += 12) {
+        for (unsigned k = 0; k < 12; k += 3) {
+            uint32_t group = (uint32_t(data[i + k]) << 16) | (uint32_t(data[i + k + 1]) << 8) | data[i + k + 2];
+            
+            const char* hi = table.pairs[group >> 12];
+            const char* lo = table.pairs[group & 0xfff];
+            out[0] = hi[0];
+            out[1] = hi[1];
+            out[2] = lo[0];
+            out[3] = lo[1];
+            out += 4;
+        }
+    }
+    
+    for (; i + 3 <= size; i += 3) {
+        uint32_t group = (uint32_t(data[i]) << 16) | (uint32_t(data[i + 1]) << 8) | data[i + 2];
+        
+        const char* hi = table.pairs[group >> 12];
+        const char* lo = table.pairs[group & 0xfff];
+        out[0] = hi[0];
+        out[1] = hi[1];
+        out[2] = lo[0];
+        out[3] = lo[1];
+        out += 4;
+    }
+    
+    // remaining one or two bytes, padded with '='
+    if (i < size) {
+        uint32_t group = uint32_t(data[i]) << 16;
+        if (i + 1 < size) {
+            group |= uint32_t(data[i + 1]) << 8;
+        }
+        
+        out[0] = kBase64Enc[(group >> 18) & 0x3f];
+        out[1] = kBase64Enc[(group >> 12) & 0x3f];
+        out[2] = i + 1 < size ? kBase64Enc[(group >> 6) & 0x3f] : '=';
+        out[3] = '=';
+        out += 4;
+    }
+    
+    return out - buffer;
+}
@@ -0,0 +1,16 @@
+#ifndef __threeio__base64__
+#define __threeio__base64__
+
+#include <cstddef>
+
+// Characters needed to encode size bytes, padding included.
+inline size_t Base64Size(size_t size)
+{
+    return (size + 2) / 3 * 4;
+}
+
+// Encodes size bytes as padded base64 (RFC 4648) into buffer, which needs
+// room for Base64Size(size) characters. Returns the length written.
+size_t EncodeBase64(const unsigned char* data, size_t size, char* buffer);
+
+#endif // /* defined(__threeio__base64__) */
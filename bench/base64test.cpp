@@ -0,0 +1,191 @@
+//
+//  base64test.cpp
+//  threeio
+//
+//  Checks EncodeBase64 against a bit by bit reference encoder for every
+//  length up to kMaxLength, and images embedded by JSONFormat around the
+//  multiples of its read block size, decoding them back as well.
+//
+//  make check
+//
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "base64.h"
+#include "jsonformat.h"
+
+static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static const size_t kMaxLength = 4096;
+
+// JSONFormat reads embedded images in blocks of this many bytes
+static const size_t kBlockSize = 3 * 64 * 1024;
+
+// RFC 4648 one bit at a time, as far from the table driven encoder as it gets
+static std::string ReferenceBase64(const std::vector<unsigned char>& data)
+{
+    std::string out;
+    
+    uint32_t bits = 0;
+    int count = 0;
+    for (unsigned char byte : data) {
+        for (int i = 7; i >= 0; --i) {
+            bits = (bits << 1) | ((byte >> i) & 1);
+            if (++count == 6) {
+                out += kAlphabet[bits];
+                bits = 0;
+                count = 0;
+            }
+        }
+    }
+    
+    if (count > 0) {
+        out += kAlphabet[bits << (6 - count)];
+    }
+    while (out.size() % 4 != 0) {
+        out += '=';
+    }
+    
+    return out;
+}
+
+static bool DecodeBase64(const std::string& text, std::vector<unsigned char>& data)
+{
+    data.clear();
+    if (text.size() % 4 != 0) {
+        return false;
+    }
+    
+    uint32_t bits = 0;
+    int count = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '=') {
+            return text.size() - i <= 2 && text.find_first_not_of('=', i) == std::string::npos;
+        }
+        
+        const char* digit = strchr(kAlphabet, text[i]);
+        if (!digit || !*digit) {
+            return false;
+        }
+        
+        bits = (bits << 6) | static_cast<uint32_t>(digit - kAlphabet);
+        count += 6;
+        if (count >= 8) {
+            count -= 8;
+            data.push_back(static_cast<unsigned char>(bits >> count));
+            bits &= (1u << count) - 1;
+        }
+    }
+    
+    return true;
+}
+
+static std::vector<unsigned char> MakeData(size_t size, uint32_t seed)
+{
+    std::vector<unsigned char> data(size);
+    uint32_t state = seed;
+    for (auto& byte : data) {
+        state = state * 1664525u + 1013904223u;
+        byte = static_cast<unsigned char>(state >> 24);
+    }
+    return data;
+}
+
+static int failures = 0;
+
+static void Check(bool ok, const char* what, size_t size)
+{
+    if (!ok) {
+        fprintf(stderr, "FAIL %s, %zu bytes\n", what, size);
+        failures++;
+    }
+}
+
+static void CheckEncoder(const std::vector<unsigned char>& data)
+{
+    std::string expected = ReferenceBase64(data);
+    
+    // guard bytes catch writes past Base64Size
+    std::string buffer(Base64Size(data.size()) + 4, '#');
+    size_t length = EncodeBase64(data.data(), data.size(), &buffer[0]);
+    
+    Check(length == expected.size() && length == Base64Size(data.size()), "encoded length", data.size());
+    Check(buffer.compare(0, length, expected) == 0, "encoded text", data.size());
+    Check(buffer.compare(length, std::string::npos, "####") == 0, "write past the end", data.size());
+    
+    std::vector<unsigned char> decoded;
+    Check(DecodeBase64(buffer.substr(0, length), decoded) && decoded == data, "round trip", data.size());
+}
+
+static void CheckEmbedded(const std::vector<unsigned char>& data, const std::string& directory)
+{
+    std::string image = directory + "/threeio-base64test.png";
+    std::string path = directory + "/threeio-base64test.json";
+    
+    {
+        std::ofstream os(image.c_str(), std::ios::out | std::ios::binary);
+        os.write(reinterpret_cast<const char*>(data.data()), data.size());
+    }
+    
+    JSONFormat json;
+    json.pretty(false);
+    bool ok = json.ff_Open(path.c_str());
+    if (ok) {
+        std::ifstream is(image.c_str(), std::ios::in | std::ios::binary);
+        json.StartArray();
+        json.Write(is, "image/png");
+        json.EndArray();
+        ok = json.Close();
+        json.ff_Cleanup();
+    }
+    
+    std::ifstream is(path.c_str(), std::ios::in | std::ios::binary);
+    std::string text((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    
+    std::string expected = "[\"data:image/png;base64," + ReferenceBase64(data) + "\"]";
+    Check(ok && text == expected, "embedded image", data.size());
+    
+    unlink(image.c_str());
+    unlink(path.c_str());
+}
+
+int main(int argc, char* argv[])
+{
+    std::string directory = argc > 1 ? argv[1] : "/tmp";
+    
+    for (size_t size = 0; size <= kMaxLength; ++size) {
+        CheckEncoder(MakeData(size, static_cast<uint32_t>(size)));
+    }
+    
+    // every byte value in every position of a group
+    std::vector<unsigned char> bytes;
+    for (unsigned i = 0; i < 3 * 256; ++i) {
+        bytes.push_back(static_cast<unsigned char>(i / 3 + (i % 3) * 85));
+    }
+    CheckEncoder(bytes);
+    
+    for (size_t block = 0; block <= 2 * kBlockSize; block += kBlockSize) {
+        for (size_t size = block > 2 ? block - 2 : 0; size <= block + 2; ++size) {
+            auto data = MakeData(size, 7);
+            CheckEncoder(data);
+            CheckEmbedded(data, directory);
+        }
+    }
+    
+    if (failures > 0) {
+        fprintf(stderr, "base64: %d checks failed\n", failures);
+        return 1;
+    }
+    
+    printf("base64: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,664 @@
+//
+//  bench.cpp
+//  threeio
+//
+//  Runs the savers on procedural scenes through the headless SDK stand-in
+//  in bench/sdk, and reports wall time, throughput and peak memory of each
+//  output mode. Every mode runs in its own process, so the peak resident
+//  set of one does not leak into the next.
+//
+//  make bench && build/bench/threeio-bench --help
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "gltfsaver.h"
+#include "jsonformat.h"
+#include "saver.h"
+#include "standin.h"
+
+struct SceneOptions {
+    unsigned meshes = 64;
+    unsigned tags = 4;
+    unsigned polys = 20000;   // per mesh
+    unsigned instances = 64;
+    unsigned depth = 8;       // nested group locators
+    bool triangles = false;   // quads otherwise
+    double soup = 0;          // > 0: polygons do not share points, which are jittered by up to this
+    
+    // synthetic payloads of the modes that do not save the scene
+    unsigned floats = 10000000;
+    unsigned image = 64;      // MB of image data embedded by the base64 mode
+};
+
+struct Mode {
+    const char* name;
+    const char* extension;
+    
+    // kFloats writes a JSON array of SceneOptions::floats numbers and
+    // kBase64 embeds an image file of SceneOptions::image MB as a data uri,
+    // both through JSONFormat alone, without a scene
+    enum Saver { kThree, kGLTF, kGLB, kFloats, kBase64 } saver;
+    std::vector<std::pair<const char*, const char*>> values;
+    
+    bool scene() const
+    {
+        return saver == kThree || saver == kGLTF || saver == kGLB;
+    }
+};
+
+static const std::vector<Mode> kModes = {
+    { "geometry", "json", Mode::kThree, { { "threeio.geometry.type", "1" } } },
+    { "geometry-compact", "json", Mode::kThree, { { "threeio.geometry.type", "1" }, { "threeio.json.pretty", "0" } } },
+    { "buffer", "json", Mode::kThree, { { "threeio.geometry.type", "0" } } },
+    { "buffer-compact", "json", Mode::kThree, { { "threeio.geometry.type", "0" }, { "threeio.json.pretty", "0" } } },
+    { "buffer-binary", "json", Mode::kThree, { { "threeio.geometry.type", "0" }, { "threeio.geometry.binary", "1" } } },
+    { "buffer-interleaved", "json", Mode::kThree, { { "threeio.geometry.type", "0" }, { "threeio.geometry.interleaved", "1" } } },
+    { "buffer-binary-interleaved", "json", Mode::kThree, { { "threeio.geometry.type", "0" }, { "threeio.geometry.binary", "1" }, { "threeio.geometry.interleaved", "1" } } },
+    { "buffer-cached", "json", Mode::kThree, { { "threeio.geometry.type", "0" }, { "threeio.geometry.cache", "1" } } },
+    { "buffer-welded", "json", Mode::kThree, { { "threeio.geometry.type", "0" }, { "threeio.weld.enabled", "1" } } },
+    { "geometry-welded", "json", Mode::kThree, { { "threeio.geometry.type", "1" }, { "threeio.weld.enabled", "1" } } },
+    { "buffer-quantized", "json", Mode::kThree, { { "threeio.geometry.type", "0" }, { "threeio.quantize.enabled", "1" } } },
+    { "buffer-gzip", "json", Mode::kThree, { { "threeio.geometry.type", "0" }, { "threeio.compress.method", "1" } } },
+    { "buffer-binary-gzip", "json", Mode::kThree, { { "threeio.geometry.type", "0" }, { "threeio.geometry.binary", "1" }, { "threeio.compress.method", "1" } } },
+    { "buffer-zstd", "json", Mode::kThree, { { "threeio.geometry.type", "0" }, { "threeio.compress.method", "2" } } },
+    { "gltf", "gltf", Mode::kGLTF, {} },
+    { "glb", "glb", Mode::kGLB, {} },
+    { "floats", "json", Mode::kFloats, {} },
+    { "base64", "json", Mode::kBase64, {} },
+};
+
+// sent from the process running a mode to the parent
+struct Result {
+    bool ok;
+    double seconds;           // best of the repeats
+    uint64_t bytes;           // all files written
+    uint64_t scene_rss;       // kB, after building the scene
+    uint64_t peak_rss;        // kB
+};
+
+// Modes compressing with a method that is not built in, zstd without
+// THREEIO_ZSTD, would measure the gzip fallback under their name.
+static bool Available(const Mode& mode)
+{
+    for (auto& value : mode.values) {
+        if (strcmp(value.first, "threeio.compress.method") == 0) {
+            return Compressor::Available((Compressor::Method)atoi(value.second));
+        }
+    }
+    
+    return true;
+}
+
+//----------------------------------------------------------------------------
+// procedural scenes
+
+/*
+ * A rippled sheet of about polys quads (or twice as many triangles) with
+ * smooth normals and a uv map, banded into tags by rows. The ripple phase
+ * depends on index, so no two meshes have the same content.
+ */
+static std::shared_ptr<standin::Mesh> MakeMesh(const SceneOptions& options, unsigned index)
+{
+    auto mesh = std::make_shared<standin::Mesh>();
+    
+    unsigned quads = options.triangles ? std::max(1u, options.polys / 2) : options.polys;
+    unsigned cols = std::max(1u, static_cast<unsigned>(std::sqrt(double(quads))));
+    unsigned rows = std::max(1u, (quads + cols - 1) / cols);
+    
+    double size = 10.0;
+    double frequency = 2.0 * M_PI * 3.0 / size;
+    double amplitude = 0.5;
+    double phase = index * 0.37;
+    
+    mesh->points.reserve((rows + 1) * (cols + 1) * 3);
+    mesh->normals.reserve((rows + 1) * (cols + 1) * 3);
+    mesh->uvs.reserve((rows + 1) * (cols + 1) * 2);
+    
+    for (unsigned r = 0; r <= rows; ++r) {
+        for (unsigned c = 0; c <= cols; ++c) {
+            double u = double(c) / cols;
+            double v = double(r) / rows;
+            double x = (u - 0.5) * size;
+            double z = (v - 0.5) * size;
+            
+            double sx = std::sin(frequency * x + phase), cx = std::cos(frequency * x + phase);
+            double sz = std::sin(frequency * z), cz = std::cos(frequency * z);
+            double y = amplitude * sx * cz;
+            
+            // normal from the height field's gradient
+            double dx = amplitude * frequency * cx * cz;
+            double dz = -amplitude * frequency * sx * sz;
+            double length = std::sqrt(dx * dx + 1 + dz * dz);
+            
+            mesh->points.insert(mesh->points.end(), { x, y, z });
+            mesh->normals.insert(mesh->normals.end(), { -dx / length, 1 / length, -dz / length });
+            mesh->uvs.insert(mesh->uvs.end(), { float(u), float(v) });
+        }
+    }
+    
+    for (unsigned t = 0; t < std::max(1u, options.tags); ++t) {
+        mesh->tag_names.push_back("Tag " + std::to_string(t));
+    }
+    
+    unsigned stride = cols + 1;
+    unsigned count = 0;
+    
+    // a copy of a grid point for a single polygon, like scanned meshes
+    // that were stitched from separately computed parts
+    unsigned jitter = 0;
+    auto corner = [&](unsigned point) {
+        if (options.soup <= 0) {
+            return point;
+        }
+        
+        unsigned copy = static_cast<unsigned>(mesh->points.size() / 3);
+        for (unsigned k = 0; k < 3; ++k) {
+            jitter = jitter * 1664525u + 1013904223u;
+            double offset = options.soup * (double(jitter >> 8) / double(1u << 24) * 2 - 1);
+            mesh->points.push_back(mesh->points[point * 3 + k] + offset);
+            mesh->normals.push_back(mesh->normals[point * 3 + k]);
+        }
+        mesh->uvs.push_back(mesh->uvs[point * 2]);
+        mesh->uvs.push_back(mesh->uvs[point * 2 + 1]);
+        
+        return copy;
+    };
+    
+    for (unsigned r = 0; r < rows && count < quads; ++r) {
+        unsigned tag = r * static_cast<unsigned>(mesh->tag_names.size()) / rows;
+        
+        for (unsigned c = 0; c < cols && count < quads; ++c, ++count) {
+            unsigned a = r * stride + c;
+            unsigned b = a + 1;
+            unsigned d = a + stride;
+            unsigned e = d + 1;
+            
+            // counter clockwise seen from +y
+            if (options.triangles) {
+                mesh->AddPolygon({ corner(a), corner(d), corner(e) }, tag);
+                mesh->AddPolygon({ corner(a), corner(e), corner(b) }, tag);
+            } else {
+                mesh->AddPolygon({ corner(a), corner(d), corner(e), corner(b) }, tag);
+            }
+        }
+    }
+    
+    return mesh;
+}
+
+static void Translate(standin::Item* item, double x, double y, double z)
+{
+    item->transform[3][0] = x;
+    item->transform[3][1] = y;
+    item->transform[3][2] = z;
+}
+
+static void MakeScene(const SceneOptions& options, standin::Scene& scene)
+{
+    // shader tree: a base material, then a mask with a material and a
+    // diffuse image map for each tag
+    auto render = scene.Add(LXsITYPE_POLYRENDER, "Render");
+    
+    auto base = scene.Add(LXsITYPE_ADVANCEDMATERIAL, "Base Material", render);
+    base->ints[LXsICHAN_TEXTURELAYER_ENABLE] = 1;
+    base->floats[LXsICHAN_ADVANCEDMATERIAL_DIFFAMT] = 0.8;
+    base->Color(LXsICHAN_ADVANCEDMATERIAL_DIFFCOL, 0.6, 0.6, 0.6);
+    
+    for (unsigned t = 0; t < std::max(1u, options.tags); ++t) {
+        std::string tag = "Tag " + std::to_string(t);
+        
+        auto mask = scene.Add(LXsITYPE_MASK, tag, render);
+        mask->ints[LXsICHAN_TEXTURELAYER_ENABLE] = 1;
+        mask->strings[LXsICHAN_MASK_PTAG] = tag;
+        
+        auto material = scene.Add(LXsITYPE_ADVANCEDMATERIAL, tag + " Material", mask);
+        material->ints[LXsICHAN_TEXTURELAYER_ENABLE] = 1;
+        material->floats[LXsICHAN_ADVANCEDMATERIAL_DIFFAMT] = 0.8;
+        material->Color(LXsICHAN_ADVANCEDMATERIAL_DIFFCOL, 0.2 + 0.1 * (t % 8), 0.5, 0.8);
+        material->floats[LXsICHAN_ADVANCEDMATERIAL_SPECAMT] = 0.04;
+        material->Color(LXsICHAN_ADVANCEDMATERIAL_SPECCOL, 1, 1, 1);
+        material->floats[LXsICHAN_ADVANCEDMATERIAL_ROUGH] = 0.4;
+        
+        auto still = scene.Add(LXsITYPE_VIDEOSTILL, tag + " Image");
+        still->strings[LXsICHAN_VIDEOSTILL_FILENAME] = "/textures/tag" + std::to_string(t) + ".png";
+        still->strings[LXsICHAN_VIDEOSTILL_FORMAT] = "PNG";
+        
+        auto map = scene.Add(LXsITYPE_IMAGEMAP, tag + " Image Map", mask);
+        map->ints[LXsICHAN_TEXTURELAYER_ENABLE] = 1;
+        map->effect = LXs_FX_DIFFCOLOR;
+        map->image = still;
+    }
+    
+    // chain of nested groups
+    std::vector<standin::Item*> groups;
+    for (unsigned d = 0; d < options.depth; ++d) {
+        auto group = scene.Add(LXsITYPE_GROUPLOCATOR, "Group " + std::to_string(d),
+                               groups.empty() ? nullptr : groups.back());
+        Translate(group, 1, 0, 0);
+        groups.push_back(group);
+    }
+    
+    auto parent = [&groups](unsigned i) {
+        return groups.empty() ? nullptr : groups[i % groups.size()];
+    };
+    
+    std::vector<standin::Item*> meshes;
+    for (unsigned m = 0; m < options.meshes; ++m) {
+        auto mesh = scene.Add(LXsITYPE_MESH, "Mesh " + std::to_string(m), parent(m));
+        mesh->mesh = MakeMesh(options, m);
+        Translate(mesh, (m % 8) * 12.0, 0, (m / 8) * 12.0);
+        meshes.push_back(mesh);
+    }
+    
+    for (unsigned i = 0; i < options.instances && !meshes.empty(); ++i) {
+        auto instance = scene.Add(LXsITYPE_MESHINST, "Instance " + std::to_string(i), parent(i * 7));
+        instance->source = meshes[i % meshes.size()];
+        Translate(instance, (i % 8) * 12.0, 5.0, (i / 8) * 12.0);
+    }
+}
+
+//----------------------------------------------------------------------------
+// measuring
+
+// kB value of a line of /proc/self/status, 0 if not available
+static uint64_t ProcStatus(const char* key)
+{
+    FILE* status = fopen("/proc/self/status", "r");
+    if (!status) {
+        return 0;
+    }
+    
+    char line[256];
+    uint64_t value = 0;
+    size_t length = strlen(key);
+    
+    while (fgets(line, sizeof line, status)) {
+        if (strncmp(line, key, length) == 0 && line[length] == ':') {
+            value = strtoull(line + length + 1, nullptr, 10);
+            break;
+        }
+    }
+    
+    fclose(status);
+    return value;
+}
+
+static uint64_t FileSize(const std::string& path)
+{
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+}
+
+// the file a saver wrote for path, which may have been compressed
+static std::string StoredPath(const std::string& path)
+{
+    for (const char* extension : { "gz", "zst" }) {
+        std::string compressed = path + "." + extension;
+        if (access(compressed.c_str(), F_OK) == 0) {
+            return compressed;
+        }
+    }
+    
+    return path;
+}
+
+static bool Save(const Mode& mode, const std::string& path)
+{
+    THREESceneSaver three;
+    GLTFSceneSaver gltf;
+    GLBSceneSaver glb;
+    
+    THREESceneSaver* saver = &three;
+    if (mode.saver == Mode::kGLTF) {
+        saver = &gltf;
+    } else if (mode.saver == Mode::kGLB) {
+        saver = &glb;
+    }
+    
+    if (!saver->ss_Format()->ff_Open(path.c_str())) {
+        return false;
+    }
+    
+    LxResult result = saver->ss_Save();
+    bool ok = LXx_OK(result) && !saver->ss_Format()->ff_HasError();
+    saver->ss_Format()->ff_Cleanup();
+    
+    return ok;
+}
+
+// a float array like a position attribute, distinct digits in every value
+static std::vector<float> MakeFloats(unsigned count)
+{
+    std::vector<float> floats(count);
+    for (unsigned i = 0; i < count; ++i) {
+        floats[i] = float(std::sin(i * 0.001) * (1 + i % 1000));
+    }
+    return floats;
+}
+
+static bool WriteFloats(const std::vector<float>& floats, const std::string& path)
+{
+    JSONFormat json;
+    if (!json.ff_Open(path.c_str())) {
+        return false;
+    }
+    
+    json.StartArray();
+    for (float value : floats) {
+        json.Write(value);
+    }
+    json.EndArray();
+    
+    bool ok = json.Close();
+    json.ff_Cleanup();
+    
+    return ok;
+}
+
+// incompressible bytes standing in for an image file
+static bool MakeImage(unsigned mb, const std::string& path)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    
+    std::vector<unsigned char> block(1024 * 1024);
+    uint32_t state = 1;
+    bool ok = true;
+    for (unsigned i = 0; i < mb && ok; ++i) {
+        for (auto& byte : block) {
+            state = state * 1664525u + 1013904223u;
+            byte = static_cast<unsigned char>(state >> 24);
+        }
+        ok = fwrite(block.data(), 1, block.size(), file) == block.size();
+    }
+    
+    return fclose(file) == 0 && ok;
+}
+
+static bool WriteImage(const std::string& image, const std::string& path)
+{
+    JSONFormat json;
+    if (!json.ff_Open(path.c_str())) {
+        return false;
+    }
+    
+    std::ifstream is(image.c_str(), std::ios::in | std::ios::binary);
+    if (!is) {
+        return false;
+    }
+    
+    json.StartArray();
+    json.Write(is, "image/png");
+    json.EndArray();
+    
+    bool ok = json.Close();
+    json.ff_Cleanup();
+    
+    return ok;
+}
+
+static Result RunMode(const Mode& mode, const SceneOptions& options, const std::string& out,
+                      unsigned repeat, unsigned threads, bool keep, bool log, bool stats)
+{
+    Result result = { true, HUGE_VAL, 0, 0, 0 };
+    
+    standin::Scene scene;
+    if (mode.scene()) {
+        MakeScene(options, scene);
+    }
+    standin::SetScene(&scene);
+    
+    std::vector<float> floats;
+    if (mode.saver == Mode::kFloats) {
+        floats = MakeFloats(options.floats);
+    }
+    
+    result.scene_rss = ProcStatus("VmRSS");
+    
+    standin::ClearUserValues();
+    standin::SetUserValue("threeio.geometry.threads", std::to_string(threads));
+    standin::SetUserValue("threeio.stats.file", stats ? "1" : "0");
+    for (auto& value : mode.values) {
+        standin::SetUserValue(value.first, value.second);
+    }
+    
+    std::string path = out + "/threeio-bench-" + mode.name + "." + mode.extension;
+    std::string sidecar = ReplaceExtension(path, THREE_BUFFER_EXTENSION);
+    std::string stats_file = ReplaceExtension(path, "stats.json");
+    std::string cache = path + ".cache";
+    std::string image = ReplaceExtension(path, "png");
+    
+    if (mode.saver == Mode::kBase64 && !MakeImage(options.image, image)) {
+        result.ok = false;
+    }
+    
+    // every run starts cold, later repeats hit the cache of the first
+    unlink(cache.c_str());
+    
+    for (unsigned r = 0; r < repeat; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        if (mode.saver == Mode::kFloats) {
+            result.ok = WriteFloats(floats, path) && result.ok;
+        } else if (mode.saver == Mode::kBase64) {
+            result.ok = WriteImage(image, path) && result.ok;
+        } else {
+            result.ok = Save(mode, path) && result.ok;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        
+        result.seconds = std::min(result.seconds, elapsed.count());
+    }
+    
+    path = StoredPath(path);
+    sidecar = StoredPath(sidecar);
+    result.bytes = FileSize(path) + FileSize(sidecar);
+    result.peak_rss = ProcStatus("VmHWM");
+    
+    if (log) {
+        for (auto& message : standin::LogMessages()) {
+            fprintf(stderr, "  [%s] %s\n", mode.name, message.c_str());
+        }
+    }
+    
+    unlink(image.c_str());
+    
+    if (!keep) {
+        unlink(path.c_str());
+        unlink(sidecar.c_str());
+        unlink(stats_file.c_str());
+        unlink(cache.c_str());
+    }
+    
+    return result;
+}
+
+// runs a mode in a child process and collects its result through a pipe
+static bool RunIsolated(const Mode& mode, const SceneOptions& options, const std::string& out,
+                        unsigned repeat, unsigned threads, bool keep, bool log, bool stats, Result& result)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    
+    if (pid == 0) {
+        close(fds[0]);
+        Result child = RunMode(mode, options, out, repeat, threads, keep, log, stats);
+        ssize_t written = write(fds[1], &child, sizeof child);
+        _exit(written == sizeof child ? 0 : 1);
+    }
+    
+    close(fds[1]);
+    ssize_t count = read(fds[0], &result, sizeof result);
+    close(fds[0]);
+    
+    int status = 0;
+    waitpid(pid, &status, 0);
+    
+    return count == sizeof result && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+//----------------------------------------------------------------------------
+
+static void Usage(const char* name)
+{
+    SceneOptions defaults;
+    
+    printf("usage: %s [options]\n\n", name);
+    printf("scene:\n");
+    printf("  --meshes N      mesh items (%u)\n", defaults.meshes);
+    printf("  --tags N        material tags per mesh (%u)\n", defaults.tags);
+    printf("  --polys N       polygons per mesh (%u)\n", defaults.polys);
+    printf("  --instances N   mesh instances (%u)\n", defaults.instances);
+    printf("  --depth N       nesting depth of the group hierarchy (%u)\n", defaults.depth);
+    printf("  --triangles     triangles instead of quads\n");
+    printf("  --soup E        polygons get their own copies of their points, jittered by up to E\n");
+    printf("  --floats N      numbers written by the floats mode (%u)\n", defaults.floats);
+    printf("  --image MB      size of the image the base64 mode embeds (%u)\n\n", defaults.image);
+    printf("run:\n");
+    printf("  --mode NAME     run only this mode, may be repeated:");
+    for (auto& mode : kModes) {
+        printf(" %s%s", mode.name, Available(mode) ? "" : " (not built in)");
+    }
+    printf("\n");
+    printf("  --repeat N      saves per mode, the fastest is reported (3)\n");
+    printf("  --threads N     threeio.geometry.threads, 0 for one per core (0)\n");
+    printf("  --out DIR       directory for the output files (/tmp)\n");
+    printf("  --keep          keep the output files\n");
+    printf("  --log           print the savers' log messages, including their stats\n");
+    printf("  --stats         write the savers' stats files next to the output\n");
+    printf("  --csv           comma separated output, for tracking over time\n");
+}
+
+int main(int argc, char* argv[])
+{
+    SceneOptions options;
+    std::vector<std::string> selected;
+    std::string out = "/tmp";
+    unsigned repeat = 3;
+    unsigned threads = 0;
+    bool keep = false;
+    bool log = false;
+    bool stats = false;
+    bool csv = false;
+    
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        
+        if (arg == "--meshes" && has_value) {
+            options.meshes = atoi(argv[++i]);
+        } else if (arg == "--tags" && has_value) {
+            options.tags = atoi(argv[++i]);
+        } else if (arg == "--polys" && has_value) {
+            options.polys = atoi(argv[++i]);
+        } else if (arg == "--instances" && has_value) {
+            options.instances = atoi(argv[++i]);
+        } else if (arg == "--depth" && has_value) {
+            options.depth = atoi(argv[++i]);
+        } else if (arg == "--triangles") {
+            options.triangles = true;
+        } else if (arg == "--soup" && has_value) {
+            options.soup = atof(argv[++i]);
+        } else if (arg == "--floats" && has_value) {
+            options.floats = atoi(argv[++i]);
+        } else if (arg == "--image" && has_value) {
+            options.image = atoi(argv[++i]);
+        } else if (arg == "--mode" && has_value) {
+            selected.push_back(argv[++i]);
+        } else if (arg == "--repeat" && has_value) {
+            repeat = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--threads" && has_value) {
+            threads = atoi(argv[++i]);
+        } else if (arg == "--out" && has_value) {
+            out = argv[++i];
+        } else if (arg == "--keep") {
+            keep = true;
+        } else if (arg == "--log") {
+            log = true;
+        } else if (arg == "--stats") {
+            stats = true;
+        } else if (arg == "--csv") {
+            csv = true;
+        } else {
+            Usage(argv[0]);
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+    }
+    
+    uint64_t polys = uint64_t(options.meshes) * options.polys;
+    
+    if (csv) {
+        printf("mode,meshes,tags,polys,instances,depth,seconds,polys_per_s,bytes,mb_per_s,scene_rss_kb,peak_rss_kb\n");
+    } else {
+        printf("%u meshes x %u tags x %u %s, %u instances, depth %u\n\n", options.meshes, options.tags,
+               options.polys, options.triangles ? "triangles" : "quads", options.instances, options.depth);
+        printf("%-26s %9s %12s %10s %9s %11s %11s\n", "mode", "time s", "polys/s", "size MB", "MB/s",
+               "scene MB", "peak MB");
+    }
+    
+    int failures = 0;
+    
+    for (auto& mode : kModes) {
+        if (!selected.empty() && std::find(selected.begin(), selected.end(), mode.name) == selected.end()) {
+            continue;
+        }
+        
+        if (!Available(mode)) {
+            fprintf(stderr, "%s: skipped, not built in\n", mode.name);
+            continue;
+        }
+        
+        Result result;
+        if (!RunIsolated(mode, options, out, repeat, threads, keep, log, stats, result) || !result.ok) {
+            fprintf(stderr, "%s: save failed\n", mode.name);
+            failures++;
+            continue;
+        }
+        
+        double mb = result.bytes / (1024.0 * 1024.0);
+        double polys_per_second = mode.scene() ? polys / result.seconds : 0;
+        
+        if (csv) {
+            printf("%s,%u,%u,%llu,%u,%u,%.4f,%.0f,%llu,%.2f,%llu,%llu\n", mode.name, options.meshes,
+                   options.tags, (unsigned long long)polys, options.instances, options.depth,
+                   result.seconds, polys_per_second, (unsigned long long)result.bytes,
+                   mb / result.seconds, (unsigned long long)result.scene_rss,
+                   (unsigned long long)result.peak_rss);
+        } else {
+            char polys_column[32] = "-";
+            if (mode.scene()) {
+                snprintf(polys_column, sizeof polys_column, "%.0f", polys_per_second);
+            }
+            
+            printf("%-26s %9.3f %12s %10.1f %9.1f %11.1f %11.1f\n", mode.name, result.seconds,
+                   polys_column, mb, mb / result.seconds, result.scene_rss / 1024.0,
+                   result.peak_rss / 1024.0);
+        }
+        fflush(stdout);
+    }
+    
+    return failures > 0 ? 1 : 0;
+}
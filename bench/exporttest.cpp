@@ -0,0 +1,160 @@
+//
+//  exporttest.cpp
+//  threeio
+//
+//  Saves a single quad through the headless SDK stand-in and checks that
+//  the numbers of its attributes and bounds are written with the digits
+//  they were modeled with, e.g. 0.1 and not the 0.10000000149011612 of
+//  its Float32 value widened to a double.
+//
+//  make check
+//
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "saver.h"
+#include "standin.h"
+
+// every number the quad is made of, as it should appear in the output,
+// and the 1.0 of the face normal Geometry writes as well
+static const std::set<std::string> kNumbers = {
+    "0.0", "0.1", "0.2", "0.3", "0.6", "0.7", "0.8", "1.0", "1.1", "1.3"
+};
+
+static int failures = 0;
+
+static void MakeScene(standin::Scene& scene)
+{
+    auto render = scene.Add(LXsITYPE_POLYRENDER, "Render");
+    
+    auto base = scene.Add(LXsITYPE_ADVANCEDMATERIAL, "Base Material", render);
+    base->ints[LXsICHAN_TEXTURELAYER_ENABLE] = 1;
+    base->Color(LXsICHAN_ADVANCEDMATERIAL_DIFFCOL, 0.6, 0.6, 0.6);
+    
+    auto mesh = std::make_shared<standin::Mesh>();
+    mesh->points = { 0.1, 0.2, 0.3,  1.1, 0.2, 0.3,  1.1, 0.2, 1.3,  0.1, 0.2, 1.3 };
+    mesh->normals = { 0.6, 0.8, 0.0,  0.6, 0.8, 0.0,  0.6, 0.8, 0.0,  0.6, 0.8, 0.0 };
+    mesh->uvs = { 0.1f, 0.1f,  0.7f, 0.1f,  0.7f, 0.7f,  0.1f, 0.7f };
+    mesh->tag_names.push_back("Default");
+    mesh->AddPolygon({ 0, 3, 2, 1 }, 0);
+    
+    scene.Add(LXsITYPE_MESH, "Quad")->mesh = mesh;
+}
+
+static std::string Save(const std::string& path)
+{
+    THREESceneSaver saver;
+    if (!saver.ss_Format()->ff_Open(path.c_str())) {
+        return std::string();
+    }
+    
+    LxResult result = saver.ss_Save();
+    bool ok = LXx_OK(result) && !saver.ss_Format()->ff_HasError();
+    saver.ss_Format()->ff_Cleanup();
+    
+    std::ifstream is(path.c_str(), std::ios::in | std::ios::binary);
+    std::string text((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    unlink(path.c_str());
+    
+    return ok ? text : std::string();
+}
+
+// the numbers of the array that follows key, which has to be there
+static void CheckArray(const std::string& text, const char* key, const char* config)
+{
+    std::string start = std::string("\"") + key + "\":[";
+    size_t begin = text.find(start);
+    if (begin == std::string::npos) {
+        fprintf(stderr, "FAIL %s: no %s array\n", config, key);
+        failures++;
+        return;
+    }
+    
+    begin += start.size();
+    while (text[begin] == '[') {
+        begin++;
+    }
+    size_t end = text.find(']', begin);
+    
+    std::string array = text.substr(begin, end - begin);
+    size_t position = 0;
+    while (position <= array.size()) {
+        size_t comma = array.find(',', position);
+        if (comma == std::string::npos) {
+            comma = array.size();
+        }
+        
+        std::string number = array.substr(position, comma - position);
+        if (kNumbers.count(number) == 0) {
+            fprintf(stderr, "FAIL %s: %s holds %s\n", config, key, number.c_str());
+            failures++;
+            return;
+        }
+        
+        position = comma + 1;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::string directory = argc > 1 ? argv[1] : "/tmp";
+    std::string path = directory + "/threeio-exporttest.json";
+    
+    standin::Scene scene;
+    MakeScene(scene);
+    standin::SetScene(&scene);
+    
+    struct Config {
+        const char* name;
+        std::vector<std::pair<const char*, const char*>> values;
+        std::vector<const char*> arrays;
+    };
+    
+    const std::vector<Config> configs = {
+        { "BufferGeometry", { { "threeio.geometry.type", "0" } },
+            { "position", "normal", "uv", "min", "max" } },
+        { "BufferGeometry, 4 decimals", { { "threeio.geometry.type", "0" }, { "threeio.precision.enabled", "1" },
+            { "threeio.precision.value", "4" } }, { "position", "normal", "uv", "min", "max" } },
+        { "BufferGeometry, float32", { { "threeio.geometry.type", "0" }, { "threeio.precision.float32", "1" } },
+            { "position", "normal", "uv", "min", "max" } },
+        { "Geometry", { { "threeio.geometry.type", "1" } }, { "vertices", "normals", "uvs", "min", "max" } },
+    };
+    
+    for (auto& config : configs) {
+        standin::ClearUserValues();
+        standin::SetUserValue("threeio.json.pretty", "0");
+        for (auto& value : config.values) {
+            standin::SetUserValue(value.first, value.second);
+        }
+        
+        std::string text = Save(path);
+        if (text.empty()) {
+            fprintf(stderr, "FAIL %s: save failed\n", config.name);
+            failures++;
+            continue;
+        }
+        
+        for (const char* key : config.arrays) {
+            // attributes hold their numbers in an array of their own
+            std::string attribute = std::string("\"") + key + "\":{";
+            size_t at = text.find(attribute);
+            CheckArray(at == std::string::npos ? text : text.substr(at), at == std::string::npos ? key : "array",
+                       config.name);
+        }
+    }
+    
+    if (failures > 0) {
+        fprintf(stderr, "export: %d checks failed\n", failures);
+        return 1;
+    }
+    
+    printf("export: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef __threeio__standin_action__
+#define __threeio__standin_action__
+
+#include "lx_mesh.hpp"
+
+#define LXs_ACTIONLAYER_EDIT "edit"
+
+class CLxUser_Item;
+
+class CLxUser_ChannelRead : public CLxLocalizedObject
+{
+public:
+    LxResult Integer(ILxUnknownID, unsigned, int*);
+    LxResult String(ILxUnknownID, unsigned, const char**);
+    LxResult Integer(CLxUser_Item&, unsigned, int*);
+    LxResult String(CLxUser_Item&, unsigned, const char**);
+    LxResult Double(CLxUser_Item&, unsigned, double*);
+};
+
+#endif // /* defined(__threeio__standin_action__) */
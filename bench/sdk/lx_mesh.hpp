@@ -0,0 +1,36 @@
+#ifndef __threeio__standin_mesh__
+#define __threeio__standin_mesh__
+
+#include "lxu_format.hpp"
+#include "lx_visitor.hpp"
+
+#define LXi_PTAG_MATR 0x4D415452
+#define LXi_VMAP_TEXTUREUV 0x54585556
+
+class CLxLocalizedObject
+{
+public:
+    bool test() const { return true; }
+};
+
+class CLxUser_MeshMap : public CLxLocalizedObject
+{
+public:
+    LxResult FilterByType(LXtID4);
+    LxResult Enum(CLxImpl_AbstractVisitor*);
+    LxResult Name(const char**);
+    
+    const standin::Mesh* mesh_ = nullptr;
+    LXtID4 type_ = 0;
+    bool current_ = false;
+};
+
+class CLxUser_Mesh : public CLxLocalizedObject
+{
+public:
+    bool GetMaps(CLxUser_MeshMap&);
+    
+    const standin::Mesh* mesh_ = nullptr;
+};
+
+#endif // /* defined(__threeio__standin_mesh__) */
@@ -0,0 +1,13 @@
+#ifndef __threeio__standin_visitor__
+#define __threeio__standin_visitor__
+
+#include "lxu_format.hpp"
+
+class CLxImpl_AbstractVisitor
+{
+public:
+    virtual ~CLxImpl_AbstractVisitor() {}
+    virtual LxResult Evaluate() = 0;
+};
+
+#endif // /* defined(__threeio__standin_visitor__) */
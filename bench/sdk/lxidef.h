@@ -0,0 +1,4 @@
+#ifndef __threeio__standin_idef__
+#define __threeio__standin_idef__
+
+#endif // /* defined(__threeio__standin_idef__) */
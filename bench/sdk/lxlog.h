@@ -0,0 +1,4 @@
+#ifndef __threeio__standin_log__
+#define __threeio__standin_log__
+
+#endif // /* defined(__threeio__standin_log__) */
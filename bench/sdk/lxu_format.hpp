@@ -0,0 +1,45 @@
+//
+//  Headless stand-in for the subset of the modo SDK the plugin uses, see
+//  standin.h. Only meant for building the benchmark on machines without
+//  modo, it is not compatible with the real SDK beyond that subset.
+//
+
+#ifndef __threeio__standin_format__
+#define __threeio__standin_format__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+typedef double LXtVector[3];
+typedef double LXtMatrix4[4][4];
+typedef unsigned int LxResult;
+typedef unsigned int LXtID4;
+typedef int LXtItemType;
+typedef struct st_Point *LXtPointID;
+typedef struct st_Polygon *LXtPolygonID;
+typedef void *ILxUnknownID;
+
+#define LXe_OK 0
+#define LXe_FAILED 0x80000000
+#define LXx_OK(r) (((r) & 0x80000000) == 0)
+#define LXx_FAIL(r) (!LXx_OK(r))
+
+namespace standin {
+    struct Item;
+    struct Mesh;
+    struct Scene;
+}
+
+class CLxFileFormat
+{
+public:
+    virtual ~CLxFileFormat() {}
+    virtual bool ff_Open(const char *) { return false; }
+    virtual void ff_Enable(bool) {}
+    virtual bool ff_HasError() { return false; }
+    virtual void ff_Cleanup() {}
+};
+
+#endif // /* defined(__threeio__standin_format__) */
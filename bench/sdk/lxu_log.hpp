@@ -0,0 +1,17 @@
+#ifndef __threeio__standin_log_message__
+#define __threeio__standin_log_message__
+
+// messages end up in standin::LogMessages()
+class CLxLuxologyLogMessage
+{
+public:
+    virtual ~CLxLuxologyLogMessage() {}
+    virtual const char* GetFormat() = 0;
+    
+    void Setup();
+    void Info(const char*);
+    void Warning(const char*);
+    void Error(const char*);
+};
+
+#endif // /* defined(__threeio__standin_log_message__) */
@@ -0,0 +1,19 @@
+#ifndef __threeio__standin_queries__
+#define __threeio__standin_queries__
+
+#include <string>
+
+// reads the values set with standin::SetUserValue
+class CLxReadUserValue
+{
+public:
+    bool Query(const char*);
+    int GetInt();
+    double GetFlt();
+    const char* GetString();
+    
+private:
+    std::string value_;
+};
+
+#endif // /* defined(__threeio__standin_queries__) */
@@ -0,0 +1,192 @@
+#ifndef __threeio__standin_scene__
+#define __threeio__standin_scene__
+
+#include <string>
+
+#include "lx_action.hpp"
+
+struct LXtTagInfoDesc {
+    const char* type;
+    const char* info;
+};
+
+#define LXsSAV_OUTCLASS "saver.outClass"
+#define LXsSAV_DOSTYPE "saver.dosType"
+#define LXsSRV_USERNAME "server.username"
+#define LXsSRV_LOGSUBSYSTEM "server.logSubsystem"
+#define LXa_SCENE "scene"
+
+#define LXsGRAPH_XFRMCORE "xfrmCore"
+#define LXsGRAPH_SHADELOC "shadeLoc"
+
+#define LXsITYPE_SCENE "scene"
+#define LXsITYPE_LOCATOR "locator"
+#define LXsITYPE_MESH "mesh"
+#define LXsITYPE_MESHINST "meshInst"
+#define LXsITYPE_GROUPLOCATOR "groupLocator"
+#define LXsITYPE_POLYRENDER "polyRender"
+#define LXsITYPE_TEXTURELAYER "textureLayer"
+#define LXsITYPE_MASK "mask"
+#define LXsITYPE_IMAGEMAP "imageMap"
+#define LXsITYPE_ADVANCEDMATERIAL "advancedMaterial"
+#define LXsITYPE_VIDEOSTILL "videoStill"
+
+#define LXsICHAN_TEXTURELAYER_ENABLE "enable"
+#define LXsICHAN_TEXTURELAYER_OPACITY "opacity"
+#define LXsICHAN_TEXTURELAYER_BLEND "blend"
+#define LXsICHAN_MASK_PTAG "ptag"
+#define LXsICHAN_VIDEOSTILL_FILENAME "filename"
+#define LXsICHAN_VIDEOSTILL_FORMAT "format"
+#define LXsICHAN_MESH_MESH "mesh"
+#define LXsICHAN_ADVANCEDMATERIAL_DIFFAMT "diffAmt"
+#define LXsICHAN_ADVANCEDMATERIAL_DIFFCOL "diffCol"
+#define LXsICHAN_ADVANCEDMATERIAL_SPECAMT "specAmt"
+#define LXsICHAN_ADVANCEDMATERIAL_SPECCOL "specCol"
+#define LXsICHAN_ADVANCEDMATERIAL_SPECFRES "specFres"
+#define LXsICHAN_ADVANCEDMATERIAL_ROUGH "rough"
+#define LXsICHAN_ADVANCEDMATERIAL_RADIANCE "radiance"
+#define LXsICHAN_ADVANCEDMATERIAL_LUMICOL "lumiCol"
+#define LXsICHAN_ADVANCEDMATERIAL_DBLSIDED "dblSided"
+#define LXsICHAN_ADVANCEDMATERIAL_TRANAMT "tranAmt"
+
+#define LXs_FX_DIFFCOLOR "diffColor"
+#define LXs_FX_SPECCOLOR "specColor"
+#define LXs_FX_LUMICOLOR "lumiColor"
+#define LXs_FX_BUMP "bump"
+
+// servers are created directly by the benchmark
+#define LXx_ADD_SERVER(cls, type, name) ((void)0)
+
+class CLxUser_Item : public CLxLocalizedObject
+{
+public:
+    CLxUser_Item() {}
+    CLxUser_Item(ILxUnknownID item) { set(item); }
+    
+    operator ILxUnknownID() const { return (ILxUnknownID)item_; }
+    bool set(ILxUnknownID);
+    
+    bool IsA(LXtItemType) const;
+    LxResult Ident(const char**) const;
+    LxResult UniqueName(const char**) const;
+    bool GetUniqueName(std::string&) const;
+    
+    LxResult SubCount(unsigned*) const;
+    LxResult SubByIndex(unsigned, CLxUser_Item&) const;
+    bool GetSubItem(unsigned, CLxUser_Item&) const;
+    bool Parent(CLxUser_Item&) const;
+    
+    unsigned ChannelIndex(const char*) const;
+    
+    standin::Item* item_ = nullptr;
+};
+
+typedef CLxUser_Item CLxLoc_Item;
+
+class CLxUser_SceneGraph : public CLxLocalizedObject
+{
+public:
+    std::string name_;
+};
+
+class CLxUser_ItemGraph : public CLxLocalizedObject
+{
+public:
+    bool set(CLxUser_SceneGraph&);
+    unsigned Forward(CLxUser_Item&);
+    bool Forward(CLxUser_Item&, unsigned, CLxUser_Item&);
+    
+private:
+    bool shade_loc_ = false;
+};
+
+class CLxUser_Scene : public CLxLocalizedObject
+{
+public:
+    CLxUser_Scene& operator=(ILxUnknownID);
+    
+    bool GetChannels(CLxUser_ChannelRead&, const char*);
+    bool GetChannels(CLxUser_ChannelRead&, double);
+    bool GetGraph(const char*, CLxUser_SceneGraph&);
+    bool GetItem(LXtItemType, CLxUser_Item&);
+    bool GetItemByIdent(const char*, CLxUser_Item&);
+    
+private:
+    standin::Scene* scene_ = nullptr;
+};
+
+class CLxUser_SceneService
+{
+public:
+    LxResult GetMeshInstSourceItem(ILxUnknownID, CLxUser_Item&);
+};
+
+/*
+ * Scene saver over the scene set with standin::SetScene. Items are
+ * visited in creation order, polygons and points in mesh order.
+ */
+class CLxSceneSaver
+{
+public:
+    virtual ~CLxSceneSaver() {}
+    
+    virtual CLxFileFormat* ss_Format() = 0;
+    virtual void ss_Verify() {}
+    virtual LxResult ss_Save() = 0;
+    virtual void ss_Point() {}
+    virtual void ss_Polygon() {}
+    
+    ILxUnknownID SceneObject();
+    bool ReallySaving();
+    
+    void StartScan(const char* = 0);
+    bool NextItem();
+    bool NextMesh();
+    
+    bool SetItem(ILxUnknownID);
+    bool SetItem(CLxUser_Item&);
+    bool GetItem(CLxUser_Item&) const;
+    
+    LXtItemType ItemType(const char*);
+    bool ItemIsA(const char*) const;
+    bool ItemIsA(LXtItemType) const;
+    const char* ItemName() const;
+    const char* ItemIdentity() const;
+    bool ItemVisible() const;
+    
+    int ChanInt(const char*);
+    double ChanFloat(const char*);
+    const char* ChanString(const char*);
+    void ChanColor(const char*, LXtVector);
+    bool ChanObject(const char*, CLxUser_Mesh&);
+    
+    unsigned PointCount();
+    unsigned PolyCount();
+    void WritePoints();
+    void WritePolys(unsigned = 0, bool = false);
+    
+    void PntSet(LXtPointID);
+    LXtPointID PntID();
+    void PntPosition(double[3]);
+    
+    void PolySet(LXtPolygonID);
+    LXtPolygonID PolyID();
+    unsigned PolyNumVerts();
+    LXtPointID PolyVertex(unsigned);
+    bool PolyNormal(double[3], LXtPointID = 0);
+    const char* PolyTag(LXtID4);
+    bool PolyMapValue(float*, LXtPointID);
+    bool SetMap(LXtID4, const char*);
+    
+    const char* LayerEffect();
+    bool TxtrImage();
+    
+private:
+    standin::Item* item_ = nullptr;
+    size_t scan_ = 0;
+    unsigned point_ = 0;
+    unsigned polygon_ = 0;
+    bool map_ = false;
+};
+
+#endif // /* defined(__threeio__standin_scene__) */
@@ -0,0 +1,17 @@
+#ifndef __threeio__standin_locator__
+#define __threeio__standin_locator__
+
+#include "lxu_scene.hpp"
+
+class CLxLoc_Locator
+{
+public:
+    bool set(CLxUser_Item&);
+    LxResult LocalTransform4(CLxUser_ChannelRead&, LXtMatrix4);
+    LxResult WorldTransform4(CLxUser_ChannelRead&, LXtMatrix4);
+    
+private:
+    const standin::Item* item_ = nullptr;
+};
+
+#endif // /* defined(__threeio__standin_locator__) */
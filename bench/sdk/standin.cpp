@@ -0,0 +1,806 @@
+#include "standin.h"
+
+#include <cmath>
+#include <cstdlib>
+
+#include "lxu_log.hpp"
+#include "lxu_queries.hpp"
+#include "lxu_scene.hpp"
+#include "lxw_locator.hpp"
+
+namespace standin {
+
+namespace {
+
+Scene* current_scene = nullptr;
+std::map<std::string, std::string> user_values;
+std::vector<std::string> log_messages;
+
+// item types and channels are referred to by index
+std::vector<std::string> names;
+
+unsigned Intern(const std::string& name)
+{
+    for (unsigned i = 0; i < names.size(); ++i) {
+        if (names[i] == name) {
+            return i;
+        }
+    }
+    
+    names.push_back(name);
+    return static_cast<unsigned>(names.size() - 1);
+}
+
+const std::string& Name(unsigned index)
+{
+    static const std::string empty;
+    return index < names.size() ? names[index] : empty;
+}
+
+}
+
+Scene::Scene()
+{
+    Add(LXsITYPE_SCENE, "Scene");
+}
+
+Item* Scene::Add(const std::string& type, const std::string& name, Item* parent)
+{
+    std::unique_ptr<Item> item(new Item());
+    item->type = type;
+    item->name = name;
+    item->parent = parent;
+    
+    char ident[32];
+    snprintf(ident, sizeof ident, "%s%03u", type.c_str(), static_cast<unsigned>(items.size()));
+    item->ident = ident;
+    
+    if (parent) {
+        parent->children.push_back(item.get());
+    }
+    
+    idents[item->ident] = item.get();
+    items.push_back(std::move(item));
+    
+    return items.back().get();
+}
+
+Item* Scene::Find(const std::string& ident) const
+{
+    auto iter = idents.find(ident);
+    return iter != idents.end() ? iter->second : nullptr;
+}
+
+Item* Scene::First(const std::string& type) const
+{
+    for (auto& item : items) {
+        if (IsA(item.get(), type)) {
+            return item.get();
+        }
+    }
+    
+    return nullptr;
+}
+
+bool IsA(const Item* item, const std::string& type)
+{
+    if (!item) {
+        return false;
+    }
+    
+    if (item->type == type) {
+        return true;
+    }
+    
+    if (type == LXsITYPE_LOCATOR) {
+        return item->type == LXsITYPE_MESH || item->type == LXsITYPE_MESHINST ||
+               item->type == LXsITYPE_GROUPLOCATOR;
+    }
+    
+    if (type == LXsITYPE_TEXTURELAYER) {
+        return item->type == LXsITYPE_MASK || item->type == LXsITYPE_IMAGEMAP ||
+               item->type == LXsITYPE_ADVANCEDMATERIAL;
+    }
+    
+    return false;
+}
+
+void SetScene(Scene* scene)
+{
+    current_scene = scene;
+}
+
+Scene* CurrentScene()
+{
+    return current_scene;
+}
+
+void SetUserValue(const std::string& name, const std::string& value)
+{
+    user_values[name] = value;
+}
+
+void ClearUserValues()
+{
+    user_values.clear();
+}
+
+const std::vector<std::string>& LogMessages()
+{
+    return log_messages;
+}
+
+// exposed to the SDK classes below
+unsigned InternName(const std::string& name)
+{
+    return Intern(name);
+}
+
+const std::string& InternedName(unsigned index)
+{
+    return Name(index);
+}
+
+bool UserValue(const std::string& name, std::string& value)
+{
+    auto iter = user_values.find(name);
+    if (iter == user_values.end()) {
+        return false;
+    }
+    
+    value = iter->second;
+    return true;
+}
+
+void Log(const char* kind, const char* message)
+{
+    log_messages.push_back(std::string(kind) + ": " + (message ? message : ""));
+}
+
+void ClearLog()
+{
+    log_messages.clear();
+}
+
+}
+
+using standin::Item;
+using standin::Mesh;
+
+// points and polygons are handed out as 1 based indices
+static inline LXtPointID PointID(unsigned index)
+{
+    return reinterpret_cast<LXtPointID>(static_cast<uintptr_t>(index) + 1);
+}
+
+static inline unsigned PointIndex(LXtPointID point)
+{
+    return static_cast<unsigned>(reinterpret_cast<uintptr_t>(point) - 1);
+}
+
+//----------------------------------------------------------------------------
+// meshes and maps
+
+bool CLxUser_Mesh::GetMaps(CLxUser_MeshMap& map)
+{
+    map.mesh_ = mesh_;
+    map.type_ = 0;
+    map.current_ = false;
+    return mesh_ != nullptr;
+}
+
+LxResult CLxUser_MeshMap::FilterByType(LXtID4 type)
+{
+    type_ = type;
+    return LXe_OK;
+}
+
+LxResult CLxUser_MeshMap::Enum(CLxImpl_AbstractVisitor* visitor)
+{
+    // the only map of a stand-in mesh is its uv map
+    if (mesh_ && !mesh_->uvs.empty() && (type_ == 0 || type_ == LXi_VMAP_TEXTUREUV)) {
+        current_ = true;
+        visitor->Evaluate();
+        current_ = false;
+    }
+    
+    return LXe_OK;
+}
+
+LxResult CLxUser_MeshMap::Name(const char** name)
+{
+    if (!mesh_ || !current_) {
+        return LXe_FAILED;
+    }
+    
+    *name = mesh_->uv_map.c_str();
+    return LXe_OK;
+}
+
+//----------------------------------------------------------------------------
+// channels
+
+static LxResult ReadInteger(const Item* item, unsigned index, int* value)
+{
+    if (!item) {
+        return LXe_FAILED;
+    }
+    
+    auto iter = item->ints.find(standin::InternedName(index));
+    *value = iter != item->ints.end() ? iter->second : 0;
+    return LXe_OK;
+}
+
+static LxResult ReadString(const Item* item, unsigned index, const char** value)
+{
+    if (!item) {
+        return LXe_FAILED;
+    }
+    
+    auto iter = item->strings.find(standin::InternedName(index));
+    *value = iter != item->strings.end() ? iter->second.c_str() : nullptr;
+    return LXe_OK;
+}
+
+LxResult CLxUser_ChannelRead::Integer(ILxUnknownID item, unsigned index, int* value)
+{
+    return ReadInteger(static_cast<Item*>(item), index, value);
+}
+
+LxResult CLxUser_ChannelRead::String(ILxUnknownID item, unsigned index, const char** value)
+{
+    return ReadString(static_cast<Item*>(item), index, value);
+}
+
+LxResult CLxUser_ChannelRead::Integer(CLxUser_Item& item, unsigned index, int* value)
+{
+    return ReadInteger(item.item_, index, value);
+}
+
+LxResult CLxUser_ChannelRead::String(CLxUser_Item& item, unsigned index, const char** value)
+{
+    return ReadString(item.item_, index, value);
+}
+
+LxResult CLxUser_ChannelRead::Double(CLxUser_Item& item, unsigned index, double* value)
+{
+    if (!item.item_) {
+        return LXe_FAILED;
+    }
+    
+    auto iter = item.item_->floats.find(standin::InternedName(index));
+    *value = iter != item.item_->floats.end() ? iter->second : 0;
+    return LXe_OK;
+}
+
+//----------------------------------------------------------------------------
+// items
+
+bool CLxUser_Item::set(ILxUnknownID item)
+{
+    item_ = static_cast<Item*>(item);
+    return item_ != nullptr;
+}
+
+bool CLxUser_Item::IsA(LXtItemType type) const
+{
+    return standin::IsA(item_, standin::InternedName(type));
+}
+
+LxResult CLxUser_Item::Ident(const char** ident) const
+{
+    if (!item_) {
+        return LXe_FAILED;
+    }
+    
+    *ident = item_->ident.c_str();
+    return LXe_OK;
+}
+
+LxResult CLxUser_Item::UniqueName(const char** name) const
+{
+    if (!item_) {
+        return LXe_FAILED;
+    }
+    
+    *name = item_->name.c_str();
+    return LXe_OK;
+}
+
+bool CLxUser_Item::GetUniqueName(std::string& name) const
+{
+    if (!item_) {
+        return false;
+    }
+    
+    name = item_->name;
+    return true;
+}
+
+LxResult CLxUser_Item::SubCount(unsigned* count) const
+{
+    if (!item_) {
+        return LXe_FAILED;
+    }
+    
+    *count = static_cast<unsigned>(item_->children.size());
+    return LXe_OK;
+}
+
+LxResult CLxUser_Item::SubByIndex(unsigned index, CLxUser_Item& child) const
+{
+    return GetSubItem(index, child) ? LXe_OK : LXe_FAILED;
+}
+
+bool CLxUser_Item::GetSubItem(unsigned index, CLxUser_Item& child) const
+{
+    if (!item_ || index >= item_->children.size()) {
+        return false;
+    }
+    
+    return child.set(item_->children[index]);
+}
+
+bool CLxUser_Item::Parent(CLxUser_Item& parent) const
+{
+    if (!item_ || !item_->parent) {
+        return false;
+    }
+    
+    return parent.set(item_->parent);
+}
+
+unsigned CLxUser_Item::ChannelIndex(const char* channel) const
+{
+    return standin::InternName(channel);
+}
+
+bool CLxUser_ItemGraph::set(CLxUser_SceneGraph& graph)
+{
+    shade_loc_ = graph.name_ == LXsGRAPH_SHADELOC;
+    return true;
+}
+
+unsigned CLxUser_ItemGraph::Forward(CLxUser_Item& item)
+{
+    if (!shade_loc_ || !item.item_) {
+        return 0;
+    }
+    
+    return static_cast<unsigned>(item.item_->shade_links.size());
+}
+
+bool CLxUser_ItemGraph::Forward(CLxUser_Item& item, unsigned index, CLxUser_Item& linked)
+{
+    if (index >= Forward(item)) {
+        return false;
+    }
+    
+    return linked.set(item.item_->shade_links[index]);
+}
+
+//----------------------------------------------------------------------------
+// scene
+
+CLxUser_Scene& CLxUser_Scene::operator=(ILxUnknownID scene)
+{
+    scene_ = static_cast<standin::Scene*>(scene);
+    return *this;
+}
+
+bool CLxUser_Scene::GetChannels(CLxUser_ChannelRead&, const char*)
+{
+    return scene_ != nullptr;
+}
+
+bool CLxUser_Scene::GetChannels(CLxUser_ChannelRead&, double)
+{
+    return scene_ != nullptr;
+}
+
+bool CLxUser_Scene::GetGraph(const char* name, CLxUser_SceneGraph& graph)
+{
+    graph.name_ = name;
+    return scene_ != nullptr;
+}
+
+bool CLxUser_Scene::GetItem(LXtItemType type, CLxUser_Item& item)
+{
+    return scene_ && item.set(scene_->First(standin::InternedName(type)));
+}
+
+bool CLxUser_Scene::GetItemByIdent(const char* ident, CLxUser_Item& item)
+{
+    return scene_ && item.set(scene_->Find(ident));
+}
+
+LxResult CLxUser_SceneService::GetMeshInstSourceItem(ILxUnknownID instance, CLxUser_Item& source)
+{
+    auto item = static_cast<Item*>(instance);
+    if (!item || !item->source) {
+        return LXe_FAILED;
+    }
+    
+    source.set(item->source);
+    return LXe_OK;
+}
+
+//----------------------------------------------------------------------------
+// locators
+
+bool CLxLoc_Locator::set(CLxUser_Item& item)
+{
+    item_ = standin::IsA(item.item_, LXsITYPE_LOCATOR) ? item.item_ : nullptr;
+    return item_ != nullptr;
+}
+
+LxResult CLxLoc_Locator::LocalTransform4(CLxUser_ChannelRead&, LXtMatrix4 transform)
+{
+    if (!item_) {
+        return LXe_FAILED;
+    }
+    
+    memcpy(transform, item_->transform, sizeof(LXtMatrix4));
+    return LXe_OK;
+}
+
+LxResult CLxLoc_Locator::WorldTransform4(CLxUser_ChannelRead&, LXtMatrix4 transform)
+{
+    if (!item_) {
+        return LXe_FAILED;
+    }
+    
+    // row vectors, so the parent's transform is applied last
+    memcpy(transform, item_->transform, sizeof(LXtMatrix4));
+    for (const Item* parent = item_->parent; parent; parent = parent->parent) {
+        LXtMatrix4 world;
+        for (unsigned row = 0; row < 4; ++row) {
+            for (unsigned col = 0; col < 4; ++col) {
+                world[row][col] = 0;
+                for (unsigned k = 0; k < 4; ++k) {
+                    world[row][col] += transform[row][k] * parent->transform[k][col];
+                }
+            }
+        }
+        memcpy(transform, world, sizeof(LXtMatrix4));
+    }
+    
+    return LXe_OK;
+}
+
+//----------------------------------------------------------------------------
+// log and user values
+
+void CLxLuxologyLogMessage::Setup()
+{
+    standin::ClearLog();
+}
+
+void CLxLuxologyLogMessage::Info(const char* message)
+{
+    standin::Log("info", message);
+}
+
+void CLxLuxologyLogMessage::Warning(const char* message)
+{
+    standin::Log("warning", message);
+}
+
+void CLxLuxologyLogMessage::Error(const char* message)
+{
+    standin::Log("error", message);
+}
+
+bool CLxReadUserValue::Query(const char* name)
+{
+    return standin::UserValue(name, value_);
+}
+
+int CLxReadUserValue::GetInt()
+{
+    // booleans may be given by name
+    if (value_ == "true") {
+        return 1;
+    }
+    
+    return std::atoi(value_.c_str());
+}
+
+double CLxReadUserValue::GetFlt()
+{
+    return std::atof(value_.c_str());
+}
+
+const char* CLxReadUserValue::GetString()
+{
+    return value_.c_str();
+}
+
+//----------------------------------------------------------------------------
+// scene saver
+
+ILxUnknownID CLxSceneSaver::SceneObject()
+{
+    return standin::CurrentScene();
+}
+
+bool CLxSceneSaver::ReallySaving()
+{
+    return true;
+}
+
+void CLxSceneSaver::StartScan(const char*)
+{
+    scan_ = 0;
+    item_ = nullptr;
+}
+
+bool CLxSceneSaver::NextItem()
+{
+    auto scene = standin::CurrentScene();
+    if (!scene || scan_ >= scene->items.size()) {
+        item_ = nullptr;
+        return false;
+    }
+    
+    item_ = scene->items[scan_++].get();
+    return true;
+}
+
+bool CLxSceneSaver::NextMesh()
+{
+    while (NextItem()) {
+        if (item_->type == LXsITYPE_MESH) {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+bool CLxSceneSaver::SetItem(ILxUnknownID item)
+{
+    item_ = static_cast<Item*>(item);
+    map_ = false;
+    return item_ != nullptr;
+}
+
+bool CLxSceneSaver::SetItem(CLxUser_Item& item)
+{
+    return SetItem((ILxUnknownID)item);
+}
+
+bool CLxSceneSaver::GetItem(CLxUser_Item& item) const
+{
+    return item.set(item_);
+}
+
+LXtItemType CLxSceneSaver::ItemType(const char* type)
+{
+    return static_cast<LXtItemType>(standin::InternName(type));
+}
+
+bool CLxSceneSaver::ItemIsA(const char* type) const
+{
+    return standin::IsA(item_, type);
+}
+
+bool CLxSceneSaver::ItemIsA(LXtItemType type) const
+{
+    return standin::IsA(item_, standin::InternedName(type));
+}
+
+const char* CLxSceneSaver::ItemName() const
+{
+    return item_ ? item_->name.c_str() : nullptr;
+}
+
+const char* CLxSceneSaver::ItemIdentity() const
+{
+    return item_ ? item_->ident.c_str() : "";
+}
+
+bool CLxSceneSaver::ItemVisible() const
+{
+    return item_ && item_->visible;
+}
+
+int CLxSceneSaver::ChanInt(const char* channel)
+{
+    int value = 0;
+    ReadInteger(item_, standin::InternName(channel), &value);
+    return value;
+}
+
+double CLxSceneSaver::ChanFloat(const char* channel)
+{
+    if (!item_) {
+        return 0;
+    }
+    
+    auto iter = item_->floats.find(channel);
+    return iter != item_->floats.end() ? iter->second : 0;
+}
+
+const char* CLxSceneSaver::ChanString(const char* channel)
+{
+    const char* value = nullptr;
+    ReadString(item_, standin::InternName(channel), &value);
+    return value ? value : "";
+}
+
+void CLxSceneSaver::ChanColor(const char* channel, LXtVector color)
+{
+    std::string name(channel);
+    color[0] = ChanFloat((name + ".R").c_str());
+    color[1] = ChanFloat((name + ".G").c_str());
+    color[2] = ChanFloat((name + ".B").c_str());
+}
+
+bool CLxSceneSaver::ChanObject(const char* channel, CLxUser_Mesh& mesh)
+{
+    mesh.mesh_ = item_ && std::string(channel) == LXsICHAN_MESH_MESH ? item_->mesh.get() : nullptr;
+    return mesh.mesh_ != nullptr;
+}
+
+unsigned CLxSceneSaver::PointCount()
+{
+    return item_ && item_->mesh ? item_->mesh->PointCount() : 0;
+}
+
+unsigned CLxSceneSaver::PolyCount()
+{
+    return item_ && item_->mesh ? item_->mesh->PolygonCount() : 0;
+}
+
+void CLxSceneSaver::WritePoints()
+{
+    if (!item_ || !item_->mesh) {
+        return;
+    }
+    
+    unsigned count = item_->mesh->PointCount();
+    for (point_ = 0; point_ < count; ++point_) {
+        ss_Point();
+    }
+}
+
+void CLxSceneSaver::WritePolys(unsigned, bool)
+{
+    if (!item_ || !item_->mesh) {
+        return;
+    }
+    
+    unsigned count = item_->mesh->PolygonCount();
+    for (polygon_ = 0; polygon_ < count; ++polygon_) {
+        ss_Polygon();
+    }
+}
+
+void CLxSceneSaver::PntSet(LXtPointID point)
+{
+    point_ = PointIndex(point);
+}
+
+LXtPointID CLxSceneSaver::PntID()
+{
+    return PointID(point_);
+}
+
+void CLxSceneSaver::PntPosition(double position[3])
+{
+    const double* p = &item_->mesh->points[point_ * 3];
+    position[0] = p[0];
+    position[1] = p[1];
+    position[2] = p[2];
+}
+
+void CLxSceneSaver::PolySet(LXtPolygonID polygon)
+{
+    polygon_ = static_cast<unsigned>(reinterpret_cast<uintptr_t>(polygon) - 1);
+}
+
+LXtPolygonID CLxSceneSaver::PolyID()
+{
+    return reinterpret_cast<LXtPolygonID>(static_cast<uintptr_t>(polygon_) + 1);
+}
+
+unsigned CLxSceneSaver::PolyNumVerts()
+{
+    return item_->mesh->Corners(polygon_);
+}
+
+LXtPointID CLxSceneSaver::PolyVertex(unsigned index)
+{
+    const Mesh& mesh = *item_->mesh;
+    return PointID(mesh.corners[mesh.polygons[polygon_] + index]);
+}
+
+bool CLxSceneSaver::PolyNormal(double normal[3], LXtPointID point)
+{
+    const Mesh& mesh = *item_->mesh;
+    
+    if (point) {
+        if (mesh.normals.empty()) {
+            return false;
+        }
+        
+        const double* n = &mesh.normals[PointIndex(point) * 3];
+        normal[0] = n[0];
+        normal[1] = n[1];
+        normal[2] = n[2];
+        return true;
+    }
+    
+    // Newell normal of the polygon
+    unsigned start = mesh.polygons[polygon_];
+    unsigned count = mesh.Corners(polygon_);
+    double n[3] = { 0, 0, 0 };
+    
+    for (unsigned i = 0; i < count; ++i) {
+        const double* a = &mesh.points[mesh.corners[start + i] * 3];
+        const double* b = &mesh.points[mesh.corners[start + (i + 1) % count] * 3];
+        
+        n[0] += (a[1] - b[1]) * (a[2] + b[2]);
+        n[1] += (a[2] - b[2]) * (a[0] + b[0]);
+        n[2] += (a[0] - b[0]) * (a[1] + b[1]);
+    }
+    
+    double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (length == 0) {
+        return false;
+    }
+    
+    normal[0] = n[0] / length;
+    normal[1] = n[1] / length;
+    normal[2] = n[2] / length;
+    return true;
+}
+
+const char* CLxSceneSaver::PolyTag(LXtID4 type)
+{
+    const Mesh& mesh = *item_->mesh;
+    
+    if (type != LXi_PTAG_MATR || mesh.tag_names.empty()) {
+        return nullptr;
+    }
+    
+    return mesh.tag_names[mesh.tags[polygon_]].c_str();
+}
+
+bool CLxSceneSaver::PolyMapValue(float* value, LXtPointID point)
+{
+    const Mesh& mesh = *item_->mesh;
+    
+    if (!map_ || mesh.uvs.empty()) {
+        return false;
+    }
+    
+    const float* uv = &mesh.uvs[PointIndex(point) * 2];
+    value[0] = uv[0];
+    value[1] = uv[1];
+    return true;
+}
+
+bool CLxSceneSaver::SetMap(LXtID4 type, const char* name)
+{
+    map_ = item_ && item_->mesh && type == LXi_VMAP_TEXTUREUV && !item_->mesh->uvs.empty() &&
+           name && item_->mesh->uv_map == name;
+    return map_;
+}
+
+const char* CLxSceneSaver::LayerEffect()
+{
+    return item_ && !item_->effect.empty() ? item_->effect.c_str() : nullptr;
+}
+
+bool CLxSceneSaver::TxtrImage()
+{
+    // moves on to the image of the current image map
+    if (!item_ || !item_->image) {
+        return false;
+    }
+    
+    item_ = item_->image;
+    return true;
+}
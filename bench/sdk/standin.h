@@ -0,0 +1,115 @@
+//
+//  standin.h
+//  threeio
+//
+//  In-memory scene model behind the headless SDK stand-in. The benchmark
+//  builds scenes with it and the stand-in SDK classes read from it, so
+//  the savers run unchanged without modo.
+//
+
+#ifndef __threeio__standin__
+#define __threeio__standin__
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "lxu_format.hpp"
+
+namespace standin {
+
+// Polygons index into shared points. Normals and uvs are per point, which
+// is all the savers can tell apart through the polygon visitor anyway.
+struct Mesh {
+    std::vector<double> points;         // x, y, z
+    std::vector<double> normals;        // x, y, z per point, empty for none
+    std::vector<float> uvs;             // u, v per point, empty for none
+    std::string uv_map = "Texture";
+    
+    std::vector<unsigned> polygons;     // start of each polygon in corners
+    std::vector<unsigned> corners;      // point indices
+    std::vector<unsigned> tags;         // tag index of each polygon
+    std::vector<std::string> tag_names;
+    
+    unsigned PointCount() const { return static_cast<unsigned>(points.size() / 3); }
+    unsigned PolygonCount() const { return static_cast<unsigned>(polygons.size()); }
+    
+    unsigned Corners(unsigned polygon) const
+    {
+        unsigned end = polygon + 1 < polygons.size() ? polygons[polygon + 1] : static_cast<unsigned>(corners.size());
+        return end - polygons[polygon];
+    }
+    
+    unsigned AddPolygon(const std::vector<unsigned>& points, unsigned tag)
+    {
+        polygons.push_back(static_cast<unsigned>(corners.size()));
+        corners.insert(corners.end(), points.begin(), points.end());
+        tags.push_back(tag);
+        return static_cast<unsigned>(polygons.size() - 1);
+    }
+};
+
+struct Item {
+    std::string type;
+    std::string ident;
+    std::string name;
+    bool visible = true;
+    
+    Item* parent = nullptr;
+    std::vector<Item*> children;
+    
+    double transform[4][4] = {
+        { 1, 0, 0, 0 },
+        { 0, 1, 0, 0 },
+        { 0, 0, 1, 0 },
+        { 0, 0, 0, 1 },
+    };
+    
+    std::map<std::string, int> ints;
+    std::map<std::string, double> floats;
+    std::map<std::string, std::string> strings;
+    
+    std::shared_ptr<Mesh> mesh;         // mesh items
+    Item* source = nullptr;             // mesh instances
+    std::string effect;                 // texture layers
+    Item* image = nullptr;              // image maps
+    std::vector<Item*> shade_links;     // masks, to the items they apply to
+    
+    void Color(const std::string& channel, double r, double g, double b)
+    {
+        floats[channel + ".R"] = r;
+        floats[channel + ".G"] = g;
+        floats[channel + ".B"] = b;
+    }
+};
+
+struct Scene {
+    Scene();
+    
+    // items are visited in the order they were added
+    Item* Add(const std::string& type, const std::string& name, Item* parent = nullptr);
+    
+    Item* Root() const { return items.front().get(); }
+    Item* Find(const std::string& ident) const;
+    Item* First(const std::string& type) const;
+    
+    std::vector<std::unique_ptr<Item>> items;
+    std::map<std::string, Item*> idents;
+};
+
+bool IsA(const Item*, const std::string& type);
+
+void SetScene(Scene*);
+Scene* CurrentScene();
+
+// threeio.* preferences read by the savers
+void SetUserValue(const std::string& name, const std::string& value);
+void ClearUserValues();
+
+// messages of the savers, cleared by every log Setup()
+const std::vector<std::string>& LogMessages();
+
+}
+
+#endif // /* defined(__threeio__standin__) */
@@ -0,0 +1,234 @@
+#include "bufferedfile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+BufferedFile::BufferedFile(size_t capacity) : capacity_(capacity)
+{
+}
+
+BufferedFile::~BufferedFile()
+{
+    Close();
+}
+
+bool BufferedFile::Open(const char* filename, Compressor::Method method, int level)
+{
+    Close();
+    
+    fd_ = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    error_ = fd_ < 0;
+    used_ = 0;
+    written_ = 0;
+    
+    if (!error_) {
+        buffer_.resize(capacity_);
+        
+        if (method != Compressor::kNone) {
+            compressor_.reset(new Compressor(fd_, method, level));
+        }
+    }
+    
+    return !error_;
+}
+
+bool BufferedFile::OpenMemory()
+{
+    Close();
+    
+    memory_ = true;
+    error_ = false;
+    used_ = 0;
+    written_ = 0;
+    
+    return true;
+}
+
+bool BufferedFile::Close()
+{
+    if (memory_) {
+        memory_ = false;
+        used_ = 0;
+        std::vector<char>().swap(buffer_);
+        return !error_;
+    }
+    
+    if (fd_ < 0) {
+        return !error_;
+    }
+    
+    Flush();
+    
+    stored_ = written_;
+    if (compressor_) {
+        if (!compressor_->Finish()) {
+            error_ = true;
+        }
+        
+        stored_ = compressor_->Written();
+        compressor_.reset();
+    }
+    
+    if (close(fd_) != 0) {
+        error_ = true;
+    }
+    fd_ = -1;
+    
+    // release the buffer, a saver instance lives as long as the plugin
+    std::vector<char>().swap(buffer_);
+    
+    return !error_;
+}
+
+bool BufferedFile::IsOpen() const
+{
+    return fd_ >= 0 || memory_;
+}
+
+bool BufferedFile::HasError() const
+{
+    return error_ || (compressor_ && compressor_->HasError());
+}
+
+uint64_t BufferedFile::Tell() const
+{
+    return written_;
+}
+
+uint64_t BufferedFile::Stored() const
+{
+    return stored_;
+}
+
+const char* BufferedFile::Data() const
+{
+    return buffer_.data();
+}
+
+void BufferedFile::Flush()
+{
+    if (used_ == 0 || memory_) {
+        return;
+    }
+    
+    size_t size = used_;
+    used_ = 0;
+    
+    // the compressor takes the buffer and hands back an empty one
+    if (compressor_) {
+        compressor_->Submit(buffer_, size);
+        buffer_.resize(capacity_);
+        return;
+    }
+    
+    // the buffered bytes are already accounted for in written_
+    written_ -= size;
+    WriteDirect(buffer_.data(), size);
+}
+
+bool BufferedFile::MakeRoom(size_t size)
+{
+    if (memory_) {
+        size_t capacity = buffer_.size() > 0 ? buffer_.size() : 64 * 1024;
+        while (capacity < used_ + size) {
+            capacity *= 2;
+        }
+        buffer_.resize(capacity);
+        return true;
+    }
+    
+    Flush();
+    
+    return size <= buffer_.size();
+}
+
+void BufferedFile::WriteDirect(const void* data, size_t size)
+{
+    written_ += size;
+    
+    if (fd_ < 0 || error_) {
+        error_ = true;
+        return;
+    }
+    
+    auto bytes = static_cast<const char*>(data);
+    
+    // larger than the buffer, handed over in buffer sized blocks
+    if (compressor_) {
+        while (size > 0) {
+            size_t count = std::min(size, buffer_.size());
+            memcpy(buffer_.data(), bytes, count);
+            
+            compressor_->Submit(buffer_, count);
+            buffer_.resize(capacity_);
+            
+            bytes += count;
+            size -= count;
+        }
+        return;
+    }
+    
+    while (size > 0) {
+        ssize_t count = write(fd_, bytes, size);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            
+            error_ = true;
+            return;
+        }
+        
+        bytes += count;
+        size -= count;
+    }
+}
+
+void BufferedFile::WriteAt(uint64_t position, const void* data, size_t size)
+{
+    if (memory_) {
+        if (position + size > used_) {
+            error_ = true;
+            return;
+        }
+        
+        memcpy(&buffer_[position], data, size);
+        return;
+    }
+    
+    Flush();
+    
+    if (fd_ < 0 || error_ || compressor_) {
+        error_ = true;
+        return;
+    }
+    
+    auto bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t count = pwrite(fd_, bytes, size, position);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            
+            error_ = true;
+            return;
+        }
+        
+        bytes += count;
+        size -= count;
+        position += count;
+    }
+}
+
+void BufferedFile::Align(unsigned alignment)
+{
+    static const char zeros[16] = { 0 };
+    
+    while (written_ % alignment != 0) {
+        size_t padding = alignment - written_ % alignment;
+        Write(zeros, padding < sizeof zeros ? padding : sizeof zeros);
+    }
+}
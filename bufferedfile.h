@@ -0,0 +1,154 @@
+#ifndef __threeio__buffered_file__
+#define __threeio__buffered_file__
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "compressor.h"
+
+// Binary output file with a large user space buffer, flushed with plain
+// write(2) calls. Numbers are stored little-endian, as expected by typed
+// arrays on the client. OpenMemory keeps all output in the growing buffer
+// instead, e.g. for fragments assembled off the main thread. A compressed
+// file hands each full buffer to a Compressor, which can not be patched
+// with WriteAt.
+class BufferedFile
+{
+public:
+    static const size_t kDefaultCapacity = 8 * 1024 * 1024;
+    
+    BufferedFile(size_t capacity = kDefaultCapacity);
+    ~BufferedFile();
+    
+    bool Open(const char*, Compressor::Method = Compressor::kNone, int level = 0);
+    bool OpenMemory();
+    bool Close();
+    
+    bool IsOpen() const;
+    bool HasError() const;
+    
+    // bytes written since Open, before compression
+    uint64_t Tell() const;
+    
+    // bytes stored in the file by the last Close, after compression
+    uint64_t Stored() const;
+    
+    // contents of an in-memory file, Tell() bytes long
+    const char* Data() const;
+    
+    void Flush();
+    
+    inline void Write(const void* data, size_t size)
+    {
+        if (used_ + size > buffer_.size() && !MakeRoom(size)) {
+            WriteDirect(data, size);
+            return;
+        }
+        
+        memcpy(&buffer_[used_], data, size);
+        used_ += size;
+        written_ += size;
+    }
+    
+    inline void Put(char c)
+    {
+        if (used_ >= buffer_.size() && !MakeRoom(1)) {
+            WriteDirect(&c, 1);
+            return;
+        }
+        
+        buffer_[used_++] = c;
+        written_++;
+    }
+    
+    // Returns room for up to size bytes to be formatted in place and
+    // handed back with Commit, or nullptr when the file is not open.
+    inline char* Reserve(size_t size)
+    {
+        if (used_ + size > buffer_.size() && !MakeRoom(size)) {
+            error_ = true;
+            return nullptr;
+        }
+        
+        return &buffer_[used_];
+    }
+    
+    inline void Commit(size_t size)
+    {
+        used_ += size;
+        written_ += size;
+    }
+    
+    // overwrites already written bytes, e.g. to patch in a header
+    void WriteAt(uint64_t position, const void*, size_t);
+    
+    inline void WriteUint16(uint16_t val)
+    {
+        val = LittleEndian(val);
+        Write(&val, sizeof val);
+    }
+    
+    inline void WriteUint32(uint32_t val)
+    {
+        val = LittleEndian(val);
+        Write(&val, sizeof val);
+    }
+    
+    inline void WriteInt8(int8_t val)
+    {
+        Write(&val, sizeof val);
+    }
+    
+    inline void WriteInt16(int16_t val)
+    {
+        WriteUint16(static_cast<uint16_t>(val));
+    }
+    
+    inline void WriteFloat32(float val)
+    {
+        uint32_t bits;
+        memcpy(&bits, &val, sizeof bits);
+        WriteUint32(bits);
+    }
+    
+    // pads with zeros up to the next multiple of alignment
+    void Align(unsigned alignment);
+    
+private:
+    
+    int fd_ = -1;
+    size_t capacity_;
+    std::vector<char> buffer_;
+    size_t used_ = 0;
+    uint64_t written_ = 0;
+    bool error_ = false;
+    bool memory_ = false;
+    uint64_t stored_ = 0;
+    std::unique_ptr<Compressor> compressor_;
+    
+    // flushes, or grows the buffer of an in-memory file, and returns
+    // whether size more bytes fit into the buffer now
+    bool MakeRoom(size_t size);
+    void WriteDirect(const void*, size_t);
+    
+    template<typename T>
+    static inline T LittleEndian(T val)
+    {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        T swapped;
+        auto src = reinterpret_cast<const unsigned char*>(&val);
+        auto dst = reinterpret_cast<unsigned char*>(&swapped);
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            dst[i] = src[sizeof(T) - 1 - i];
+        }
+        return swapped;
+#else
+        return val;
+#endif
+    }
+};
+
+#endif // /* defined(__threeio__buffered_file__) */
@@ -0,0 +1,258 @@
+#include "compressor.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#ifdef THREEIO_ZSTD
+#include <zstd.h>
+#endif
+
+bool Compressor::Available(Method method)
+{
+    switch (method) {
+        case kGzip:
+            return true;
+        case kZstd:
+#ifdef THREEIO_ZSTD
+            return true;
+#else
+            return false;
+#endif
+        default:
+            return false;
+    }
+}
+
+const char* Compressor::Extension(Method method)
+{
+    switch (method) {
+        case kGzip: return "gz";
+        case kZstd: return "zst";
+        default: return "";
+    }
+}
+
+const char* Compressor::Name(Method method)
+{
+    switch (method) {
+        case kGzip: return "gzip";
+        case kZstd: return "zstd";
+        default: return "none";
+    }
+}
+
+Compressor::Compressor(int fd, Method method, int level) : fd_(fd), method_(method)
+{
+    output_.resize(kOutputSize);
+    
+    if (method_ == kGzip) {
+        z_stream* stream = new z_stream();
+        
+        // window bits + 16 writes a gzip header and trailer
+        level = level > 0 ? std::min(level, 9) : Z_DEFAULT_COMPRESSION;
+        if (deflateInit2(stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            delete stream;
+            stream = nullptr;
+        }
+        
+        stream_ = stream;
+    }
+    
+#ifdef THREEIO_ZSTD
+    if (method_ == kZstd) {
+        ZSTD_CCtx* context = ZSTD_createCCtx();
+        
+        if (context && level > 0) {
+            ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, std::min(level, ZSTD_maxCLevel()));
+        }
+        
+        stream_ = context;
+    }
+#endif
+    
+    error_ = stream_ == nullptr;
+    
+    thread_ = std::thread(&Compressor::Run, this);
+}
+
+Compressor::~Compressor()
+{
+    Finish();
+    
+    if (method_ == kGzip && stream_) {
+        z_stream* stream = static_cast<z_stream*>(stream_);
+        deflateEnd(stream);
+        delete stream;
+    }
+    
+#ifdef THREEIO_ZSTD
+    if (method_ == kZstd && stream_) {
+        ZSTD_freeCCtx(static_cast<ZSTD_CCtx*>(stream_));
+    }
+#endif
+}
+
+void Compressor::Submit(std::vector<char>& block, size_t size)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [this] { return !has_pending_; });
+    
+    if (finish_) {
+        error_ = true;
+        return;
+    }
+    
+    pending_.swap(block);
+    pending_size_ = size;
+    has_pending_ = true;
+    
+    condition_.notify_all();
+}
+
+bool Compressor::Finish()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        finish_ = true;
+        condition_.notify_all();
+    }
+    
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    
+    return !HasError();
+}
+
+bool Compressor::HasError()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return error_;
+}
+
+uint64_t Compressor::Written()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return written_;
+}
+
+void Compressor::Run()
+{
+    while (true) {
+        size_t size = 0;
+        bool end = false;
+        
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait(lock, [this] { return has_pending_ || finish_; });
+            
+            // take the pending block, and leave the compressed one for
+            // the writer to fill next
+            if (has_pending_) {
+                block_.swap(pending_);
+                size = pending_size_;
+                has_pending_ = false;
+                condition_.notify_all();
+            }
+            
+            end = finish_ && !has_pending_;
+            
+            if (error_) {
+                if (end) {
+                    return;
+                }
+                continue;
+            }
+        }
+        
+        bool ok = Compress(block_.data(), size, end);
+        
+        if (!ok) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            error_ = true;
+        }
+        
+        if (end) {
+            return;
+        }
+    }
+}
+
+bool Compressor::Compress(const char* data, size_t size, bool end)
+{
+    if (method_ == kGzip) {
+        z_stream* stream = static_cast<z_stream*>(stream_);
+        
+        stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        stream->avail_in = static_cast<uInt>(size);
+        
+        int result;
+        do {
+            stream->next_out = reinterpret_cast<Bytef*>(output_.data());
+            stream->avail_out = static_cast<uInt>(output_.size());
+            
+            result = deflate(stream, end ? Z_FINISH : Z_NO_FLUSH);
+            if (result == Z_STREAM_ERROR) {
+                return false;
+            }
+            
+            if (!Store(output_.data(), output_.size() - stream->avail_out)) {
+                return false;
+            }
+        } while (stream->avail_out == 0 || (end && result != Z_STREAM_END));
+        
+        return true;
+    }
+    
+#ifdef THREEIO_ZSTD
+    if (method_ == kZstd) {
+        ZSTD_CCtx* context = static_cast<ZSTD_CCtx*>(stream_);
+        ZSTD_inBuffer input = { data, size, 0 };
+        
+        size_t remaining;
+        do {
+            ZSTD_outBuffer output = { output_.data(), output_.size(), 0 };
+            
+            remaining = ZSTD_compressStream2(context, &output, &input, end ? ZSTD_e_end : ZSTD_e_continue);
+            if (ZSTD_isError(remaining)) {
+                return false;
+            }
+            
+            if (!Store(output_.data(), output.pos)) {
+                return false;
+            }
+        } while (end ? remaining != 0 : input.pos < input.size);
+        
+        return true;
+    }
+#endif
+    
+    return false;
+}
+
+bool Compressor::Store(const char* data, size_t size)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        written_ += size;
+    }
+    
+    while (size > 0) {
+        ssize_t count = write(fd_, data, size);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            
+            return false;
+        }
+        
+        data += count;
+        size -= count;
+    }
+    
+    return true;
+}
@@ -0,0 +1,80 @@
+#ifndef __threeio__compressor__
+#define __threeio__compressor__
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Compresses a stream of blocks into a file descriptor on a background
+ * thread, gzip through zlib's deflate, or zstd when built with
+ * THREEIO_ZSTD. A block is compressed while the writer fills the next one,
+ * so compression overlaps with the scene traversal and number formatting.
+ */
+class Compressor
+{
+public:
+    enum Method {
+        kNone = 0,
+        kGzip = 1,
+        kZstd = 2
+    };
+    
+    static bool Available(Method);
+    
+    // file extension appended to compressed files, "gz" or "zst"
+    static const char* Extension(Method);
+    static const char* Name(Method);
+    
+    // level 0 selects the method's default
+    Compressor(int fd, Method, int level);
+    ~Compressor();
+    
+    // Hands over the first size bytes of block and swaps in an empty block,
+    // which has to be resized before use. Waits while the previous block is
+    // still being compressed.
+    void Submit(std::vector<char>& block, size_t size);
+    
+    // ends the stream and waits for everything to be written
+    bool Finish();
+    
+    bool HasError();
+    
+    // compressed bytes written so far
+    uint64_t Written();
+    
+private:
+    
+    static const size_t kOutputSize = 1024 * 1024;
+    
+    const int fd_;
+    const Method method_;
+    void* stream_ = nullptr; // z_stream or ZSTD_CCtx
+    
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    
+    // handed over by Submit and not yet taken by the thread
+    std::vector<char> pending_;
+    size_t pending_size_ = 0;
+    bool has_pending_ = false;
+    bool finish_ = false;
+    bool error_ = false;
+    uint64_t written_ = 0;
+    
+    // owned by the thread
+    std::vector<char> block_;
+    std::vector<char> output_;
+    
+    Compressor(const Compressor&) = delete;
+    Compressor& operator=(const Compressor&) = delete;
+    
+    void Run();
+    bool Compress(const char*, size_t, bool end);
+    bool Store(const char*, size_t);
+};
+
+#endif // /* defined(__threeio__compressor__) */
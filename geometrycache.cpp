@@ -0,0 +1,282 @@
+#include "geometrycache.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+    
+const char kMagic[8] = { 'T', 'H', 'R', 'E', 'E', 'I', 'O', 'C' };
+
+template <typename T>
+void Put(std::string& out, T val)
+{
+    out.append(reinterpret_cast<const char*>(&val), sizeof val);
+}
+
+void PutString(std::string& out, const std::string& str)
+{
+    Put(out, (uint32_t)str.size());
+    out.append(str);
+}
+
+// reads from an index in memory, failing once it runs past the end
+class Reader
+{
+public:
+    Reader(const std::vector<char>& data) : data_(data) {}
+    
+    template <typename T>
+    bool Get(T& val)
+    {
+        if (pos_ + sizeof val > data_.size()) {
+            return false;
+        }
+        
+        memcpy(&val, &data_[pos_], sizeof val);
+        pos_ += sizeof val;
+        return true;
+    }
+    
+    bool GetString(std::string& str)
+    {
+        uint32_t size;
+        if (!Get(size) || pos_ + size > data_.size()) {
+            return false;
+        }
+        
+        str.assign(&data_[pos_], size);
+        pos_ += size;
+        return true;
+    }
+    
+private:
+    const std::vector<char>& data_;
+    size_t pos_ = 0;
+};
+
+bool ReadAt(int fd, void* data, size_t size, uint64_t position)
+{
+    auto bytes = static_cast<char*>(data);
+    
+    while (size > 0) {
+        ssize_t count = pread(fd, bytes, size, position);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        
+        if (count <= 0) {
+            return false;
+        }
+        
+        bytes += count;
+        size -= count;
+        position += count;
+    }
+    
+    return true;
+}
+
+}
+
+GeometryCache::GeometryCache() : next_(1024 * 1024)
+{
+}
+
+GeometryCache::~GeometryCache()
+{
+    Close(false);
+}
+
+bool GeometryCache::IsOpen() const
+{
+    return next_.IsOpen();
+}
+
+bool GeometryCache::Open(const std::string& path, uint64_t options)
+{
+    Close(false);
+    
+    hits = misses = 0;
+    seconds_saved = 0;
+    
+    path_ = path;
+    next_path_ = path + ".tmp";
+    
+    previous_fd_ = open(path_.c_str(), O_RDONLY);
+    if (previous_fd_ >= 0 && !LoadIndex(options)) {
+        previous_.clear();
+        close(previous_fd_);
+        previous_fd_ = -1;
+    }
+    
+    if (!next_.Open(next_path_.c_str())) {
+        return false;
+    }
+    
+    // the index offset is patched in on Close
+    uint32_t version = kVersion;
+    uint64_t index = 0;
+    next_.Write(kMagic, sizeof kMagic);
+    next_.Write(&version, sizeof version);
+    next_.Write(&options, sizeof options);
+    next_.Write(&index, sizeof index);
+    
+    return true;
+}
+
+bool GeometryCache::LoadIndex(uint64_t options)
+{
+    char header[kHeaderSize];
+    if (!ReadAt(previous_fd_, header, sizeof header, 0) || memcmp(header, kMagic, sizeof kMagic) != 0) {
+        return false;
+    }
+    
+    uint32_t version;
+    uint64_t cached_options, index;
+    memcpy(&version, header + 8, sizeof version);
+    memcpy(&cached_options, header + 12, sizeof cached_options);
+    memcpy(&index, header + 20, sizeof index);
+    
+    if (version != kVersion || cached_options != options || index < kHeaderSize) {
+        return false;
+    }
+    
+    off_t end = lseek(previous_fd_, 0, SEEK_END);
+    if (end < 0 || (uint64_t)end < index) {
+        return false;
+    }
+    
+    std::vector<char> data(end - index);
+    if (!ReadAt(previous_fd_, data.data(), data.size(), index)) {
+        return false;
+    }
+    
+    Reader reader(data);
+    
+    uint32_t count;
+    if (!reader.Get(count)) {
+        return false;
+    }
+    
+    for (uint32_t i = 0; i < count; ++i) {
+        Key key;
+        Entry entry;
+        uint32_t units;
+        
+        if (!reader.Get(key.first) || !reader.Get(key.second) || !reader.Get(entry.seconds) ||
+            !reader.Get(entry.parts) || !reader.Get(units)) {
+            return false;
+        }
+        
+        entry.units.resize(units);
+        
+        for (auto& unit : entry.units) {
+            uint8_t index_bits, quantized;
+            
+            if (!reader.GetString(unit.uuid) || !reader.Get(unit.hash.first) || !reader.Get(unit.hash.second) ||
+                !reader.Get(index_bits) || !reader.Get(quantized) || !reader.Get(unit.offset) ||
+                !reader.Get(unit.scale) || !reader.Get(unit.position) || !reader.Get(unit.length)) {
+                return false;
+            }
+            
+            if (unit.position < kHeaderSize || unit.position + unit.length > index) {
+                return false;
+            }
+            
+            unit.index_bits = index_bits;
+            unit.quantized = quantized != 0;
+        }
+        
+        previous_[key] = std::move(entry);
+    }
+    
+    return true;
+}
+
+bool GeometryCache::Close(bool commit)
+{
+    if (previous_fd_ >= 0) {
+        close(previous_fd_);
+        previous_fd_ = -1;
+    }
+    previous_.clear();
+    
+    if (!next_.IsOpen()) {
+        return !commit;
+    }
+    
+    if (commit) {
+        std::string index;
+        Put(index, (uint32_t)entries_.size());
+        
+        for (auto& it : entries_) {
+            const Entry& entry = it.second;
+            
+            Put(index, it.first.first);
+            Put(index, it.first.second);
+            Put(index, entry.seconds);
+            Put(index, (uint32_t)entry.parts);
+            Put(index, (uint32_t)entry.units.size());
+            
+            for (auto& unit : entry.units) {
+                PutString(index, unit.uuid);
+                Put(index, unit.hash.first);
+                Put(index, unit.hash.second);
+                Put(index, (uint8_t)unit.index_bits);
+                Put(index, (uint8_t)unit.quantized);
+                Put(index, unit.offset[0]);
+                Put(index, unit.offset[1]);
+                Put(index, unit.offset[2]);
+                Put(index, unit.scale);
+                Put(index, unit.position);
+                Put(index, unit.length);
+            }
+        }
+        
+        uint64_t position = next_.Tell();
+        next_.Write(index.data(), index.size());
+        next_.WriteAt(kHeaderSize - sizeof position, &position, sizeof position);
+    }
+    
+    entries_.clear();
+    
+    bool ok = next_.Close() && commit;
+    
+    if (ok) {
+        ok = rename(next_path_.c_str(), path_.c_str()) == 0;
+    }
+    
+    if (!ok) {
+        remove(next_path_.c_str());
+    }
+    
+    return ok || !commit;
+}
+
+const GeometryCache::Entry* GeometryCache::Find(const Key& key) const
+{
+    auto it = previous_.find(key);
+    return it != previous_.end() ? &it->second : nullptr;
+}
+
+bool GeometryCache::Read(const Unit& unit, std::string& bytes) const
+{
+    bytes.resize(unit.length);
+    
+    return previous_fd_ >= 0 && ReadAt(previous_fd_, &bytes[0], bytes.size(), unit.position);
+}
+
+uint64_t GeometryCache::Append(const char* data, size_t size)
+{
+    uint64_t position = next_.Tell();
+    next_.Write(data, size);
+    
+    return position;
+}
+
+void GeometryCache::Add(const Key& key, const Entry& entry)
+{
+    entries_[key] = entry;
+}
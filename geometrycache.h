@@ -0,0 +1,92 @@
+#ifndef __threeio__geometry_cache__
+#define __threeio__geometry_cache__
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "bufferedfile.h"
+
+/*
+ * Encoded geometries of the previous save, kept in a file next to the
+ * output, so that a re-export splices unchanged geometries in instead of
+ * deduplicating and formatting them again. Entries are keyed by a hash of
+ * the geometry's identity and polygon data, the whole cache by a hash of
+ * the export options.
+ *
+ * A save reads the index of the previous cache on Open, fetches the bytes
+ * of hits with Read, and streams everything it encodes, hits included, into
+ * the next cache, which replaces the previous one on Close.
+ *
+ * File layout, native byte order: magic, version, options hash, offset of
+ * the index; the encoded bytes; the index.
+ */
+class GeometryCache
+{
+public:
+    typedef std::pair<uint64_t, uint64_t> Key;
+    
+    // an encoded geometry, or a part of a split one
+    struct Unit {
+        std::string uuid;
+        Key hash;                   // content hash for sharing identical geometries
+        unsigned index_bits = 0;    // 16 or 32, 0 if not indexed
+        bool quantized = false;
+        double offset[3] = { 0, 0, 0 };
+        double scale = 1;
+        uint64_t position = 0;      // of the bytes in the cache file
+        uint64_t length = 0;
+    };
+    
+    struct Entry {
+        double seconds = 0;         // it took to build and encode
+        unsigned parts = 0;         // it was split into, 0 if not split
+        std::vector<Unit> units;
+    };
+    
+    GeometryCache();
+    ~GeometryCache();
+    
+    bool IsOpen() const;
+    
+    // Loads the index of the cache at path if it was written with the same
+    // options, and starts the next one. Returns false if that fails.
+    bool Open(const std::string& path, uint64_t options);
+    
+    // replaces the previous cache with the next one, or discards it
+    bool Close(bool commit);
+    
+    // hit of the previous save, safe to call from any thread
+    const Entry* Find(const Key&) const;
+    
+    // bytes of a unit of the previous save
+    bool Read(const Unit&, std::string&) const;
+    
+    // Appends the bytes of a unit to the next cache, and returns its
+    // position there.
+    uint64_t Append(const char*, size_t);
+    
+    void Add(const Key&, const Entry&);
+    
+    unsigned hits = 0;
+    unsigned misses = 0;
+    double seconds_saved = 0;
+    
+private:
+    
+    static const uint32_t kVersion = 4;
+    static const size_t kHeaderSize = 8 + 4 + 8 + 8;
+    
+    std::string path_;
+    std::string next_path_;
+    int previous_fd_ = -1;
+    std::map<Key, Entry> previous_;
+    
+    BufferedFile next_;
+    std::map<Key, Entry> entries_;
+    
+    bool LoadIndex(uint64_t options);
+};
+
+#endif // /* defined(__threeio__geometry_cache__) */
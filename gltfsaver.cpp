@@ -0,0 +1,759 @@
+#include "gltfsaver.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+#include <lxidef.h>
+#include <lxw_locator.hpp>
+
+GLTFSceneSaver::GLTFSceneSaver(bool binary) : binary_(binary)
+{
+}
+
+void GLTFSceneSaver::GetOptions()
+{
+    THREESceneSaver::GetOptions();
+    
+    // primitives are always indexed triangle lists
+    opt_geometry_type_ = kBufferGeometry;
+    opt_geometry_binary_ = true;
+    
+    // the GLB header is patched in place once the chunks are written
+    opt_compress_method_ = Compressor::kNone;
+}
+
+bool GLTFSceneSaver::OpenBuffers()
+{
+    if (binary_) {
+        // the BIN chunk is staged next to the output and appended after
+        // the JSON chunk, whose length is only known once it is written
+        buffer_path_ = filename_ + ".tmp";
+        
+        char header[kGLBHeaderSize] = { 0 };
+        WriteRaw(header, sizeof header);
+    } else {
+        buffer_path_ = ReplaceExtension(filename_, THREE_BUFFER_EXTENSION);
+    }
+    
+    buffer_url_ = FileName(buffer_path_);
+    
+    return buffer_file_.Open(buffer_path_.c_str());
+}
+
+bool GLTFSceneSaver::CloseBuffers()
+{
+    if (!buffer_file_.IsOpen()) {
+        return true;
+    }
+    
+    buffer_file_.Align(4);
+    uint64_t buffer_length = buffer_file_.Tell();
+    
+    if (!buffer_file_.Close()) {
+        return false;
+    }
+    
+    if (!binary_) {
+        return true;
+    }
+    
+    // pad the JSON chunk with spaces
+    uint64_t json_length = Tell() - kGLBHeaderSize;
+    while (json_length % 4 != 0) {
+        WriteRaw(" ", 1);
+        json_length++;
+    }
+    
+    uint32_t chunk[2] = { (uint32_t)buffer_length, kGLBChunkBIN };
+    WriteRaw(chunk, sizeof chunk);
+    
+    std::ifstream is(buffer_path_.c_str(), std::ios::in | std::ios::binary);
+    std::vector<char> block(1024 * 1024);
+    while (is) {
+        is.read(block.data(), block.size());
+        if (is.gcount() > 0) {
+            WriteRaw(block.data(), is.gcount());
+        }
+    }
+    bool copied = is.eof();
+    is.close();
+    remove(buffer_path_.c_str());
+    
+    uint32_t header[5] = {
+        kGLBMagic,
+        kGLBVersion,
+        (uint32_t)(kGLBHeaderSize + json_length + sizeof chunk + buffer_length),
+        (uint32_t)json_length,
+        kGLBChunkJSON
+    };
+    
+    WriteRawAt(0, header, sizeof header);
+    
+    return copied;
+}
+
+void GLTFSceneSaver::WriteDocument()
+{
+    StartObject();
+    
+    StartObject("asset");
+    Property("version", "2.0");
+    Property("generator", THREE_IO_GENERATOR_NAME);
+    EndObject();
+    
+    WriteMaterials();
+    WriteGeometries();
+    WriteScene();
+    WriteBuffers();
+    
+    EndObject(); // root
+    
+    Clear();
+}
+
+void GLTFSceneSaver::Clear()
+{
+    buffer_views_.clear();
+    accessors_.clear();
+    primitives_.clear();
+    meshes_.clear();
+    mesh_index_.clear();
+    nodes_.clear();
+    material_index_.clear();
+    texture_index_.clear();
+    material_map_.clear();
+    materials_.clear();
+    images_.clear();
+}
+
+void GLTFSceneSaver::WriteMaterials()
+{
+    PhaseTimer timer(stats_, ExportStats::kPhaseMaterials);
+    
+    ScanMaterials();
+    
+    WriteTextures();
+    
+    // glTF does not allow empty top level arrays, they are started with
+    // their first entry
+    for (auto it = materials_.begin(); it != materials_.end(); it++) {
+        MaterialLayers layers;
+        if (!ResolveMaterial(*it, layers)) {
+            continue;
+        }
+        
+        if (material_index_.empty()) {
+            StartArray("materials");
+        }
+        
+        material_index_[*it] = (unsigned)material_index_.size();
+        
+        StartObject();
+        Property("name", MaskName(*it));
+        
+        double amount;
+        LXtVector color;
+        
+        // base color
+        amount = ChanFloat(LXsICHAN_ADVANCEDMATERIAL_DIFFAMT);
+        ChanColor(LXsICHAN_ADVANCEDMATERIAL_DIFFCOL, color);
+        
+        double opacity = 1.0 - ChanFloat(LXsICHAN_ADVANCEDMATERIAL_TRANAMT);
+        double roughness = ChanFloat(LXsICHAN_ADVANCEDMATERIAL_ROUGH);
+        
+        // emission
+        LXtVector emissive;
+        double radiance = ChanFloat(LXsICHAN_ADVANCEDMATERIAL_RADIANCE);
+        ChanColor(LXsICHAN_ADVANCEDMATERIAL_LUMICOL, emissive);
+        
+        bool double_sided = ChanInt(LXsICHAN_ADVANCEDMATERIAL_DBLSIDED) == 1;
+        
+        StartObject("pbrMetallicRoughness");
+        StartArray("baseColorFactor");
+        Write(color[0] * amount);
+        Write(color[1] * amount);
+        Write(color[2] * amount);
+        Write(opacity);
+        EndArray();
+        Property("metallicFactor", 0.0);
+        Property("roughnessFactor", roughness);
+        
+        if (layers.diffuse_map.test() && SetItem(layers.diffuse_map) && TxtrImage()) {
+            auto texture = texture_index_.find(ItemIdentity());
+            if (texture != texture_index_.end()) {
+                StartObject("baseColorTexture");
+                Property("index", texture->second);
+                EndObject();
+            }
+        }
+        EndObject(); // pbrMetallicRoughness
+        
+        if (radiance > 0) {
+            StartArray("emissiveFactor");
+            for (unsigned i = 0; i < 3; ++i) {
+                Write(std::min(emissive[i] * radiance, 1.0));
+            }
+            EndArray();
+        }
+        
+        if (layers.emissive_map.test() && SetItem(layers.emissive_map) && TxtrImage()) {
+            auto texture = texture_index_.find(ItemIdentity());
+            if (texture != texture_index_.end()) {
+                StartObject("emissiveTexture");
+                Property("index", texture->second);
+                EndObject();
+            }
+        }
+        
+        if (opacity < 1.0) {
+            Property("alphaMode", "BLEND");
+        }
+        
+        if (double_sided) {
+            Property("doubleSided", true);
+        }
+        
+        EndObject(); // material
+    }
+    
+    if (!material_index_.empty()) {
+        EndArray(); // materials
+    }
+}
+
+void GLTFSceneSaver::WriteTextures()
+{
+    for (auto it = images_.begin(); it != images_.end(); it++) {
+        CLxUser_Item map;
+        if (!scene_.GetItemByIdent(it->c_str(), map)) {
+            continue;
+        }
+        
+        SetItem(map);
+        if (!TxtrImage()) {
+            continue;
+        }
+        
+        if (texture_index_.empty()) {
+            StartArray("images");
+        }
+        
+        texture_index_[*it] = (unsigned)texture_index_.size();
+        
+        StartObject(); // image
+        std::string path(ChanString(LXsICHAN_VIDEOSTILL_FILENAME));
+        
+        if (opt_embed_images_) {
+            std::string type(ChanString(LXsICHAN_VIDEOSTILL_FORMAT));
+            for (unsigned short i = 0; i < type.size(); i++) {
+                type[i] = std::tolower(type[i]);
+            }
+            if (type == "jpg") {
+                type = "jpeg";
+            }
+            
+            WriteKey("uri");
+            std::ifstream is(path.c_str(), std::ios::in | std::ios::binary);
+            Write(is, "image/" + type);
+        } else {
+            Property("uri", FileName(path));
+        }
+        
+        EndObject(); // image
+    }
+    
+    if (texture_index_.empty()) {
+        return;
+    }
+    
+    EndArray(); // images
+    
+    StartArray("textures");
+    
+    for (unsigned i = 0; i < texture_index_.size(); ++i) {
+        StartObject(); // texture
+        Property("source", i);
+        EndObject(); // texture
+    }
+    
+    EndArray(); // textures
+}
+
+void GLTFSceneSaver::WriteGeometries()
+{
+    PhaseTimer timer(stats_, ExportStats::kPhaseGeometries);
+    
+    triangulated_polygons_ = generated_triangles_ = 0;
+    
+    StartScan();
+    while (NextMesh()) {
+        if (!ItemVisibleForSave() || GetMeshInfo().points == 0) {
+            continue;
+        }
+        
+        ScanGeometry();
+        
+        // one primitive for each material tag
+        auto& primitives = primitives_[ItemIdentity()];
+        for (auto it = geometries_.begin(); it != geometries_.end(); it++) {
+            poly_tag_ = names_.Intern(it->first);
+            geometry_ = &it->second;
+            
+            if (geometry_->indices.empty()) {
+                continue;
+            }
+            
+            if (opt_geometry_optimize_) {
+                VertexCacheStats before, after;
+                {
+                    PhaseTimer timer(stats_, ExportStats::kPhaseBuild);
+                    OptimizeGeometry(*geometry_, before, after);
+                }
+                LogVertexCache(geometry_->uuid, before, after);
+            }
+            
+            primitives.push_back(EncodePrimitive());
+        }
+        
+        geometries_.clear();
+        geometry_ = nullptr;
+        poly_tag_ = StringInterner::kEmpty;
+        has_uvs_ = false;
+    }
+    
+    LogTriangulation();
+}
+
+GLTFSceneSaver::Primitive GLTFSceneSaver::EncodePrimitive()
+{
+    PhaseTimer timer(stats_, ExportStats::kPhaseEncode);
+    
+    Primitive primitive;
+    primitive.tag = poly_tag_;
+    
+    auto& vertices = geometry_->vertices;
+    unsigned count = (unsigned)vertices.size();
+    
+    // positions
+    {
+        Accessor accessor = { 0, kFloat, count, "VEC3", true, {}, {} };
+        for (unsigned i = 0; i < 3; ++i) {
+            accessor.min[i] = std::numeric_limits<float>::max();
+            accessor.max[i] = -std::numeric_limits<float>::max();
+        }
+        
+        uint64_t offset = buffer_file_.Tell();
+        for (auto vertex : vertices) {
+            auto position = vertex.position();
+            float p[3] = { (float)position.x, (float)position.y, (float)position.z };
+            
+            for (unsigned i = 0; i < 3; ++i) {
+                buffer_file_.WriteFloat32(p[i]);
+                accessor.min[i] = std::min(accessor.min[i], p[i]);
+                accessor.max[i] = std::max(accessor.max[i], p[i]);
+            }
+        }
+        accessor.view = AddBufferView(offset, kArrayBuffer);
+        
+        primitive.position = (int)accessors_.size();
+        accessors_.push_back(accessor);
+    }
+    
+    // normals
+    if (opt_save_normals_) {
+        Accessor accessor = { 0, kFloat, count, "VEC3", false, {}, {} };
+        
+        uint64_t offset = buffer_file_.Tell();
+        for (auto vertex : vertices) {
+            auto normal = vertex.normal();
+            buffer_file_.WriteFloat32(normal.x);
+            buffer_file_.WriteFloat32(normal.y);
+            buffer_file_.WriteFloat32(normal.z);
+        }
+        accessor.view = AddBufferView(offset, kArrayBuffer);
+        
+        primitive.normal = (int)accessors_.size();
+        accessors_.push_back(accessor);
+    }
+    
+    // uvs, glTF puts the origin at the top left
+    if (opt_save_uvs_ && has_uvs_) {
+        Accessor accessor = { 0, kFloat, count, "VEC2", false, {}, {} };
+        
+        uint64_t offset = buffer_file_.Tell();
+        for (auto vertex : vertices) {
+            auto uv = vertex.uv();
+            buffer_file_.WriteFloat32(uv.x);
+            buffer_file_.WriteFloat32(1.0f - uv.y);
+        }
+        accessor.view = AddBufferView(offset, kArrayBuffer);
+        
+        primitive.texcoord = (int)accessors_.size();
+        accessors_.push_back(accessor);
+    }
+    
+    // indices, 16 bit whenever the vertex count allows it
+    // (65535 is reserved for primitive restart)
+    {
+        auto& indices = geometry_->indices;
+        bool is_short = count < 0xffff;
+        Accessor accessor = { 0, kUnsignedInt, (unsigned)indices.size(), "SCALAR", false, {}, {} };
+        if (is_short) {
+            accessor.component_type = kUnsignedShort;
+        }
+        
+        uint64_t offset = buffer_file_.Tell();
+        if (is_short) {
+            for (unsigned index : indices) {
+                buffer_file_.WriteUint16((uint16_t)index);
+            }
+        } else {
+            for (unsigned index : indices) {
+                buffer_file_.WriteUint32(index);
+            }
+        }
+        accessor.view = AddBufferView(offset, kElementArrayBuffer);
+        
+        primitive.indices = (int)accessors_.size();
+        accessors_.push_back(accessor);
+    }
+    
+    return primitive;
+}
+
+// Adds a view of the data written since offset, and aligns the buffer
+// for the next view.
+unsigned GLTFSceneSaver::AddBufferView(uint64_t offset, unsigned target)
+{
+    BufferView view = { offset, buffer_file_.Tell() - offset, target };
+    buffer_views_.push_back(view);
+    
+    buffer_file_.Align(4);
+    
+    return (unsigned)buffer_views_.size() - 1;
+}
+
+void GLTFSceneSaver::WriteScene()
+{
+    PhaseTimer timer(stats_, ExportStats::kPhaseScene);
+    
+    scene_.GetChannels(chan_, LXs_ACTIONLAYER_EDIT);
+    scene_.GetChannels(chan_xform_, 0.0);
+    
+    scene_.GetGraph(LXsGRAPH_XFRMCORE, scene_graph_);
+    item_graph_.set(scene_graph_);
+    
+    std::vector<unsigned> roots;
+    
+    StartScan();
+    while (NextItem()) {
+        if (!ItemVisibleForSave() || !ItemSupported()) {
+            continue;
+        }
+        
+        CLxLoc_Item item;
+        GetItem(item);
+        
+        // skip non roots, children are added recursively
+        CLxLoc_Item parent;
+        if (item.Parent(parent)) {
+            continue;
+        }
+        
+        roots.push_back(AddNode());
+    }
+    
+    Property("scene", 0);
+    
+    StartArray("scenes");
+    StartObject();
+    StartArray("nodes");
+    for (unsigned root : roots) {
+        Write(root);
+    }
+    EndArray(); // nodes
+    EndObject();
+    EndArray(); // scenes
+    
+    StartArray("nodes");
+    for (auto& node : nodes_) {
+        StartObject();
+        
+        if (!node.name.empty()) {
+            Property("name", node.name);
+        }
+        
+        if (node.has_matrix) {
+            StartArray("matrix");
+            for (unsigned i = 0; i < 16; ++i) {
+                Write(node.matrix[i]);
+            }
+            EndArray();
+        }
+        
+        if (node.mesh >= 0) {
+            Property("mesh", node.mesh);
+        }
+        
+        if (!node.children.empty()) {
+            StartArray("children");
+            for (unsigned child : node.children) {
+                Write(child);
+            }
+            EndArray();
+        }
+        
+        EndObject();
+    }
+    EndArray(); // nodes
+    
+    StartArray("meshes");
+    for (auto& mesh : meshes_) {
+        StartObject();
+        
+        if (!mesh.name.empty()) {
+            Property("name", mesh.name);
+        }
+        
+        StartArray("primitives");
+        for (auto& it : mesh.primitives) {
+            auto primitive = it.first;
+            
+            StartObject();
+            StartObject("attributes");
+            Property("POSITION", primitive->position);
+            if (primitive->normal >= 0) {
+                Property("NORMAL", primitive->normal);
+            }
+            if (primitive->texcoord >= 0) {
+                Property("TEXCOORD_0", primitive->texcoord);
+            }
+            EndObject(); // attributes
+            Property("indices", primitive->indices);
+            if (it.second >= 0) {
+                Property("material", it.second);
+            }
+            Property("mode", kModeTriangles);
+            EndObject();
+        }
+        EndArray(); // primitives
+        
+        EndObject();
+    }
+    EndArray(); // meshes
+}
+
+// Adds the current item and its children to nodes_.
+unsigned GLTFSceneSaver::AddNode()
+{
+    CLxUser_Item item;
+    GetItem(item);
+    
+    unsigned index = (unsigned)nodes_.size();
+    nodes_.push_back(Node());
+    
+    Node node;
+    const char* name = ItemName();
+    if (name) {
+        node.name = name;
+    }
+    
+    LXtMatrix4 transform = {
+        { 1, 0, 0, 0 },
+        { 0, 1, 0, 0 },
+        { 0, 0, 1, 0 },
+        { 0, 0, 0, 1 },
+    };
+    
+    CLxLoc_Locator locator;
+    if (locator.set(item)) {
+        locator.LocalTransform4(chan_xform_, transform);
+    }
+    
+    // same column major layout as the THREE object matrix
+    for (unsigned col = 0; col < 4; ++col) {
+        for (unsigned row = 0; row < 4; ++row) {
+            node.matrix[col * 4 + row] = transform[col][row];
+            node.has_matrix = node.has_matrix || transform[col][row] != (col == row ? 1.0 : 0.0);
+        }
+    }
+    
+    if (ItemIsA(LXsITYPE_MESH) || ItemIsA(LXsITYPE_MESHINST)) {
+        node.mesh = AddMesh(item);
+    }
+    
+    unsigned child_count;
+    item.SubCount(&child_count);
+    
+    for (unsigned i = 0; i < child_count; ++i) {
+        CLxUser_Item child;
+        item.SubByIndex(i, child);
+        
+        SetItem(child);
+        
+        if (!ItemVisibleForSave() || !ItemSupported()) {
+            continue;
+        }
+        
+        node.children.push_back(AddNode());
+    }
+    
+    SetItem(item);
+    
+    nodes_[index] = node;
+    
+    return index;
+}
+
+// Adds a mesh for the current mesh or mesh instance item. Instances share
+// the primitives of their source, but may resolve to other materials.
+int GLTFSceneSaver::AddMesh(CLxUser_Item& item)
+{
+    std::string item_id = ItemIdentity();
+    std::string source_id = item_id;
+    const char* name = ItemName();
+    
+    if (ItemIsA(LXsITYPE_MESHINST)) {
+        CLxUser_Item source;
+        scene_service_.GetMeshInstSourceItem((ILxUnknownID)item, source);
+        SetItem(source);
+        source_id = ItemIdentity();
+        SetItem(item);
+    }
+    
+    auto primitives = primitives_.find(source_id);
+    if (primitives == primitives_.end() || primitives->second.empty()) {
+        return -1;
+    }
+    
+    // poly tag -> item mask
+    std::map<StringInterner::ID, StringInterner::ID> masks;
+    auto iter = material_map_.find(item_id);
+    if (iter != material_map_.end()) {
+        for (auto it = iter->second.begin(); it != iter->second.end(); it++) {
+            masks[it->second] = it->first;
+        }
+    }
+    
+    Mesh mesh;
+    if (name) {
+        mesh.name = name;
+    }
+    
+    std::string key = source_id;
+    for (auto& primitive : primitives->second) {
+        int material = MaterialIndex(masks, primitive.tag);
+        mesh.primitives.push_back(std::make_pair(&primitive, material));
+        key += ":" + std::to_string(material);
+    }
+    
+    // meshes with the same source and materials are shared
+    auto existing = mesh_index_.find(key);
+    if (existing != mesh_index_.end()) {
+        return existing->second;
+    }
+    
+    unsigned index = (unsigned)meshes_.size();
+    meshes_.push_back(mesh);
+    mesh_index_[key] = index;
+    
+    return index;
+}
+
+// Same mask lookup as the children of multi material objects in
+// THREESceneSaver::WriteObject.
+int GLTFSceneSaver::MaterialIndex(const std::map<StringInterner::ID, StringInterner::ID>& masks, StringInterner::ID tag) const
+{
+    ShaderMask mask;
+    
+    auto iter = masks.find(tag);
+    if (iter != masks.end()) {
+        mask = ShaderMask(iter->second, tag);
+    } else {
+        iter = masks.find(StringInterner::kEmpty);
+        if (iter != masks.end()) {
+            mask = ShaderMask(iter->second, StringInterner::kEmpty);
+        }
+    }
+    
+    auto material = material_index_.find(mask);
+    if (material == material_index_.end()) {
+        return -1;
+    }
+    
+    return material->second;
+}
+
+void GLTFSceneSaver::WriteBuffers()
+{
+    PhaseTimer timer(stats_, ExportStats::kPhaseBuffers);
+    
+    StartArray("accessors");
+    for (auto& accessor : accessors_) {
+        StartObject();
+        Property("bufferView", accessor.view);
+        Property("componentType", accessor.component_type);
+        Property("count", accessor.count);
+        Property("type", accessor.type);
+        
+        if (accessor.bounds) {
+            StartArray("min");
+            for (unsigned i = 0; i < 3; ++i) {
+                Write(accessor.min[i]);
+            }
+            EndArray();
+            
+            StartArray("max");
+            for (unsigned i = 0; i < 3; ++i) {
+                Write(accessor.max[i]);
+            }
+            EndArray();
+        }
+        
+        EndObject();
+    }
+    EndArray(); // accessors
+    
+    StartArray("bufferViews");
+    for (auto& view : buffer_views_) {
+        StartObject();
+        Property("buffer", 0);
+        Property("byteOffset", (unsigned long long)view.offset);
+        Property("byteLength", (unsigned long long)view.length);
+        Property("target", view.target);
+        EndObject();
+    }
+    EndArray(); // bufferViews
+    
+    // the buffer is padded to 4 bytes when it is closed
+    uint64_t length = buffer_file_.Tell();
+    length += (4 - length % 4) % 4;
+    
+    StartArray("buffers");
+    StartObject();
+    Property("byteLength", (unsigned long long)length);
+    if (!binary_) {
+        Property("uri", buffer_url_);
+    }
+    EndObject();
+    EndArray(); // buffers
+}
+
+LXtTagInfoDesc GLTFSceneSaver::descInfo[] = {
+    { LXsSAV_OUTCLASS,      LXa_SCENE },
+    { LXsSAV_DOSTYPE,       GLTF_FILE_EXTENSION.c_str() },
+    { LXsSRV_USERNAME,      GLTF_IO_USER_NAME.c_str() },
+    { LXsSRV_LOGSUBSYSTEM,	"io-status" },
+    { 0 }
+};
+
+LXtTagInfoDesc GLBSceneSaver::descInfo[] = {
+    { LXsSAV_OUTCLASS,      LXa_SCENE },
+    { LXsSAV_DOSTYPE,       GLB_FILE_EXTENSION.c_str() },
+    { LXsSRV_USERNAME,      GLB_IO_USER_NAME.c_str() },
+    { LXsSRV_LOGSUBSYSTEM,	"io-status" },
+    { 0 }
+};
@@ -0,0 +1,126 @@
+#ifndef __threeio__gltfsaver__
+#define __threeio__gltfsaver__
+
+#include "saver.h"
+
+const std::string GLTF_FILE_EXTENSION        = "gltf";
+const std::string GLB_FILE_EXTENSION         = "glb";
+
+const std::string GLTF_IO_INTERNAL_NAME      = "GLTF_2";
+const std::string GLTF_IO_USER_NAME          = "glTF 2.0";
+const std::string GLB_IO_INTERNAL_NAME       = "GLB_2";
+const std::string GLB_IO_USER_NAME           = "glTF 2.0 Binary";
+
+/*
+ * glTF 2.0 saver, sharing the item scan, material resolution and vertex
+ * deduplication of the THREE saver. Vertex attributes are tightly packed
+ * into a single binary buffer, which is either written next to the .gltf
+ * file or embedded as the BIN chunk of a .glb file.
+ */
+class GLTFSceneSaver : public THREESceneSaver
+{
+public:
+    
+    GLTFSceneSaver(bool binary = false);
+    ~GLTFSceneSaver() {}
+    
+    static LXtTagInfoDesc descInfo[];
+    
+protected:
+    
+    // https://github.com/KhronosGroup/glTF/tree/master/specification/2.0
+    static const unsigned kUnsignedShort = 5123;
+    static const unsigned kUnsignedInt = 5125;
+    static const unsigned kFloat = 5126;
+    
+    static const unsigned kArrayBuffer = 34962;
+    static const unsigned kElementArrayBuffer = 34963;
+    
+    static const unsigned kModeTriangles = 4;
+    
+    static const uint32_t kGLBMagic = 0x46546C67; // glTF
+    static const uint32_t kGLBVersion = 2;
+    static const uint32_t kGLBChunkJSON = 0x4E4F534A; // JSON
+    static const uint32_t kGLBChunkBIN = 0x004E4942; // BIN
+    static const unsigned kGLBHeaderSize = 12 + 8;
+    
+    struct BufferView {
+        uint64_t offset;
+        uint64_t length;
+        unsigned target;
+    };
+    
+    struct Accessor {
+        unsigned view;
+        unsigned component_type;
+        unsigned count;
+        const char* type;
+        bool bounds;
+        float min[3];
+        float max[3];
+    };
+    
+    // accessor indices of one material tag of a mesh, -1 if not present
+    struct Primitive {
+        StringInterner::ID tag = StringInterner::kEmpty;
+        int position = -1;
+        int normal = -1;
+        int texcoord = -1;
+        int indices = -1;
+    };
+    
+    struct Mesh {
+        std::string name;
+        std::vector<std::pair<const Primitive*, int>> primitives; // primitive, material
+    };
+    
+    struct Node {
+        std::string name;
+        bool has_matrix = false;
+        double matrix[16];
+        int mesh = -1;
+        std::vector<unsigned> children;
+    };
+    
+    const bool binary_;
+    std::string buffer_path_;
+    
+    std::vector<BufferView> buffer_views_;
+    std::vector<Accessor> accessors_;
+    std::map<std::string, std::vector<Primitive>> primitives_; // mesh identity -> primitives
+    std::vector<Mesh> meshes_;
+    std::map<std::string, unsigned> mesh_index_;
+    std::vector<Node> nodes_;
+    std::map<ShaderMask, unsigned> material_index_;
+    std::map<std::string, unsigned> texture_index_; // image map identity -> texture
+    
+    virtual void GetOptions() override;
+    virtual void WriteDocument() override;
+    virtual bool OpenBuffers() override;
+    virtual bool CloseBuffers() override;
+    
+    void WriteMaterials();
+    void WriteTextures();
+    void WriteGeometries();
+    void WriteScene();
+    void WriteBuffers();
+    
+    Primitive EncodePrimitive();
+    unsigned AddBufferView(uint64_t offset, unsigned target);
+    unsigned AddNode();
+    int AddMesh(CLxUser_Item&);
+    int MaterialIndex(const std::map<StringInterner::ID, StringInterner::ID>&, StringInterner::ID) const;
+    
+    void Clear();
+};
+
+class GLBSceneSaver : public GLTFSceneSaver
+{
+public:
+    
+    GLBSceneSaver() : GLTFSceneSaver(true) {}
+    
+    static LXtTagInfoDesc descInfo[];
+};
+
+#endif // /* defined(__threeio__gltfsaver__) */
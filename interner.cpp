@@ -0,0 +1,88 @@
+#include "interner.h"
+
+#include <cstring>
+
+#include "types.h"
+
+static const size_t kMinSlots = 64;
+
+// FNV-1a, finalized for the low bits used as slot
+static uint64_t HashString(const char* s, size_t length)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(s[i])) * 0x100000001b3ULL;
+    }
+    return HashCombine(0, hash);
+}
+
+StringInterner::StringInterner()
+{
+    clear();
+}
+
+StringInterner::ID StringInterner::Intern(const char* s)
+{
+    return s ? Intern(s, strlen(s)) : kEmpty;
+}
+
+StringInterner::ID StringInterner::Intern(const std::string& s)
+{
+    return Intern(s.data(), s.size());
+}
+
+StringInterner::ID StringInterner::Intern(const char* s, size_t length)
+{
+    if ((strings_.size() + 1) * 2 > slots_.size()) {
+        Rehash(slots_.size() * 2);
+    }
+    
+    size_t slot = Slot(s, length, HashString(s, length));
+    if (slots_[slot] == kNone) {
+        slots_[slot] = static_cast<ID>(strings_.size());
+        strings_.push_back(std::string(s, length));
+    }
+    
+    return slots_[slot];
+}
+
+void StringInterner::clear()
+{
+    strings_.clear();
+    slots_.assign(kMinSlots, static_cast<ID>(kNone));
+    
+    Intern("", 0);
+}
+
+// slot of the string, or the empty slot it would go into
+size_t StringInterner::Slot(const char* s, size_t length, uint64_t hash) const
+{
+    size_t mask = slots_.size() - 1;
+    size_t i = hash & mask;
+    while (slots_[i] != kNone) {
+        const std::string& string = strings_[slots_[i]];
+        if (string.size() == length && memcmp(string.data(), s, length) == 0) {
+            break;
+        }
+        
+        i = (i + 1) & mask;
+    }
+    
+    return i;
+}
+
+// slot count must be a power of two
+void StringInterner::Rehash(size_t count)
+{
+    slots_.assign(count, static_cast<ID>(kNone));
+    
+    size_t mask = count - 1;
+    for (ID id = 0; id < strings_.size(); ++id) {
+        const std::string& string = strings_[id];
+        size_t i = HashString(string.data(), string.size()) & mask;
+        while (slots_[i] != kNone) {
+            i = (i + 1) & mask;
+        }
+        slots_[i] = id;
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef __threeio__interner__
+#define __threeio__interner__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Assigns strings small integer IDs, in the order they are first seen, so
+ * they can be compared and stored as integers and only turned back into
+ * strings for the output. The empty string is always kEmpty. Looking up a
+ * string that is already interned does not allocate.
+ */
+class StringInterner
+{
+public:
+    typedef unsigned ID;
+    
+    static const ID kEmpty = 0;
+    
+    StringInterner();
+    
+    ID Intern(const char*);
+    ID Intern(const std::string&);
+    
+    const std::string& Name(ID id) const { return strings_[id]; }
+    size_t size() const { return strings_.size(); }
+    
+    // forgets all strings but the empty one
+    void clear();
+    
+private:
+    
+    static const ID kNone = ~0u;
+    
+    std::vector<std::string> strings_;
+    std::vector<ID> slots_; // open addressing, kNone if empty
+    
+    ID Intern(const char*, size_t);
+    size_t Slot(const char*, size_t, uint64_t) const;
+    void Rehash(size_t count);
+};
+
+#endif // /* defined(__threeio__interner__) */
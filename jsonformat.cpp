@@ -1,6 +1,12 @@
 #include "jsonformat.h"
 
 #include <assert.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "base64.h"
+#include "numberformat.h"
 
 #define ENABLED if (!enabled_) return;
 
@@ -21,11 +27,13 @@ bool JSONFormat::ff_Open(const char *filename)
     filename_ = filename;
     file_name = filename_.c_str();
     
-    os_ = new std::ofstream;
-    os_->open(file_name, std::ifstream::out);
+    std::string path = filename_;
+    if (compression_ != Compressor::kNone) {
+        path += std::string(".") + Compressor::Extension(compression_);
+    }
     
     enabled_ = true;
-    return os_->good();
+    return out_.Open(path.c_str(), compression_, compression_level_);
 }
 
 void JSONFormat::ff_Enable(bool enable)
@@ -35,16 +43,25 @@ void JSONFormat::ff_Enable(bool enable)
 
 bool JSONFormat::ff_HasError()
 {
-    return !os_ || (!os_->eof() && !os_->good());
+    // a file closed by Close keeps the errors of closing it
+    if (closed_) {
+        return out_.HasError();
+    }
+    
+    if (!out_.IsOpen()) {
+        return true;
+    }
+    
+    // surface errors of the buffered tail as well
+    out_.Flush();
+    return out_.HasError();
 }
 
 void JSONFormat::ff_Cleanup()
 {
     filename_ = "";
-    if (os_) {
-        delete os_;
-        os_ = nullptr;
-    }
+    closed_ = false;
+    out_.Close();
 }
 
 const unsigned JSONFormat::precision() const
@@ -59,10 +76,22 @@ void JSONFormat::precision(unsigned precision)
     }
     
     precision_ = precision;
-    
-    char buf[5];
-    snprintf(buf, sizeof buf, "%%.%df", precision);
-    precision_format_ = strdup(buf);
+    fixed_ = true;
+}
+
+const bool JSONFormat::fixed() const
+{
+    return fixed_;
+}
+
+const bool JSONFormat::float32() const
+{
+    return float32_;
+}
+
+void JSONFormat::float32(bool float32)
+{
+    float32_ = float32;
 }
 
 const bool JSONFormat::pretty() const
@@ -75,12 +104,36 @@ void JSONFormat::pretty(bool pretty)
     pretty_ = pretty;
 }
 
+void JSONFormat::compression(Compressor::Method method, int level)
+{
+    compression_ = method;
+    compression_level_ = level;
+}
+
+uint64_t JSONFormat::Stored() const
+{
+    return out_.Stored();
+}
+
+bool JSONFormat::Close()
+{
+    if (!closed_) {
+        closed_ = out_.IsOpen();
+        out_.Close();
+    }
+    
+    return !ff_HasError();
+}
+
 void JSONFormat::BeforeWrite()
 {
     if (context_.size() > 0 && context_.top() == kValue) {
         context_.pop();
     } else if (context_.size() > 0 && context_.top() == kArray && has_value_) {
-        *os_ << (pretty_ ? ", " : ",");
+        Put(',');
+        if (pretty_) {
+            Put(' ');
+        }
     }
     
     has_value_ = true;
@@ -93,7 +146,7 @@ void JSONFormat::WriteIndention()
     }
     
     for (unsigned i = 0; i < indention_; ++i) {
-        *os_ << kIndentWith;
+        Put(kIndentWith);
     }
 }
 
@@ -103,7 +156,7 @@ void JSONFormat::Newline()
         return;
     }
     
-    *os_ << kLineBreakWith;
+    Put(kLineBreakWith);
 }
 
 void JSONFormat::Write(std::nullptr_t)
@@ -112,7 +165,7 @@ void JSONFormat::Write(std::nullptr_t)
     
     BeforeWrite();
     
-    *os_ << "null";
+    Put("null", 4);
 }
 
 void JSONFormat::Write(bool val)
@@ -121,7 +174,11 @@ void JSONFormat::Write(bool val)
     
     BeforeWrite();
     
-    *os_ << (val ? "true" : "false");
+    if (val) {
+        Put("true", 4);
+    } else {
+        Put("false", 5);
+    }
 }
 
 void JSONFormat::Write(int val)
@@ -130,9 +187,10 @@ void JSONFormat::Write(int val)
     
     BeforeWrite();
     
-    char buf[32];
-    std::snprintf(buf, sizeof buf, "%d", val);
-    *os_ << buf;
+    char* buf = out_.Reserve(kNumberBufferSize);
+    if (buf) {
+        out_.Commit(FormatSigned(val, buf));
+    }
 }
 
 void JSONFormat::Write(unsigned val)
@@ -141,28 +199,91 @@ void JSONFormat::Write(unsigned val)
     
     BeforeWrite();
     
-    char buf[32];
-    std::snprintf(buf, sizeof buf, "%d", val);
-    *os_ << buf;
+    char* buf = out_.Reserve(kNumberBufferSize);
+    if (buf) {
+        out_.Commit(FormatUnsigned(val, buf));
+    }
 }
 
-// http://stackoverflow.com/questions/2225956/what-is-the-sprintf-pattern-to-output-floats-without-ending-zeros
-void morphNumericString(char *s) {
-    char *p = strchr(s,'.');
-    if (p == NULL) {
-        strcat (s, ".0");
+void JSONFormat::Write(unsigned long long val)
+{
+    ENABLED
+    
+    BeforeWrite();
+    
+    char* buf = out_.Reserve(kNumberBufferSize);
+    if (buf) {
+        out_.Commit(FormatUnsigned(val, buf));
+    }
+}
+
+// values WriteValues formats per output buffer reservation
+static const size_t kValuesPerBatch = 256;
+
+void JSONFormat::WriteValues(const unsigned* values, size_t count)
+{
+    ENABLED
+    
+    if (count == 0) {
         return;
     }
     
-    p = &(p[strlen(p)-1]);
-    while ((p != s) && (*p == '0') && (*(p-1) != '.')) {
-        *p-- = '\0';
+    // the first value goes through the usual separator logic, the rest
+    // are known to follow a value in the same array
+    BeforeWrite();
+    
+    const size_t separator = pretty_ ? 2 : 1;
+    const size_t value_size = separator + 10; // digits of UINT32_MAX
+    
+    size_t i = 0;
+    bool first = true;
+    while (i < count) {
+        size_t batch = std::min(count - i, kValuesPerBatch);
+        char* buf = out_.Reserve(batch * value_size);
+        if (!buf) {
+            return;
+        }
+        
+        char* p = buf;
+        for (size_t end = i + batch; i < end; ++i) {
+            if (!first) {
+                p[0] = ',';
+                p[1] = ' ';
+                p += separator;
+            }
+            first = false;
+            
+            p += FormatUnsigned(values[i], p);
+        }
+        
+        out_.Commit(p - buf);
     }
 }
 
 void JSONFormat::Write(float val)
 {
-    Write((double)val);
+    ENABLED
+    
+    // rounds the float's own shortest digits, its binary value widened to
+    // a double has more of them: 0.1f is 0.100000001490116
+    if (fixed_) {
+        double shortest = val;
+        if (std::isfinite(val)) {
+            char digits[kNumberBufferSize + 1];
+            digits[FormatShortest(val, digits)] = '\0';
+            shortest = std::strtod(digits, nullptr);
+        }
+        
+        Write(shortest);
+        return;
+    }
+    
+    BeforeWrite();
+    
+    char* buf = out_.Reserve(kNumberBufferSize);
+    if (buf) {
+        out_.Commit(FormatShortest(val, buf));
+    }
 }
 
 void JSONFormat::Write(double val)
@@ -171,13 +292,19 @@ void JSONFormat::Write(double val)
     
     BeforeWrite();
     
-    char buf[32];
-    snprintf(buf, sizeof buf, precision_format_, val);
-    
-    // remove trailing zeros
-    morphNumericString(buf);
+    // format straight into the output buffer
+    char* buf = out_.Reserve(kNumberBufferSize);
+    if (!buf) {
+        return;
+    }
     
-    *os_ << buf;
+    if (fixed_) {
+        out_.Commit(FormatFixed(val, precision_, buf));
+    } else if (float32_) {
+        out_.Commit(FormatShortest((float)val, buf));
+    } else {
+        out_.Commit(FormatShortest(val, buf));
+    }
 }
 
 void JSONFormat::Write(const char* val)
@@ -186,44 +313,58 @@ void JSONFormat::Write(const char* val)
     
     BeforeWrite();
     
-    *os_ << '"';
+    Put('"');
     
     // thanks to https://github.com/dropbox/json11
+    // characters that need no escaping are copied in runs
     auto len = strlen(val);
+    unsigned run = 0;
     for (unsigned i = 0; i < len; i++) {
         const char ch = val[i];
+        const char* escaped = nullptr;
+        char buf[8];
+        
         if (ch == '\\') {
-            *os_ << "\\\\";
+            escaped = "\\\\";
         } else if (ch == '"') {
-            *os_ << "\\\"";
+            escaped = "\\\"";
         } else if (ch == '\b') {
-            *os_ << "\\b";
+            escaped = "\\b";
         } else if (ch == '\f') {
-            *os_ << "\\f";
+            escaped = "\\f";
         } else if (ch == '\n') {
-            *os_ << "\\n";
+            escaped = "\\n";
         } else if (ch == '\r') {
-            *os_ << "\\r";
+            escaped = "\\r";
         } else if (ch == '\t') {
-            *os_ << "\\t";
+            escaped = "\\t";
         } else if (static_cast<uint8_t>(ch) <= 0x1f) {
-            char buf[8];
             snprintf(buf, sizeof buf, "\\u%04x", ch);
-            *os_ << buf;
+            escaped = buf;
         } else if (static_cast<uint8_t>(ch) == 0xe2 && static_cast<uint8_t>(val[i+1]) == 0x80
                    && static_cast<uint8_t>(val[i+2]) == 0xa8) {
-            *os_ << "\\u2028";
-            i += 2;
+            escaped = "\\u2028";
         } else if (static_cast<uint8_t>(ch) == 0xe2 && static_cast<uint8_t>(val[i+1]) == 0x80
                    && static_cast<uint8_t>(val[i+2]) == 0xa9) {
-            *os_ << "\\u2029";
+            escaped = "\\u2029";
+        }
+        
+        if (!escaped) {
+            continue;
+        }
+        
+        Put(val + run, i - run);
+        Put(escaped, strlen(escaped));
+        
+        // skip the remaining bytes of U+2028/U+2029
+        if (static_cast<uint8_t>(ch) == 0xe2) {
             i += 2;
-        } else {
-            *os_ << ch;
         }
+        run = i + 1;
     }
+    Put(val + run, len - run);
     
-    *os_ << '"';
+    Put('"');
 }
 
 void JSONFormat::Write(std::string val)
@@ -231,57 +372,95 @@ void JSONFormat::Write(std::string val)
     Write(val.c_str());
 }
 
-inline void a3_to_a4(unsigned char * a4, unsigned char * a3) {
-    a4[0] = (a3[0] & 0xfc) >> 2;
-    a4[1] = ((a3[0] & 0x03) << 4) + ((a3[1] & 0xf0) >> 4);
-    a4[2] = ((a3[1] & 0x0f) << 2) + ((a3[2] & 0xc0) >> 6);
-    a4[3] = (a3[2] & 0x3f);
-}
-
 void JSONFormat::Write(std::ifstream& is, std::string type)
 {
     ENABLED
     
     BeforeWrite();
     
-    *os_ << '"';
-    *os_ << "data:" + type + ";base64,";
-    
-    // thanks to https://github.com/adamvr/arduino-base64/blob/master/Base64.cpp
-    int i = 0, j = 0;
-    unsigned char a3[3];
-    unsigned char a4[4];
+    Put('"');
+    Put("data:" + type + ";base64,");
     
-    while(!is.eof()) {
-        a3[i++] = is.get();
-        if(i == 3) {
-            a3_to_a4(a4, a3);
-            
-            for(i = 0; i < 4; i++) {
-                *os_ << kBase64Enc[a4[i]];
-            }
-            
-            i = 0;
-        }
-    }
+    // read in large blocks, a multiple of 3 bytes so only the last one
+    // needs padding, and encode each straight into the output buffer
+    static const size_t kBlockSize = 3 * 64 * 1024;
+    std::vector<unsigned char> block(kBlockSize);
     
-    if(i) {
-        for(j = i; j < 3; j++) {
-            a3[j] = '\0';
-        }
-        
-        a3_to_a4(a4, a3);
-        
-        for(j = 0; j < i + 1; j++) {
-            *os_ << kBase64Enc[a4[i]];
+    while (is) {
+        is.read(reinterpret_cast<char*>(block.data()), kBlockSize);
+        size_t count = static_cast<size_t>(is.gcount());
+        if (count == 0) {
+            break;
         }
         
-        while((i++ < 3)) {
-            *os_ << '=';
+        char* buf = out_.Reserve(Base64Size(count));
+        if (!buf) {
+            break;
         }
+        out_.Commit(EncodeBase64(block.data(), count, buf));
     }
     
-    *os_ << '"';
+    Put('"');
+}
+
+void JSONFormat::WriteRaw(const void* data, size_t size)
+{
+    ENABLED
+    
+    out_.Write(data, size);
+}
+
+uint64_t JSONFormat::Tell()
+{
+    return out_.Tell();
+}
+
+void JSONFormat::WriteRawAt(uint64_t position, const void* data, size_t size)
+{
+    ENABLED
+    
+    out_.WriteAt(position, data, size);
+}
+
+void JSONFormat::StartFragment(const JSONFormat& parent)
+{
+    ff_Cleanup();
+    
+    precision_ = parent.precision_;
+    fixed_ = parent.fixed_;
+    float32_ = parent.float32_;
+    pretty_ = parent.pretty_;
+    enabled_ = parent.enabled_;
+    indention_ = parent.indention_;
+    has_value_ = false;
+    
+    out_.OpenMemory();
+}
+
+void JSONFormat::WriteFragment(const JSONFormat& fragment)
+{
+    assert(fragment.context_.size() == 0);
+    
+    WriteFragment(fragment.FragmentData(), fragment.FragmentSize());
+}
+
+void JSONFormat::WriteFragment(const char* data, size_t size)
+{
+    ENABLED
+    
+    BeforeWrite();
+    
+    Put(data, size);
+}
+
+const char* JSONFormat::FragmentData() const
+{
+    return out_.Data();
+}
+
+size_t JSONFormat::FragmentSize() const
+{
+    return static_cast<size_t>(out_.Tell());
 }
 
 void JSONFormat::WriteKey(std::string str)
@@ -291,12 +470,15 @@ void JSONFormat::WriteKey(std::string str)
     assert(context_.size() > 0 && context_.top() == kObject);
     
     if (has_value_) {
-        *os_ << ",";
+        Put(',');
     }
     Newline();
     WriteIndention();
     Write(str);
-    *os_ << (pretty_ ? ": " : ":");
+    Put(':');
+    if (pretty_) {
+        Put(' ');
+    }
     
     context_.push(kValue);
 }
@@ -311,7 +493,10 @@ void JSONFormat::WriteColor(const LXtVector& color)
               ((int(color[1] * 255) & 0xff) << 8) +
               ((int(color[2] * 255) & 0xff));
     
-    *os_ << val;
+    char* buf = out_.Reserve(kNumberBufferSize);
+    if (buf) {
+        out_.Commit(FormatSigned(val, buf));
+    }
 }
 
 void JSONFormat::Property(std::string key, bool val)
@@ -332,6 +517,12 @@ void JSONFormat::Property(std::string key, unsigned val)
     Write(val);
 }
 
+void JSONFormat::Property(std::string key, unsigned long long val)
+{
+    WriteKey(key);
+    Write(val);
+}
+
 void JSONFormat::Property(std::string key, float val)
 {
     Property(key, (double)val);
@@ -367,7 +558,7 @@ void JSONFormat::StartObject()
     has_value_ = false;
     
     indention_++;
-    *os_ << '{';
+    Put('{');
 }
 
 void JSONFormat::StartObject(std::string key)
@@ -390,7 +581,7 @@ void JSONFormat::EndObject()
     
     indention_--;
     WriteIndention();
-    *os_ << '}';
+    Put('}');
 }
 
 void JSONFormat::StartArray()
@@ -404,7 +595,7 @@ void JSONFormat::StartArray()
     context_.push(kArray);
     has_value_ = false;
     
-    *os_ << '[';
+    Put('[');
 }
 
 void JSONFormat::StartArray(std::string key)
@@ -421,5 +612,5 @@ void JSONFormat::EndArray()
     context_.pop();
     has_value_ = true;
     
-    *os_ << ']';
+    Put(']');
 }
@@ -5,6 +5,8 @@
 #include <fstream>
 #include <stack>
 
+#include "bufferedfile.h"
+
 #include <lxu_format.hpp>
 
 class JSONFormat : public CLxFileFormat
@@ -21,26 +23,55 @@ public:
     const char*	file_name;
     std::string filename_;
 
+    // fixed number of decimal places, instead of the shortest
+    // representation that reads back as the same value
     const unsigned precision() const;
     void precision(unsigned);
     
+    // whether a precision was set, numbers are the shortest otherwise
+    const bool fixed() const;
+    
+    // shortest representation of the value rounded to a 32 bit float,
+    // as it ends up in Float32Array attributes anyway
+    const bool float32() const;
+    void float32(bool);
+    
     const bool pretty() const;
     void pretty(bool);
+    
+    // compresses files opened afterwards, which get the method's extension
+    // appended: scene.json -> scene.json.gz
+    void compression(Compressor::Method, int level);
+    
+    // bytes in the file after compression, once it is closed
+    uint64_t Stored() const;
+    
+    // Flushes the output, finishes its compressed stream and closes the
+    // file. Returns false if any of it failed, as ff_HasError does from
+    // then on.
+    bool Close();
 
     void Write(std::nullptr_t);
     void Write(bool);
     void Write(int);
     void Write(unsigned);
+    void Write(unsigned long long);
     void Write(float);
     void Write(double);
     void Write(const char*);
     void Write(std::string);
     void Write(std::ifstream& is, std::string type);
+    
+    // Appends count values to the current array, formatted in batches
+    // straight into the output buffer, e.g. for long index streams.
+    void WriteValues(const unsigned* values, size_t count);
+    
     void WriteKey(std::string);
     void Property(std::string, bool);
     void WriteColor(const LXtVector& color);
     void Property(std::string, int);
     void Property(std::string, unsigned);
+    void Property(std::string, unsigned long long);
     void Property(std::string, float);
     void Property(std::string, double);
     void Property(std::string, std::string);
@@ -52,9 +83,26 @@ public:
     void StartArray(std::string);
     void EndArray();
     
-private:
+    // Sets up an in-memory document that formats like parent and starts at
+    // its indention, so it can be encoded on another thread and spliced into
+    // the parent with WriteFragment.
+    void StartFragment(const JSONFormat& parent);
+    void WriteFragment(const JSONFormat& fragment);
     
-    const std::string kBase64Enc = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    // splices in the contents of a fragment encoded earlier
+    void WriteFragment(const char* data, size_t size);
+    
+    const char* FragmentData() const;
+    size_t FragmentSize() const;
+    
+protected:
+    
+    // unformatted output, e.g. for binary container headers
+    void WriteRaw(const void*, size_t);
+    void WriteRawAt(uint64_t position, const void*, size_t);
+    uint64_t Tell();
+    
+private:
     
     // prevent implicit argument type conversion
     template<typename T>
@@ -71,15 +119,34 @@ private:
     const std::string kIndentWith = "\t";
     const std::string kLineBreakWith = "\n";
     
-    std::ofstream* os_ = nullptr;
+    BufferedFile out_;
     std::stack<Context> context_;
     unsigned precision_ = 13;
-    const char* precision_format_ = "%.13g";
+    bool fixed_ = false;
+    bool float32_ = false;
     bool pretty_ = true;
+    Compressor::Method compression_ = Compressor::kNone;
+    int compression_level_ = 0;
     bool enabled_ = false;
+    bool closed_ = false;
     bool has_value_ = false;
     unsigned indention_ = 0;
 
+    inline void Put(char c)
+    {
+        out_.Put(c);
+    }
+    
+    inline void Put(const char* str, size_t len)
+    {
+        out_.Write(str, len);
+    }
+    
+    inline void Put(const std::string& str)
+    {
+        out_.Write(str.data(), str.size());
+    }
+    
     void BeforeWrite();
     void WriteIndention();
     void Newline();
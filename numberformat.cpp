@@ -0,0 +1,482 @@
+#include "numberformat.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+/*
+ * Grisu2, after "Printing Floating-Point Numbers Quickly and Accurately
+ * with Integers" (Florian Loitsch, 2010) and the implementation of
+ * Milo Yip (https://github.com/miloyip/dtoa-benchmark). The output always
+ * reads back as the input value and is the shortest such decimal in
+ * almost all cases.
+ */
+
+// do it yourself floating point: f * 2^e
+struct DiyFp
+{
+    DiyFp() : f(0), e(0) {
+    }
+    
+    DiyFp(uint64_t f, int e) : f(f), e(e) {
+    }
+    
+    DiyFp operator-(const DiyFp& rhs) const
+    {
+        return DiyFp(f - rhs.f, e);
+    }
+    
+    // upper 64 bits of the product, rounded
+    DiyFp operator*(const DiyFp& rhs) const
+    {
+        const uint64_t M32 = 0xffffffff;
+        const uint64_t a = f >> 32;
+        const uint64_t b = f & M32;
+        const uint64_t c = rhs.f >> 32;
+        const uint64_t d = rhs.f & M32;
+        const uint64_t ac = a * c;
+        const uint64_t bc = b * c;
+        const uint64_t ad = a * d;
+        const uint64_t bd = b * d;
+        uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+        tmp += 1U << 31;
+        return DiyFp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), e + rhs.e + 64);
+    }
+    
+    DiyFp Normalize() const
+    {
+        DiyFp res = *this;
+        while (!(res.f & (uint64_t(1) << 63))) {
+            res.f <<= 1;
+            res.e--;
+        }
+        return res;
+    }
+    
+    uint64_t f;
+    int e;
+};
+
+// 10^-348, 10^-340, ..., 10^340 as normalized DiyFp
+static DiyFp CachedPower(int e, int* K)
+{
+    static const uint64_t kCachedPowersF[] = {
+        0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+        0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+        0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+        0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+        0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+        0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+        0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+        0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+        0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+        0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+        0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+        0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+        0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+        0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+        0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+        0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+        0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+        0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+        0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+        0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+        0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+        0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+        0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+        0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+        0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+        0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+        0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+        0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+        0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+    };
+    static const int16_t kCachedPowersE[] = {
+        -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+        -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+        -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+        -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+        -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+        109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+        375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+        641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+        907, 933, 960, 986, 1013, 1039, 1066,
+    };
+    
+    // the resulting exponent of the product is in [-60, -32]
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int k = static_cast<int>(dk);
+    if (dk - k > 0.0) {
+        k++;
+    }
+    
+    unsigned index = static_cast<unsigned>((k >> 3) + 1);
+    *K = -(-348 + static_cast<int>(index << 3));
+    
+    return DiyFp(kCachedPowersF[index], kCachedPowersE[index]);
+}
+
+static const uint64_t kPow10[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static void GrisuRound(char* buffer, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w)
+{
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        buffer[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static int CountDecimalDigits(uint32_t n)
+{
+    int count = 1;
+    while (n >= 10) {
+        n /= 10;
+        count++;
+    }
+    return count;
+}
+
+static void DigitGen(const DiyFp& W, const DiyFp& Mp, uint64_t delta, char* buffer, int* len, int* K)
+{
+    const DiyFp one(uint64_t(1) << -Mp.e, Mp.e);
+    const DiyFp wp_w = Mp - W;
+    uint32_t p1 = static_cast<uint32_t>(Mp.f >> -one.e);
+    uint64_t p2 = Mp.f & (one.f - 1);
+    int kappa = CountDecimalDigits(p1);
+    *len = 0;
+    
+    // integral digits
+    while (kappa > 0) {
+        uint32_t divisor = static_cast<uint32_t>(kPow10[kappa - 1]);
+        uint32_t d = p1 / divisor;
+        p1 %= divisor;
+        
+        if (d || *len) {
+            buffer[(*len)++] = static_cast<char>('0' + d);
+        }
+        
+        kappa--;
+        uint64_t tmp = (static_cast<uint64_t>(p1) << -one.e) + p2;
+        if (tmp <= delta) {
+            *K += kappa;
+            GrisuRound(buffer, *len, delta, tmp, kPow10[kappa] << -one.e, wp_w.f);
+            return;
+        }
+    }
+    
+    // fractional digits
+    while (true) {
+        p2 *= 10;
+        delta *= 10;
+        char d = static_cast<char>(p2 >> -one.e);
+        if (d || *len) {
+            buffer[(*len)++] = static_cast<char>('0' + d);
+        }
+        
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta) {
+            *K += kappa;
+            int index = -kappa;
+            GrisuRound(buffer, *len, delta, p2, one.f, wp_w.f * (index < 20 ? kPow10[index] : 0));
+            return;
+        }
+    }
+}
+
+// f * 2^e is the value, lower_closer if the next smaller value is only
+// half an ulp away (at powers of two)
+static void Grisu2(uint64_t f, int e, bool lower_closer, char* buffer, int* length, int* K)
+{
+    DiyFp plus = DiyFp((f << 1) + 1, e - 1).Normalize();
+    DiyFp minus = lower_closer ? DiyFp((f << 2) - 1, e - 2) : DiyFp((f << 1) - 1, e - 1);
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+    
+    const DiyFp c_mk = CachedPower(plus.e, K);
+    const DiyFp W = DiyFp(f, e).Normalize() * c_mk;
+    DiyFp Wp = plus * c_mk;
+    DiyFp Wm = minus * c_mk;
+    Wm.f++;
+    Wp.f--;
+    
+    DigitGen(W, Wp, Wp.f - Wm.f, buffer, length, K);
+}
+
+static char* WriteExponent(int K, char* buffer)
+{
+    *buffer++ = 'e';
+    
+    if (K < 0) {
+        *buffer++ = '-';
+        K = -K;
+    }
+    
+    if (K >= 100) {
+        *buffer++ = static_cast<char>('0' + K / 100);
+        K %= 100;
+        *buffer++ = static_cast<char>('0' + K / 10);
+        *buffer++ = static_cast<char>('0' + K % 10);
+    } else if (K >= 10) {
+        *buffer++ = static_cast<char>('0' + K / 10);
+        *buffer++ = static_cast<char>('0' + K % 10);
+    } else {
+        *buffer++ = static_cast<char>('0' + K);
+    }
+    
+    return buffer;
+}
+
+// digits * 10^k -> decimal notation
+static char* Prettify(char* buffer, int length, int k)
+{
+    const int kk = length + k; // 10^(kk-1) <= v < 10^kk
+    
+    if (0 <= k && kk <= 21) {
+        // 1234e7 -> 12340000000.0
+        for (int i = length; i < kk; i++) {
+            buffer[i] = '0';
+        }
+        buffer[kk] = '.';
+        buffer[kk + 1] = '0';
+        return &buffer[kk + 2];
+    } else if (0 < kk && kk <= 21) {
+        // 1234e-2 -> 12.34
+        memmove(&buffer[kk + 1], &buffer[kk], length - kk);
+        buffer[kk] = '.';
+        return &buffer[length + 1];
+    } else if (-6 < kk && kk <= 0) {
+        // 1234e-6 -> 0.001234
+        const int offset = 2 - kk;
+        memmove(&buffer[offset], &buffer[0], length);
+        buffer[0] = '0';
+        buffer[1] = '.';
+        for (int i = 2; i < offset; i++) {
+            buffer[i] = '0';
+        }
+        return &buffer[length + offset];
+    } else if (length == 1) {
+        // 1e30
+        return WriteExponent(kk - 1, &buffer[1]);
+    } else {
+        // 1234e30 -> 1.234e33
+        memmove(&buffer[2], &buffer[1], length - 1);
+        buffer[1] = '.';
+        return WriteExponent(kk - 1, &buffer[length + 1]);
+    }
+}
+
+// JSON has no representation for them
+static unsigned FormatNonFinite(char* buffer)
+{
+    memcpy(buffer, "null", 4);
+    return 4;
+}
+
+unsigned FormatShortest(double value, char* buffer)
+{
+    if (!std::isfinite(value)) {
+        return FormatNonFinite(buffer);
+    }
+    
+    char* start = buffer;
+    if (std::signbit(value)) {
+        *buffer++ = '-';
+        value = -value;
+    }
+    
+    if (value == 0.0) {
+        memcpy(buffer, "0.0", 3);
+        return static_cast<unsigned>(buffer + 3 - start);
+    }
+    
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof bits);
+    
+    const uint64_t kHiddenBit = uint64_t(1) << 52;
+    uint64_t significand = bits & (kHiddenBit - 1);
+    int biased_e = static_cast<int>(bits >> 52);
+    
+    uint64_t f;
+    int e;
+    if (biased_e != 0) {
+        f = significand + kHiddenBit;
+        e = biased_e - 1075;
+    } else {
+        f = significand;
+        e = -1074;
+    }
+    
+    int length, K = 0;
+    Grisu2(f, e, f == kHiddenBit && biased_e > 1, buffer, &length, &K);
+    
+    return static_cast<unsigned>(Prettify(buffer, length, K) - start);
+}
+
+unsigned FormatShortest(float value, char* buffer)
+{
+    if (!std::isfinite(value)) {
+        return FormatNonFinite(buffer);
+    }
+    
+    char* start = buffer;
+    if (std::signbit(value)) {
+        *buffer++ = '-';
+        value = -value;
+    }
+    
+    if (value == 0.0f) {
+        memcpy(buffer, "0.0", 3);
+        return static_cast<unsigned>(buffer + 3 - start);
+    }
+    
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof bits);
+    
+    const uint32_t kHiddenBit = uint32_t(1) << 23;
+    uint32_t significand = bits & (kHiddenBit - 1);
+    int biased_e = static_cast<int>(bits >> 23);
+    
+    uint64_t f;
+    int e;
+    if (biased_e != 0) {
+        f = significand + kHiddenBit;
+        e = biased_e - 150;
+    } else {
+        f = significand;
+        e = -149;
+    }
+    
+    int length, K = 0;
+    Grisu2(f, e, f == kHiddenBit && biased_e > 1, buffer, &length, &K);
+    
+    return static_cast<unsigned>(Prettify(buffer, length, K) - start);
+}
+
+// "%.Nf" and trailing zero removal, for values the fast path rejects
+static unsigned FormatFixedSlow(double value, unsigned precision, char* buffer)
+{
+    int len = snprintf(buffer, kNumberBufferSize, "%.*f", precision, value);
+    
+    char* p = strchr(buffer, '.');
+    if (p == NULL) {
+        memcpy(buffer + len, ".0", 3);
+        return len + 2;
+    }
+    
+    p = &buffer[len - 1];
+    while (*p == '0' && *(p - 1) != '.') {
+        *p-- = '\0';
+        len--;
+    }
+    
+    return len;
+}
+
+unsigned FormatFixed(double value, unsigned precision, char* buffer)
+{
+    if (!std::isfinite(value)) {
+        return FormatNonFinite(buffer);
+    }
+    
+    // too long for fixed notation
+    if (std::fabs(value) >= 1e15) {
+        return FormatShortest(value, buffer);
+    }
+    
+    if (precision > 13) {
+        precision = 13;
+    }
+    
+    // Scaling by 10^precision is off by at most half an ulp of the result.
+    // Values that land within that distance of a rounding tie are left to
+    // snprintf, which rounds the exact binary value.
+    double scaled = std::fabs(value) * kPow10[precision];
+    double integral = std::floor(scaled);
+    double fraction = scaled - integral;
+    
+    if (scaled >= 1e15 || std::fabs(fraction - 0.5) <= scaled * 2.3e-16 + 1e-300) {
+        return FormatFixedSlow(value, precision, buffer);
+    }
+    
+    uint64_t rounded = static_cast<uint64_t>(integral) + (fraction > 0.5 ? 1 : 0);
+    uint64_t int_part = rounded / kPow10[precision];
+    uint64_t frac_part = rounded % kPow10[precision];
+    
+    char* p = buffer;
+    if (std::signbit(value)) {
+        *p++ = '-';
+    }
+    
+    // integral part
+    p += FormatUnsigned(int_part, p);
+    
+    *p++ = '.';
+    
+    // fractional part without trailing zeros, at least one digit
+    unsigned places = precision;
+    while (places > 1 && frac_part % 10 == 0) {
+        frac_part /= 10;
+        places--;
+    }
+    for (unsigned i = places; i > 0; --i) {
+        p[i - 1] = static_cast<char>('0' + frac_part % 10);
+        frac_part /= 10;
+    }
+    p += places > 0 ? places : 0;
+    if (places == 0) {
+        *p++ = '0';
+    }
+    
+    return static_cast<unsigned>(p - buffer);
+}
+
+static const char kDigitPairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+unsigned FormatUnsigned(uint64_t value, char* buffer)
+{
+    unsigned length = 1;
+    while (length < 20 && value >= kPow10[length]) {
+        length++;
+    }
+    
+    // fill in from the last digit
+    char* p = buffer + length;
+    while (value >= 100) {
+        unsigned pair = static_cast<unsigned>(value % 100) * 2;
+        value /= 100;
+        *--p = kDigitPairs[pair + 1];
+        *--p = kDigitPairs[pair];
+    }
+    
+    if (value >= 10) {
+        unsigned pair = static_cast<unsigned>(value) * 2;
+        *--p = kDigitPairs[pair + 1];
+        *--p = kDigitPairs[pair];
+    } else {
+        *--p = static_cast<char>('0' + value);
+    }
+    
+    return length;
+}
+
+unsigned FormatSigned(int64_t value, char* buffer)
+{
+    if (value >= 0) {
+        return FormatUnsigned(static_cast<uint64_t>(value), buffer);
+    }
+    
+    // negated in unsigned arithmetic, which also holds INT64_MIN
+    *buffer = '-';
+    return 1 + FormatUnsigned(0 - static_cast<uint64_t>(value), buffer + 1);
+}
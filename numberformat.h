@@ -0,0 +1,25 @@
+#ifndef __threeio__number_format__
+#define __threeio__number_format__
+
+#include <cstddef>
+#include <cstdint>
+
+// Buffers passed to the formatters need at least this many characters.
+const size_t kNumberBufferSize = 32;
+
+// Shortest decimal that reads back as the same double or float (Grisu2),
+// with a trailing ".0" for integral values and an exponent outside of
+// [1e-6, 1e21), like JavaScript numbers. Returns the length written.
+unsigned FormatShortest(double value, char* buffer);
+unsigned FormatShortest(float value, char* buffer);
+
+// Rounds to a fixed number of decimal places, like "%.Nf", and strips
+// trailing zeros (but keeps one after the decimal point).
+unsigned FormatFixed(double value, unsigned precision, char* buffer);
+
+// Decimal digits of an integer, like "%llu" and "%lld", two at a time from
+// a lookup table. Returns the length written.
+unsigned FormatUnsigned(uint64_t value, char* buffer);
+unsigned FormatSigned(int64_t value, char* buffer);
+
+#endif // /* defined(__threeio__number_format__) */
@@ -0,0 +1,74 @@
+#include "parallel.h"
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+unsigned HardwareThreads()
+{
+    unsigned threads = std::thread::hardware_concurrency();
+    
+    return threads > 0 ? threads : 1;
+}
+
+void ParallelFor(size_t count, unsigned threads, const std::function<void(size_t)>& task)
+{
+    if (threads > count) {
+        threads = static_cast<unsigned>(count);
+    }
+    
+    if (threads <= 1) {
+        for (size_t i = 0; i < count; ++i) {
+            task(i);
+        }
+        return;
+    }
+    
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    
+    auto work = [&]() {
+        while (!failed) {
+            size_t i = next++;
+            if (i >= count) {
+                return;
+            }
+            
+            try {
+                task(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                failed = true;
+            }
+        }
+    };
+    
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (unsigned i = 1; i < threads; ++i) {
+        try {
+            workers.push_back(std::thread(work));
+        } catch (const std::system_error&) {
+            // carry on with the threads we got
+            break;
+        }
+    }
+    
+    work();
+    
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,16 @@
+#ifndef __threeio__parallel__
+#define __threeio__parallel__
+
+#include <cstddef>
+#include <functional>
+
+// Number of threads the hardware runs concurrently, at least 1.
+unsigned HardwareThreads();
+
+// Runs task(0) ... task(count - 1) on up to threads threads, the calling
+// thread included. Tasks are handed out in index order, and all of them
+// have finished when this returns. The first exception thrown by a task
+// is rethrown on the calling thread.
+void ParallelFor(size_t count, unsigned threads, const std::function<void(size_t)>& task);
+
+#endif // /* defined(__threeio__parallel__) */
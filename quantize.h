@@ -0,0 +1,52 @@
+#ifndef __threeio__quantize__
+#define __threeio__quantize__
+
+#include <cmath>
+#include <cstdint>
+
+// Normalized integer attributes as WebGL reads them back: signed values
+// map to [-1, 1] by q / max, unsigned ones to [0, 1].
+const int kMaxInt8 = 127;
+const int kMaxInt16 = 32767;
+const int kMaxUint16 = 65535;
+
+inline int QuantizeSnorm(double v, int max)
+{
+    if (v > 1) {
+        v = 1;
+    } else if (v < -1) {
+        v = -1;
+    }
+    
+    return static_cast<int>(std::lround(v * max));
+}
+
+inline int QuantizeUnorm(double v, int max)
+{
+    if (v > 1) {
+        v = 1;
+    } else if (v < 0) {
+        v = 0;
+    }
+    
+    return static_cast<int>(std::lround(v * max));
+}
+
+// position relative to a bounding box of half size scale around offset
+inline int16_t QuantizePosition(double v, double offset, double scale)
+{
+    return static_cast<int16_t>(QuantizeSnorm((v - offset) / scale, kMaxInt16));
+}
+
+// component of a unit normal, normalized by the vector's length
+inline int8_t QuantizeNormal(double v, double length)
+{
+    return static_cast<int8_t>(QuantizeSnorm(length > 0 ? v / length : 0, kMaxInt8));
+}
+
+inline uint16_t QuantizeUV(double v)
+{
+    return static_cast<uint16_t>(QuantizeUnorm(v, kMaxUint16));
+}
+
+#endif // /* defined(__threeio__quantize__) */
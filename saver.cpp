@@ -1,19 +1,53 @@
 #include "saver.h"
+#include "gltfsaver.h"
+#include "parallel.h"
+#include "quantize.h"
+#include "triangulate.h"
 
+#include <algorithm>
 #include <cctype>
+#include <chrono>
 #include <libgen.h>
+#include <stdexcept>
 
 #include <lxlog.h>
 #include <lxidef.h>
 #include <lxu_queries.hpp>
 #include <lxw_locator.hpp>
 
+// scene.json -> scene.bin
+std::string ReplaceExtension(const std::string& path, const std::string& extension)
+{
+    auto dot = path.find_last_of('.');
+    auto separator = path.find_last_of("/\\");
+    
+    if (dot == std::string::npos || (separator != std::string::npos && dot < separator)) {
+        return path + "." + extension;
+    }
+    
+    return path.substr(0, dot + 1) + extension;
+}
+
+// path/to/scene.bin -> scene.bin
+std::string FileName(const std::string& path)
+{
+    auto separator = path.find_last_of("/\\");
+    
+    if (separator == std::string::npos) {
+        return path;
+    }
+    
+    return path.substr(separator + 1);
+}
+
 THREESceneSaver::THREESceneSaver()
 {
 }
 
 void THREESceneSaver::WriteScene()
 {
+    PhaseTimer timer(stats_, ExportStats::kPhaseScene);
+    
     scene_.GetChannels(chan_, LXs_ACTIONLAYER_EDIT);
     scene_.GetChannels(chan_xform_, 0.0);
 
@@ -57,6 +91,32 @@ void THREESceneSaver::WriteScene()
 
 void THREESceneSaver::WriteMaterials()
 {
+    PhaseTimer timer(stats_, ExportStats::kPhaseMaterials);
+    
+    ScanMaterials();
+    
+    WriteTextures();
+    
+    StartArray("materials");
+    
+    for (auto it = materials_.begin(); it != materials_.end(); it++) {
+        WriteMaterial(*it);
+    }
+    
+    EndArray(); // materials
+    
+    materials_.clear();
+    images_.clear();
+}
+
+/*
+ * Resolves the shader masks of all used material tags, filling materials_,
+ * images_ and the per item material_map_.
+ */
+void THREESceneSaver::ScanMaterials()
+{
+    IndexShaderTree();
+    
     // find all used materials
     StartScan();
     while (NextItem()) {
@@ -64,102 +124,81 @@ void THREESceneSaver::WriteMaterials()
             continue;
         }
         
-        // find used polygon tags
-        poly_pass_ = kPolypassMaterial;
-        WritePolys(0, false);
-        
         std::string item_id = ItemIdentity();
-        std::string item_name = ItemName();
+        StringInterner::ID item_name = names_.Intern(ItemName());
         
-        std::string source_name;
+        // find used polygon tags, instances use the ones of their source
+        const MeshInfo* info;
+        StringInterner::ID source_name = StringInterner::kEmpty;
         if (ItemIsA(LXsITYPE_MESHINST)) {
             CLxUser_Item item, source;
             GetItem(item);
             scene_service_.GetMeshInstSourceItem((ILxUnknownID)item, source);
-            source.GetUniqueName(source_name);
+            
+            std::string name;
+            source.GetUniqueName(name);
+            source_name = names_.Intern(name);
+            
+            SetItem(source);
+            info = &GetMeshInfo();
+            SetItem(item);
+        } else {
+            info = &GetMeshInfo();
         }
         
         // find all item masks
-        for (auto it = poly_tags_.begin(); it != poly_tags_.end(); it++) {
-            ShaderMask mask;
-            
-            //  try item mask + poly tag mask
-            if (ScanShaderTree(it->c_str(), item_name.c_str(), source_name.c_str())) {
-                ShaderLayer layer;
-                std::string diffuse_map, specular_map, emissive_map, bump_map;
-                while (GetNextLayer(layer)) {
-                    SetItem(layer.second);
-                    
-                    // skip disabled materials
-                    if (!ChanInt(LXsICHAN_TEXTURELAYER_ENABLE)) {
-                        continue;
-                    }
-                    
-                    if (ItemIsA(LXsITYPE_IMAGEMAP)) {
-                        auto fx = LayerEffect();
-                        
-                        if (strcmp(fx, LXs_FX_DIFFCOLOR) == 0) {
-                            diffuse_map = ItemIdentity();
-                        } else if (strcmp(fx, LXs_FX_SPECCOLOR) == 0) {
-                            specular_map = ItemIdentity();
-                        } else if (strcmp(fx, LXs_FX_LUMICOLOR) == 0) {
-                            emissive_map = ItemIdentity();
-                        } else if (strcmp(fx, LXs_FX_BUMP) == 0) {
-                            bump_map = ItemIdentity();
-                        }
-                        
-                        mask = layer.first;
-                    }
-                    
-                    // traversing stack from bottom to top,
-                    // take the top most material
-                    if (ItemIsA(LXsITYPE_ADVANCEDMATERIAL)) {
-                        diffuse_map = "";
-                        specular_map = "";
-                        emissive_map = "";
-                        bump_map = "";
-                        
-                        mask = layer.first;
-                    }
-                }
-                
-                if (!diffuse_map.empty()) {
-                    images_.insert(diffuse_map);
-                }
-                
-                if (!specular_map.empty()) {
-                    images_.insert(specular_map);
-                }
-                
-                if (!emissive_map.empty()) {
-                    images_.insert(emissive_map);
-                }
-                
-                if (!bump_map.empty()) {
-                    images_.insert(bump_map);
-                }
+        for (auto it = info->tags.begin(); it != info->tags.end(); it++) {
+            const ResolvedMask& resolved = ResolveMask(names_.Intern(it->first), item_name, source_name);
+            
+            if (!resolved.diffuse_map.empty()) {
+                images_.insert(resolved.diffuse_map);
+            }
+            
+            if (!resolved.specular_map.empty()) {
+                images_.insert(resolved.specular_map);
+            }
+            
+            if (!resolved.emissive_map.empty()) {
+                images_.insert(resolved.emissive_map);
+            }
+            
+            if (!resolved.bump_map.empty()) {
+                images_.insert(resolved.bump_map);
             }
             
-            materials_.insert(mask);
-            material_map_[item_id].insert(mask);
+            materials_.push_back(resolved.mask);
+            material_map_[item_id].push_back(resolved.mask);
         }
-        
-        poly_tag_ = "";
-        poly_tags_.clear();
     }
     
-    WriteTextures();
-    
-    StartArray("materials");
-    
-    for (auto it = materials_.begin(); it != materials_.end(); it++) {
-        WriteMaterial(*it);
+    SortMasks(materials_);
+    for (auto it = material_map_.begin(); it != material_map_.end(); it++) {
+        SortMasks(it->second);
     }
+}
+
+/*
+ * Sorts masks by their names and drops duplicates, so materials are
+ * written in the same order no matter when their names were interned.
+ */
+void THREESceneSaver::SortMasks(std::vector<ShaderMask>& masks) const
+{
+    std::sort(masks.begin(), masks.end(), [this](const ShaderMask& a, const ShaderMask& b) {
+        int order = names_.Name(a.first).compare(names_.Name(b.first));
+        if (order != 0) {
+            return order < 0;
+        }
+        
+        return names_.Name(a.second) < names_.Name(b.second);
+    });
     
-    EndArray(); // materials
-    
-    materials_.clear();
-    images_.clear();
+    masks.erase(std::unique(masks.begin(), masks.end()), masks.end());
+}
+
+// item mask and poly tag of a material, as used for its uuid
+std::string THREESceneSaver::MaskName(const ShaderMask& mask) const
+{
+    return names_.Name(mask.first) + "." + names_.Name(mask.second);
 }
 
 void THREESceneSaver::WriteTextures()
@@ -188,7 +227,7 @@ void THREESceneSaver::WriteTextures()
                 }
                 
                 WriteKey("url");
-                std::ifstream is(path);
+                std::ifstream is(path, std::ios::in | std::ios::binary);
                 Write(is, "image/" + type);
             } else {
                 // TODO: MakeFileRelative (is buggy)
@@ -221,52 +260,119 @@ void THREESceneSaver::WriteTextures()
     EndArray(); // textures
 }
 
-void THREESceneSaver::WriteMaterial(const ShaderMask mask)
+/*
+ * Finds the mask of the top most material for a poly tag on an item, and
+ * the image maps above it. Results are cached, as many meshes share the
+ * same item and tag combinations.
+ */
+const THREESceneSaver::ResolvedMask& THREESceneSaver::ResolveMask(StringInterner::ID poly_tag, StringInterner::ID item_name, StringInterner::ID source_name)
 {
-    if (!ScanShaderTree(mask.second.c_str(), mask.first.c_str())) {
-        return;
+    ShaderQuery query(poly_tag, item_name, source_name);
+    
+    auto cached = resolved_masks_.find(query);
+    if (cached != resolved_masks_.end()) {
+        return cached->second;
+    }
+    
+    ResolvedMask& resolved = resolved_masks_[query];
+    
+    if (ScanShaderTree(poly_tag, item_name, source_name)) {
+        ShaderLayer layer;
+        while (GetNextLayer(layer)) {
+            const ShaderNode& node = *layer.second;
+            
+            // skip disabled materials
+            if (!node.enabled) {
+                continue;
+            }
+            
+            if (node.kind == ShaderNode::kImageMap) {
+                if (node.effect == LXs_FX_DIFFCOLOR) {
+                    resolved.diffuse_map = node.identity;
+                } else if (node.effect == LXs_FX_SPECCOLOR) {
+                    resolved.specular_map = node.identity;
+                } else if (node.effect == LXs_FX_LUMICOLOR) {
+                    resolved.emissive_map = node.identity;
+                } else if (node.effect == LXs_FX_BUMP) {
+                    resolved.bump_map = node.identity;
+                }
+                
+                resolved.mask = layer.first;
+            }
+            
+            // traversing stack from bottom to top,
+            // take the top most material
+            if (node.kind == ShaderNode::kMaterial) {
+                resolved.diffuse_map = "";
+                resolved.specular_map = "";
+                resolved.emissive_map = "";
+                resolved.bump_map = "";
+                
+                resolved.mask = layer.first;
+            }
+        }
+    }
+    
+    return resolved;
+}
+
+/*
+ * Finds the material of a mask and the image maps stacked on top of it.
+ */
+bool THREESceneSaver::ResolveMaterial(const ShaderMask mask, MaterialLayers& layers)
+{
+    if (!ScanShaderTree(mask.second, mask.first)) {
+        return false;
     }
     
     // this does not export every layer, but only the last material
     // in the shader stack for this mask
-    CLxUser_Item material, diffuse_map, specular_map, emissive_map, bump_map;
     ShaderLayer layer;
     while (GetNextLayer(layer)) {
-        SetItem(layer.second);
+        const ShaderNode& node = *layer.second;
         
         // skip disabled materials
-        if (!ChanInt(LXsICHAN_TEXTURELAYER_ENABLE)) {
+        if (!node.enabled) {
             continue;
         }
         
-        if (ItemIsA(LXsITYPE_ADVANCEDMATERIAL)) {
-            GetItem(material);
-            
-            diffuse_map = 0;
-            specular_map = 0;
-            emissive_map = 0;
-            bump_map = 0;
-        } else if (ItemIsA (LXsITYPE_IMAGEMAP)) {
-            auto fx = LayerEffect();
-            
-            if (strcmp(fx, LXs_FX_DIFFCOLOR) == 0) {
-                GetItem(diffuse_map);
-            } else if (strcmp(fx, LXs_FX_SPECCOLOR) == 0) {
-                GetItem(specular_map);
-            } else if (strcmp(fx, LXs_FX_LUMICOLOR) == 0) {
-                GetItem(emissive_map);
-            } else if (strcmp(fx, LXs_FX_BUMP) == 0) {
-                GetItem(bump_map);
+        if (node.kind == ShaderNode::kMaterial) {
+            layers.material.set(node.item);
+            
+            layers.diffuse_map = 0;
+            layers.specular_map = 0;
+            layers.emissive_map = 0;
+            layers.bump_map = 0;
+        } else if (node.kind == ShaderNode::kImageMap) {
+            if (node.effect == LXs_FX_DIFFCOLOR) {
+                layers.diffuse_map.set(node.item);
+            } else if (node.effect == LXs_FX_SPECCOLOR) {
+                layers.specular_map.set(node.item);
+            } else if (node.effect == LXs_FX_LUMICOLOR) {
+                layers.emissive_map.set(node.item);
+            } else if (node.effect == LXs_FX_BUMP) {
+                layers.bump_map.set(node.item);
             }
         }
     }
 
-    if (!material.test() || !SetItem(material)) {
+    return layers.material.test() && SetItem(layers.material);
+}
+
+void THREESceneSaver::WriteMaterial(const ShaderMask mask)
+{
+    MaterialLayers layers;
+    if (!ResolveMaterial(mask, layers)) {
         return;
     }
     
+    auto& diffuse_map = layers.diffuse_map;
+    auto& specular_map = layers.specular_map;
+    auto& emissive_map = layers.emissive_map;
+    auto& bump_map = layers.bump_map;
+    
     StartObject();
-    Property("uuid", mask.first + "." + mask.second); // ItemIdentity());
+    Property("uuid", MaskName(mask)); // ItemIdentity());
     Property("type", "MeshPhongMaterial");
 //    Property("name", ItemName());
     
@@ -388,265 +494,1593 @@ void THREESceneSaver::WriteMaterial(const ShaderMask mask)
 
 void THREESceneSaver::WriteGeometries()
 {
+    PhaseTimer timer(stats_, ExportStats::kPhaseGeometries);
+    
+    unsigned threads = opt_geometry_threads_ > 0 ? opt_geometry_threads_ : HardwareThreads();
+    
+    shared_geometries_.clear();
+    geometry_alias_.clear();
+    geometry_parts_.clear();
+    geometry_dequantization_.clear();
+    index16_count_ = index32_count_ = split_count_ = 0;
+    triangulated_polygons_ = generated_triangles_ = 0;
+    
+    // meshes are snapshot one by one on this thread and encoded in batches,
+    // which bounds the memory held by snapshots and encoded fragments
+    std::vector<GeometryBuffer> batch;
+    size_t batch_bytes = 0;
+    
     StartScan();
     while (NextMesh()) {
-        if (!ItemVisibleForSave() || PointCount() == 0) {
+        if (!ItemVisibleForSave() || GetMeshInfo().points == 0) {
             continue;
         }
         
-        // get all used materials masks
-        poly_pass_ = kPolypassMaterial;
-        WritePolys(0, false);
-        
-        // select uv map
-        CLxUser_Mesh user_mesh;
-        CLxUser_MeshMap mesh_map;
-        
-        if (opt_save_uvs_ && ChanObject(LXsICHAN_MESH_MESH, user_mesh)) {
-            user_mesh.GetMaps(mesh_map);
-            
-            mesh_map.FilterByType(LXi_VMAP_TEXTUREUV);
-            MeshMapVisitor visitor(&mesh_map);
-            mesh_map.Enum(&visitor);
-            
-            if (visitor.names().size() > 0) {
-                // select first uv
-                // TODO: export all uvs?
-                has_uvs_ = SetMap(LXi_VMAP_TEXTUREUV, visitor.names().begin()->c_str());
-            }
-        }
+        SnapshotGeometry();
         
         // create a geometry for each material tag
-        for (auto it = poly_tags_.begin(); it != poly_tags_.end(); it++) {
-            poly_tag_ = *it;
-            
-            if (opt_geometry_type_ == kGeometry) {
-                WriteGeometry();
-            } else {
-                WriteBufferGeometry();
-            }
-            
-            vertices_.clear();
-            positions_.clear();
-            normals_.clear();
-            uvs_.clear();
+        for (auto it = geometries_.begin(); it != geometries_.end(); it++) {
+            batch_bytes += it->second.snapshot.bytes();
+            batch.push_back(std::move(it->second));
         }
         
-        poly_tags_.clear();
-        poly_tag_ = "";
+        geometries_.clear();
+        geometry_ = nullptr;
+        poly_tag_ = StringInterner::kEmpty;
         has_uvs_ = false;
+        
+        if (threads == 1 || batch_bytes >= kGeometryBatchBytes) {
+            EncodeGeometries(batch, threads);
+            batch.clear();
+            batch_bytes = 0;
+        }
     }
-}
-
-void THREESceneSaver::WriteGeometry()
-{
-    StartObject();
-    Property("uuid", ItemIdentity() + poly_tag_);
-    Property("type", "Geometry");
-    
-    StartObject("data");
     
-    // faces
-    StartArray("faces");
-    poly_pass_ = kPolypassGeometry;
-    WritePolys(0, true); // Enable unified polygon material mapping.
-    EndArray();
+    EncodeGeometries(batch, threads);
     
-    // vertices
-    StartArray("vertices");
-    for (auto position : positions_) {
-        Write(position.x);
-        Write(position.y);
-        Write(position.z);
+    // report what sharing identical geometries saved
+    unsigned copies = 0;
+    uint64_t bytes = 0;
+    for (auto it = shared_geometries_.begin(); it != shared_geometries_.end(); it++) {
+        copies += it->second.copies;
+        bytes += it->second.copies * it->second.bytes;
     }
-    EndArray();
     
-    // normals
-    if (opt_save_normals_) {
-        StartArray("normals");
-        for (auto normal : normals_) {
-            Write(normal.x);
-            Write(normal.y);
-            Write(normal.z);
-        }
-        EndArray(); // normals
+    if (copies > 0) {
+        char message[128];
+        snprintf(message, sizeof message, "%u identical geometries shared, about %llu bytes saved",
+                 copies, (unsigned long long)bytes);
+        log.Info(message);
     }
     
-    if (opt_save_uvs_ && has_uvs_) {
-        StartArray("uvs");
-        StartArray(); // uv layer 0
-        for (auto uv : uvs_) {
-            Write(uv.x);
-            Write(uv.y);
-        }
-        EndArray(); // uv layer 0
-        EndArray(); // uvs
+    if (opt_geometry_type_ == kBufferGeometry && index16_count_ + index32_count_ > 0) {
+        char message[128];
+        snprintf(message, sizeof message, "BufferGeometry indices: %u Uint16, %u Uint32, %u split into 16 bit parts",
+                 index16_count_, index32_count_, split_count_);
+        log.Info(message);
     }
     
-    EndObject(); // data
-    EndObject(); // geometry
+    LogTriangulation();
+    
+    if (geometry_cache_.IsOpen()) {
+        unsigned total = geometry_cache_.hits + geometry_cache_.misses;
+        
+        char message[128];
+        snprintf(message, sizeof message, "Geometry cache: %u of %u hits (%.0f%%), about %.3f s saved",
+                 geometry_cache_.hits, total, total > 0 ? 100.0 * geometry_cache_.hits / total : 0.0,
+                 geometry_cache_.seconds_saved);
+        log.Info(message);
+    }
 }
 
-void THREESceneSaver::WriteBufferGeometry()
+/*
+ * Deduplicates and encodes a batch of geometries on up to threads threads
+ * and splices them into the geometries array in scene order, so the output
+ * does not depend on the number of threads. Binary attributes are appended
+ * to the sidecar on this thread, as their offsets depend on that order.
+ * Geometries identical to an earlier one are not written again, objects
+ * reference the earlier one through GeometryUUID instead. Geometries found
+ * in the geometry cache are spliced in as they were encoded last time.
+ */
+void THREESceneSaver::EncodeGeometries(std::vector<GeometryBuffer>& batch, unsigned threads)
 {
-    StartObject(); // geometry
-    Property("uuid", ItemIdentity() + poly_tag_);
-    Property("type", "BufferGeometry");
+    PhaseTimer timer(stats_, ExportStats::kPhaseBuild);
+    
+    typedef std::chrono::steady_clock Clock;
+    auto elapsed = [](Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    };
     
-    StartObject("data");
-    StartObject("attributes");
+    bool binary = opt_geometry_binary_ && opt_geometry_type_ == kBufferGeometry;
+    bool cache = geometry_cache_.IsOpen();
     
-    // index
-    StartObject("index");
-    Property("itemSize", 1);
-    Property("type", "Uint32Array");
-    StartArray("array");
-    // traverse faces
-    poly_pass_ = kPolypassBufferGeometry;
-    WritePolys(0, true); // Enable unified polygon material mapping.
-    EndArray(); // array
-    EndObject(); // index
+    // cached geometries are stored as the fragments they are encoded into
+    bool fragments = (threads > 1 || cache) && !binary;
     
-    // positions
-    StartObject("position");
-    Property("itemSize", 3);
-    Property("type", "Float32Array");
-    StartArray("array");
-    for (auto vertex : vertices_) {
-        auto position = vertex.position();
-        Write(position.x);
-        Write(position.y);
-        Write(position.z);
-    }
-    EndArray(); // array
-    EndObject(); // position
+    bool split = opt_geometry_split_ && opt_geometry_type_ == kBufferGeometry;
+    bool optimize = opt_geometry_optimize_ && opt_geometry_type_ == kBufferGeometry;
     
-    // normals
-    if (opt_save_normals_) {
-        StartObject("normal");
-        Property("itemSize", 3);
-        Property("type", "Float32Array");
-        StartArray("array");
-        for (auto vertex : vertices_) {
-            auto normal = vertex.normal();
-            Write(normal.x);
-            Write(normal.y);
-            Write(normal.z);
+    std::vector<std::vector<GeometryBuffer>> parts(split ? batch.size() : 0);
+    std::vector<VertexCacheStats> before(optimize ? batch.size() : 0);
+    std::vector<VertexCacheStats> after(optimize ? batch.size() : 0);
+    
+    // geometries found in the cache skip everything but the splicing
+    std::vector<GeometryCache::Key> keys(cache ? batch.size() : 0);
+    std::vector<const GeometryCache::Entry*> hits(batch.size(), nullptr);
+    std::vector<double> seconds(cache ? batch.size() : 0, 0.0);
+    
+    // parts keep the optimized triangle order and add their vertices in
+    // first use order, so optimizing before splitting covers them as well
+    ParallelFor(batch.size(), threads, [&](size_t i) {
+        auto start = Clock::now();
+        
+        if (cache) {
+            keys[i] = CacheKey(batch[i]);
+            hits[i] = geometry_cache_.Find(keys[i]);
+            
+            if (hits[i]) {
+                batch[i].snapshot = GeometrySnapshot();
+                return;
+            }
+        }
+        
+        BuildGeometry(batch[i]);
+        
+        if (optimize) {
+            OptimizeGeometry(batch[i], before[i], after[i]);
+        }
+        
+        if (split && batch[i].vertices.size() > kMaxUint16Vertices) {
+            SplitGeometry(batch[i], parts[i]);
+        }
+        
+        if (cache) {
+            seconds[i] = elapsed(start);
         }
-        EndArray(); // array
-        EndObject(); // normal
+    });
+    
+    // the dedup sets of the whole batch are alive at this point
+    uint64_t dedup_bytes = 0;
+    for (auto& geometry : batch) {
+        dedup_bytes += CountDedup(geometry);
     }
+    stats_.dedup_peak_bytes = std::max(stats_.dedup_peak_bytes, dedup_bytes);
     
-    // uvs
-    if (opt_save_uvs_ && has_uvs_) {
-        StartObject("uv");
-        Property("itemSize", 2);
-        Property("type", "Float32Array");
-        StartArray("array");
-        for (auto vertex : vertices_) {
-            auto uv = vertex.uv();
-            Write(uv.x);
-            Write(uv.y);
+    if (optimize) {
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (!batch[i].indices.empty()) {
+                LogVertexCache(batch[i].uuid, before[i], after[i]);
+            }
         }
-        EndArray(); // array
-        EndObject(); // uv
     }
     
-    EndObject(); // attributes
-    EndObject(); // data
-    EndObject(); // geometry
-}
-
-void THREESceneSaver::WriteObject()
-{
-    CLxUser_Item item;
-    GetItem(item);
+    // replace split geometries by their parts and cache hits by the parts
+    // they were encoded into, keeping the order
+    size_t count = batch.size();
+    std::vector<size_t> origin; // geometry each part came from
+    std::vector<const GeometryCache::Unit*> units; // if it came from the cache
     
-    Property("uuid", ItemIdentity());
-    const char* name = ItemName();
-    if (name) {
-        Property("name", name);
+    {
+        std::vector<GeometryBuffer> geometries;
+        geometries.reserve(batch.size());
+        
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (hits[i]) {
+                if (hits[i]->parts > 0) {
+                    geometry_parts_[batch[i].uuid] = hits[i]->parts;
+                    split_count_++;
+                }
+                
+                for (auto& unit : hits[i]->units) {
+                    GeometryBuffer placeholder;
+                    placeholder.uuid = unit.uuid;
+                    
+                    geometries.push_back(std::move(placeholder));
+                    origin.push_back(i);
+                    units.push_back(&unit);
+                }
+                continue;
+            }
+            
+            if (split && !parts[i].empty()) {
+                geometry_parts_[batch[i].uuid] = static_cast<unsigned>(parts[i].size());
+                split_count_++;
+                
+                for (auto& part : parts[i]) {
+                    geometries.push_back(std::move(part));
+                    origin.push_back(i);
+                    units.push_back(nullptr);
+                }
+                continue;
+            }
+            
+            geometries.push_back(std::move(batch[i]));
+            origin.push_back(i);
+            units.push_back(nullptr);
+        }
+        
+        batch.swap(geometries);
     }
     
-    LXtMatrix4 transform = {
-        { 1, 0, 0, 0 },
-        { 0, 1, 0, 0 },
-        { 0, 0, 1, 0 },
-        { 0, 0, 0, 1 },
+    auto index_bits = [this](const GeometryBuffer& geometry) -> unsigned {
+        if (opt_geometry_type_ != kBufferGeometry || geometry.indices.empty()) {
+            return 0;
+        }
+        return geometry.vertices.size() <= kMaxUint16Vertices ? 16 : 32;
     };
     
-    CLxLoc_Locator locator;
-    if (locator.set(item)) {
-        locator.LocalTransform4(chan_xform_, transform);
-    }
-    
-    StartArray("matrix");
-    for (unsigned col = 0; col < 4; ++col) {
-        for (unsigned row = 0; row < 4; ++row) {
-            Write(transform[col][row]);
+    for (size_t i = 0; i < batch.size(); ++i) {
+        unsigned bits = units[i] ? units[i]->index_bits : index_bits(batch[i]);
+        
+        if (bits == 16) {
+            index16_count_++;
+        } else if (bits == 32) {
+            index32_count_++;
         }
     }
-    EndArray();
     
-    // poly tag -> item tag
-    std::map<std::string, std::string> materials;
-    auto iter = material_map_.find(ItemIdentity());
-    if (iter != material_map_.end()) {
-        for (auto it = iter->second.begin(); it != iter->second.end(); it++) {
-            materials[it->second] = it->first;
-        }
-    }
+    std::vector<GeometryHash> hashes(batch.size());
+    std::vector<double> part_seconds(cache ? batch.size() : 0, 0.0);
     
-    if (ItemIsA(LXsITYPE_SCENE)) {
-        Property("type", "Scene");
-    } else if (ItemIsA(LXsITYPE_MESH) || ItemIsA(LXsITYPE_MESHINST)) {
-        if (ItemIsA(LXsITYPE_MESHINST)) {
-            CLxUser_Item source;
-            scene_service_.GetMeshInstSourceItem((ILxUnknownID)item, source);
-            SetItem(source);
+    bool quantize = opt_quantize_enabled_ && opt_geometry_type_ == kBufferGeometry;
+    
+    ParallelFor(batch.size(), threads, [&](size_t i) {
+        if (units[i]) {
+            hashes[i] = units[i]->hash;
+            return;
         }
         
-        poly_pass_ = kPolypassMaterial;
-        WritePolys(0, false);
+        auto start = Clock::now();
+        GeometryBuffer& geometry = batch[i];
         
-        if (poly_tags_.size() == 1) {
-            Property("type", "Mesh");
-            Property("geometry", ItemIdentity() + *poly_tags_.begin());
-            Property("material", materials.begin()->second + '.' + materials.begin()->first);
+        if (opt_geometry_type_ == kBufferGeometry) {
+            geometry.bounds = ComputeBounds(geometry.vertices);
+        } else {
+            geometry.bounds = ComputeBounds(geometry.positions);
         }
-    } else if (ItemIsA(LXsITYPE_GROUPLOCATOR)) {
-        Property("type", "Group");
-    } else if (ItemIsA(LXsITYPE_LOCATOR)) {
-        // don't set type for locator/null mesh
-    }
+        
+        if (quantize) {
+            QuantizeGeometry(geometry);
+        }
+        
+        if (opt_geometry_share_) {
+            hashes[i] = HashGeometry(geometry);
+        }
+        
+        if (cache) {
+            part_seconds[i] = elapsed(start);
+        }
+    });
     
-    // TODO:
-    //    PerspectiveCamera
-    //    OrthographicCamera
-    //    AmbientLight
-    //    DirectionalLight
-    //    PointLight
-    //    SpotLight
-    //    HemisphereLight
-    //    Line
-    //    Sprite
+    // decide in scene order which geometry of some content comes first
+    std::vector<SharedGeometry*> shared(batch.size(), nullptr);
+    std::vector<bool> skip(batch.size(), false);
     
-    if (!ItemVisible()) {
-        Property("visible", false);
+    if (opt_geometry_share_) {
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (batch[i].indices.empty() && !units[i]) {
+                continue;
+            }
+            
+            auto inserted = shared_geometries_.insert(std::make_pair(hashes[i], SharedGeometry()));
+            shared[i] = &inserted.first->second;
+            
+            if (inserted.second) {
+                shared[i]->uuid = batch[i].uuid;
+            } else {
+                shared[i]->copies++;
+                geometry_alias_[batch[i].uuid] = shared[i]->uuid;
+                skip[i] = true;
+            }
+        }
+    }
+    
+    PhaseTimer encode_timer(stats_, ExportStats::kPhaseEncode);
+    
+    std::vector<JSONFormat> encoded(fragments ? batch.size() : 0);
+    
+    if (fragments) {
+        ParallelFor(batch.size(), threads, [&](size_t i) {
+            if (!skip[i] && !units[i]) {
+                auto start = Clock::now();
+                
+                encoded[i].StartFragment(*this);
+                EncodeGeometry(encoded[i], batch[i]);
+                
+                if (cache) {
+                    part_seconds[i] += elapsed(start);
+                }
+            }
+        });
+    }
+    
+    // the next cache gets an entry for each geometry whose parts are all
+    // encoded, cached ones are carried over even if they are not written
+    std::vector<GeometryCache::Entry> entries(cache ? count : 0);
+    std::vector<bool> complete(cache ? count : 0, true);
+    std::string bytes;
+    
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const GeometryCache::Unit* unit = units[i];
+        
+        if (unit && !geometry_cache_.Read(*unit, bytes)) {
+            log.Error("could not read the geometry cache");
+            throw std::runtime_error("geometry cache");
+        }
+        
+        if (cache && (unit || (!skip[i] && !batch[i].indices.empty()))) {
+            GeometryCache::Unit next;
+            
+            if (unit) {
+                next = *unit;
+                next.position = geometry_cache_.Append(bytes.data(), bytes.size());
+            } else {
+                next.uuid = batch[i].uuid;
+                next.hash = hashes[i];
+                next.index_bits = index_bits(batch[i]);
+                next.quantized = batch[i].quantize_positions;
+                std::copy(batch[i].position_offset, batch[i].position_offset + 3, next.offset);
+                next.scale = batch[i].position_scale;
+                next.length = encoded[i].FragmentSize();
+                next.position = geometry_cache_.Append(encoded[i].FragmentData(), encoded[i].FragmentSize());
+                
+                entries[origin[i]].seconds += part_seconds[i];
+            }
+            
+            entries[origin[i]].units.push_back(next);
+        } else if (cache) {
+            complete[origin[i]] = false;
+        }
+        
+        if (!skip[i]) {
+            uint64_t start = Tell() + buffer_file_.Tell();
+            
+            bool quantized = unit ? unit->quantized : batch[i].quantize_positions;
+            if (quantized) {
+                Dequantization& dequantization = geometry_dequantization_[batch[i].uuid];
+                const double* offset = unit ? unit->offset : batch[i].position_offset;
+                std::copy(offset, offset + 3, dequantization.offset);
+                dequantization.scale = unit ? unit->scale : batch[i].position_scale;
+            }
+            
+            if (unit) {
+                WriteFragment(bytes.data(), bytes.size());
+            } else if (fragments) {
+                WriteFragment(encoded[i]);
+                encoded[i].ff_Cleanup();
+            } else {
+                EncodeGeometry(*this, batch[i]);
+            }
+            
+            if (shared[i]) {
+                shared[i]->bytes = Tell() + buffer_file_.Tell() - start;
+            }
+        }
+        
+        batch[i] = GeometryBuffer();
+    }
+    
+    for (size_t i = 0; i < count && cache; ++i) {
+        if (hits[i]) {
+            entries[i].seconds = hits[i]->seconds;
+            entries[i].parts = hits[i]->parts;
+            
+            geometry_cache_.hits++;
+            geometry_cache_.seconds_saved += hits[i]->seconds;
+        } else {
+            entries[i].seconds += seconds[i];
+            entries[i].parts = split ? static_cast<unsigned>(parts[i].size()) : 0;
+            
+            geometry_cache_.misses++;
+        }
+        
+        if (complete[i] && !entries[i].units.empty()) {
+            geometry_cache_.Add(keys[i], entries[i]);
+        }
+    }
+}
+
+/*
+ * Reorders the triangles of a built BufferGeometry for the post-transform
+ * vertex cache, then renumbers its vertices in the order they are first
+ * used, so they are fetched from memory mostly sequentially as well.
+ */
+void THREESceneSaver::OptimizeGeometry(GeometryBuffer& geometry, VertexCacheStats& before,
+                                       VertexCacheStats& after) const
+{
+    if (geometry.indices.empty()) {
+        return;
+    }
+    
+    before = AnalyzeVertexCache(geometry.indices, geometry.vertices.size());
+    
+    OptimizeVertexCache(geometry.indices, geometry.vertices.size());
+    
+    VertexSet vertices(geometry.vertices.layout());
+    vertices.reserve(geometry.vertices.size());
+    for (auto& index : geometry.indices) {
+        index = vertices.insert(geometry.vertices[index]);
+    }
+    geometry.vertices = std::move(vertices);
+    
+    after = AnalyzeVertexCache(geometry.indices, geometry.vertices.size());
+}
+
+void THREESceneSaver::LogVertexCache(const std::string& uuid, const VertexCacheStats& before,
+                                     const VertexCacheStats& after)
+{
+    char message[256];
+    snprintf(message, sizeof message, "%s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f",
+             uuid.c_str(), before.acmr, after.acmr, before.atvr, after.atvr);
+    log.Info(message);
+}
+
+/*
+ * Decides which attributes of a built BufferGeometry are written as
+ * normalized integers. Positions are quantized to 16 bits within a cube
+ * around their bounding box, a uniform scale keeps the normals valid, and
+ * only if half a step stays within threeio.quantize.error. UVs only if
+ * they all fit in [0, 1].
+ */
+void THREESceneSaver::QuantizeGeometry(GeometryBuffer& geometry) const
+{
+    const Bounds& bounds = geometry.bounds;
+    if (bounds.empty) {
+        return;
+    }
+    
+    bool unit_uvs = true;
+    for (const auto& vertex : geometry.vertices) {
+        auto uv = vertex.uv();
+        if (uv.x < 0 || uv.x > 1 || uv.y < 0 || uv.y > 1) {
+            unit_uvs = false;
+            break;
+        }
+    }
+    
+    double scale = 0;
+    for (unsigned i = 0; i < 3; ++i) {
+        geometry.position_offset[i] = (bounds.min[i] + bounds.max[i]) / 2;
+        scale = std::max(scale, (bounds.max[i] - bounds.min[i]) / 2);
+    }
+    
+    // all positions are the same
+    if (scale == 0) {
+        scale = 1;
+    }
+    
+    geometry.position_scale = scale;
+    geometry.quantize_positions = scale / kMaxInt16 / 2 <= opt_quantize_error_;
+    geometry.quantize_normals = opt_save_normals_;
+    geometry.quantize_uvs = opt_save_uvs_ && geometry.has_uvs && unit_uvs;
+}
+
+// Folds the scale and offset of a geometry's quantized positions into the
+// matrix of the object using it. Returns false if they are not quantized.
+bool THREESceneSaver::FoldDequantization(const std::string& uuid, LXtMatrix4 transform) const
+{
+    auto iter = geometry_dequantization_.find(GeometryUUID(uuid));
+    if (iter == geometry_dequantization_.end()) {
+        return false;
+    }
+    
+    const Dequantization& dequantization = iter->second;
+    
+    // transform * translate(offset) * scale(scale), WebGL reads the
+    // normalized values back in [-1, 1]; the rows of transform are the
+    // columns of the three.js matrix
+    for (unsigned row = 0; row < 4; ++row) {
+        for (unsigned col = 0; col < 3; ++col) {
+            transform[3][row] += transform[col][row] * dequantization.offset[col];
+        }
+        
+        for (unsigned col = 0; col < 3; ++col) {
+            transform[col][row] *= dequantization.scale;
+        }
+    }
+    
+    return true;
+}
+
+void THREESceneSaver::LogTriangulation()
+{
+    if (triangulated_polygons_ == 0) {
+        return;
+    }
+    
+    char message[128];
+    snprintf(message, sizeof message, "%u polygons triangulated into %u triangles",
+             triangulated_polygons_, generated_triangles_);
+    log.Info(message);
+}
+
+/*
+ * Splits a built BufferGeometry into parts with 16 bit indices. Triangles
+ * are taken in order, a part is closed once the next triangle could take
+ * it past kMaxUint16Vertices. Vertices used by several parts are copied.
+ */
+void THREESceneSaver::SplitGeometry(const GeometryBuffer& geometry, std::vector<GeometryBuffer>& parts) const
+{
+    const auto& indices = geometry.indices;
+    GeometryBuffer* part = nullptr;
+    
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        if (!part || part->vertices.size() + 3 > kMaxUint16Vertices) {
+            parts.push_back(GeometryBuffer());
+            part = &parts.back();
+            part->uuid = PartUUID(geometry.uuid, static_cast<unsigned>(parts.size() - 1));
+            part->has_uvs = geometry.has_uvs;
+            part->vertices = VertexSet(geometry.vertices.layout());
+            part->vertices.reserve(kMaxUint16Vertices);
+        }
+        
+        for (unsigned k = 0; k < 3; ++k) {
+            part->indices.push_back(part->vertices.insert(geometry.vertices[indices[i + k]]));
+        }
+    }
+}
+
+// uuid of a part of a split geometry
+std::string THREESceneSaver::PartUUID(const std::string& uuid, unsigned part)
+{
+    return uuid + "#" + std::to_string(part);
+}
+
+// Number of parts the geometry of a mesh and poly tag was split into, 1 if
+// it was not split.
+unsigned THREESceneSaver::GeometryParts(const std::string& uuid) const
+{
+    auto parts = geometry_parts_.find(uuid);
+    if (parts != geometry_parts_.end()) {
+        return parts->second;
+    }
+    
+    return 1;
+}
+
+/*
+ * Hashes everything of a built geometry that ends up in the file, except
+ * for its uuid. Two differently seeded 64 bit hashes are combined, so that
+ * sharing geometries by hash does not need to keep their data around.
+ */
+THREESceneSaver::GeometryHash THREESceneSaver::HashGeometry(const GeometryBuffer& geometry) const
+{
+    GeometryHash hash(0, 0x6a09e667f3bcc908ULL);
+    
+    auto add = [&hash](uint64_t v) {
+        hash.first = HashCombine(hash.first, v);
+        hash.second = HashCombine(hash.second, v);
+    };
+    
+    add(geometry.has_uvs);
+    
+    add(geometry.indices.size());
+    for (unsigned index : geometry.indices) {
+        add(index);
+    }
+    
+    add(geometry.vertices.size());
+    for (const Vertex& vertex : geometry.vertices) {
+        add(vertex.hash());
+    }
+    
+    add(geometry.positions.size());
+    for (const Vector3& position : geometry.positions) {
+        add(position.hash());
+    }
+    
+    add(geometry.normals.size());
+    for (const Vector3& normal : geometry.normals) {
+        add(normal.hash());
+    }
+    
+    add(geometry.uvs.size());
+    for (const Vector2& uv : geometry.uvs) {
+        add(uv.hash());
+    }
+    
+    return hash;
+}
+
+/*
+ * Caches the encoded geometries of THREE JSON exports with inline
+ * attributes, binary ones change their offsets into the sidecar with every
+ * save. The cache is used by the next save with the same options.
+ */
+void THREESceneSaver::OpenGeometryCache()
+{
+    if (!opt_geometry_cache_ || opt_geometry_binary_ || !ReallySaving()) {
+        return;
+    }
+    
+    if (!geometry_cache_.Open(filename_ + ".cache", CacheOptions())) {
+        log.Error("could not open the geometry cache, saving without");
+        geometry_cache_.Close(false);
+    }
+}
+
+// everything but the polygons that the encoded geometries depend on
+uint64_t THREESceneSaver::CacheOptions() const
+{
+    uint64_t hash = HashCombine(0, opt_save_normals_);
+    hash = HashCombine(hash, opt_save_uvs_);
+    hash = HashCombine(hash, opt_geometry_type_);
+    hash = HashCombine(hash, opt_geometry_interleaved_);
+    hash = HashCombine(hash, opt_geometry_share_);
+    hash = HashCombine(hash, opt_geometry_split_);
+    hash = HashCombine(hash, opt_geometry_optimize_);
+    hash = HashCombine(hash, opt_quantize_enabled_);
+    
+    WeldTolerance weld = Weld();
+    hash = HashCombine(hash, HashBits(weld.position));
+    hash = HashCombine(hash, HashBits(weld.normal));
+    hash = HashCombine(hash, HashBits(weld.uv));
+    
+    hash = HashCombine(hash, HashBits(opt_quantize_error_));
+    hash = HashCombine(hash, fixed());
+    hash = HashCombine(hash, precision());
+    hash = HashCombine(hash, float32());
+    hash = HashCombine(hash, pretty());
+    
+    return hash;
+}
+
+// identity and polygon data of a geometry, as recorded in its snapshot
+GeometryCache::Key THREESceneSaver::CacheKey(const GeometryBuffer& geometry) const
+{
+    GeometryCache::Key hash(0, 0x6a09e667f3bcc908ULL);
+    
+    auto add = [&hash](uint64_t v) {
+        hash.first = HashCombine(hash.first, v);
+        hash.second = HashCombine(hash.second, v);
+    };
+    
+    const GeometrySnapshot& snapshot = geometry.snapshot;
+    
+    add(geometry.uuid.size());
+    for (char c : geometry.uuid) {
+        add(static_cast<unsigned char>(c));
+    }
+    
+    add(geometry.has_uvs);
+    
+    add(snapshot.masks.size());
+    for (unsigned mask : snapshot.masks) {
+        add(mask);
+    }
+    
+    add(snapshot.vertices.size());
+    for (const Vertex& vertex : snapshot.vertices) {
+        add(vertex.hash());
+    }
+    
+    add(snapshot.positions.size());
+    for (const Vector3& position : snapshot.positions) {
+        add(position.hash());
+    }
+    
+    add(snapshot.normals.size());
+    for (const Vector3& normal : snapshot.normals) {
+        add(normal.hash());
+    }
+    
+    add(snapshot.uvs.size());
+    for (const Vector2& uv : snapshot.uvs) {
+        add(uv.hash());
+    }
+    
+    return hash;
+}
+
+// uuid to reference the geometry of a mesh and poly tag by
+std::string THREESceneSaver::GeometryUUID(const std::string& uuid) const
+{
+    auto alias = geometry_alias_.find(uuid);
+    if (alias != geometry_alias_.end()) {
+        return alias->second;
+    }
+    
+    return uuid;
+}
+
+/*
+ * Traverses the faces of the current mesh once, bucketing them by material
+ * tag into geometries_, and deduplicates their points.
+ */
+void THREESceneSaver::ScanGeometry()
+{
+    SnapshotGeometry();
+    
+    PhaseTimer timer(stats_, ExportStats::kPhaseBuild);
+    
+    uint64_t dedup_bytes = 0;
+    for (auto it = geometries_.begin(); it != geometries_.end(); it++) {
+        BuildGeometry(it->second);
+        dedup_bytes += CountDedup(it->second);
+    }
+    stats_.dedup_peak_bytes = std::max(stats_.dedup_peak_bytes, dedup_bytes);
+}
+
+/*
+ * Adds the dedup hits and misses of a built geometry to the stats, and
+ * returns the memory held by its dedup sets.
+ */
+uint64_t THREESceneSaver::CountDedup(const GeometryBuffer& geometry)
+{
+    uint64_t entries = geometry.dedup_entries();
+    
+    stats_.dedup_misses += entries;
+    stats_.dedup_hits += geometry.dedup_inserts - entries;
+    stats_.dedup_welded += geometry.dedup_welded;
+    
+    stats_.dedup_peak_entries = std::max<uint64_t>(stats_.dedup_peak_entries, geometry.positions.size());
+    stats_.dedup_peak_entries = std::max<uint64_t>(stats_.dedup_peak_entries, geometry.normals.size());
+    stats_.dedup_peak_entries = std::max<uint64_t>(stats_.dedup_peak_entries, geometry.uvs.size());
+    stats_.dedup_peak_entries = std::max<uint64_t>(stats_.dedup_peak_entries, geometry.vertices.size());
+    
+    return geometry.dedup_bytes;
+}
+
+/*
+ * Traverses the faces of the current mesh once, recording them by material
+ * tag into the snapshots of geometries_.
+ */
+void THREESceneSaver::SnapshotGeometry()
+{
+    current_mesh_ = &GetMeshInfo();
+    
+    // select uv map
+    if (opt_save_uvs_ && !current_mesh_->uv_map.empty()) {
+        has_uvs_ = SetMap(LXi_VMAP_TEXTUREUV, current_mesh_->uv_map.c_str());
+    }
+    
+    // traverse faces once, bucketing them by material tag
+    if (opt_geometry_type_ == kGeometry) {
+        poly_pass_ = kPolypassGeometry;
+    } else {
+        poly_pass_ = kPolypassBufferGeometry;
+    }
+    
+    {
+        PhaseTimer timer(stats_, ExportStats::kPhasePolygons);
+        tag_geometries_.assign(names_.size(), nullptr);
+        tag_string_ = nullptr;
+        WritePolys(0, true); // Enable unified polygon material mapping.
+    }
+    
+    tag_geometries_.clear();
+    current_mesh_ = nullptr;
+}
+
+/*
+ * Metadata of the current mesh item. The mesh is swept once per save on
+ * first use, later calls by the material, geometry and object writers are
+ * served from mesh_info_.
+ */
+const THREESceneSaver::MeshInfo& THREESceneSaver::GetMeshInfo()
+{
+    std::string identity = ItemIdentity();
+    
+    auto cached = mesh_info_.find(identity);
+    if (cached != mesh_info_.end()) {
+        return cached->second;
+    }
+    
+    PhaseTimer timer(stats_, ExportStats::kPhaseMeshInfo);
+    
+    MeshInfo& info = mesh_info_[identity];
+    scan_info_ = &info;
+    
+    // bounding box
+    info.points = PointCount();
+    if (info.points > 0) {
+        WritePoints();
+    }
+    
+    // polygon count per material tag
+    poly_pass_ = kPolypassMaterial;
+    poly_count_ = nullptr;
+    tag_string_ = nullptr;
+    poly_counts_.assign(names_.size(), 0);
+    WritePolys(0, false);
+    
+    for (StringInterner::ID tag = 0; tag < poly_counts_.size(); ++tag) {
+        if (poly_counts_[tag] > 0) {
+            info.tags[names_.Name(tag)] = poly_counts_[tag];
+        }
+    }
+    
+    // select the first uv map
+    // TODO: export all uvs?
+    CLxUser_Mesh user_mesh;
+    CLxUser_MeshMap mesh_map;
+    
+    if (ChanObject(LXsICHAN_MESH_MESH, user_mesh)) {
+        user_mesh.GetMaps(mesh_map);
+        
+        mesh_map.FilterByType(LXi_VMAP_TEXTUREUV);
+        MeshMapVisitor visitor(&mesh_map);
+        mesh_map.Enum(&visitor);
+        
+        if (visitor.names().size() > 0) {
+            info.uv_map = *visitor.names().begin();
+        }
+    }
+    
+    scan_info_ = nullptr;
+    poly_count_ = nullptr;
+    poly_tag_ = StringInterner::kEmpty;
+    
+    return info;
+}
+
+// attributes the packed vertex records of a BufferGeometry hold
+unsigned THREESceneSaver::LayoutOf(bool has_uvs) const
+{
+    return ((opt_save_normals_ ? kVertexNormals : 0) |
+            (opt_save_uvs_ && has_uvs ? kVertexUVs : 0));
+}
+
+// tolerances BuildGeometry welds with, all 0 if welding is off
+WeldTolerance THREESceneSaver::Weld() const
+{
+    WeldTolerance weld;
+    
+    if (opt_weld_enabled_) {
+        weld.position = std::max(opt_weld_position_, 0.0);
+        weld.normal = std::max(opt_weld_normal_, 0.0);
+        weld.uv = std::max(opt_weld_uv_, 0.0);
+    }
+    
+    return weld;
+}
+
+/*
+ * Replays the snapshot of a geometry into its deduplicated attributes and
+ * indices, and releases the snapshot. Does not touch the SDK or any saver
+ * state, so geometries can be built concurrently. With welding, values
+ * within tolerance of an earlier one are merged into it, found through a
+ * spatial hash grid per dedup set.
+ */
+void THREESceneSaver::BuildGeometry(GeometryBuffer& geometry) const
+{
+    const GeometrySnapshot& snapshot = geometry.snapshot;
+    auto& indices = geometry.indices;
+    
+    const WeldTolerance weld = Weld();
+    
+    if (!snapshot.vertices.empty()) {
+        geometry.vertices.reserve(snapshot.points);
+        indices.reserve(snapshot.vertices.size());
+        
+        if (weld.enabled()) {
+            WeldGrid grid(weld.position);
+            grid.reserve(snapshot.points);
+            
+            auto close = [&weld](const Vertex& a, const Vertex& b) {
+                return (WeldPositions(a.position(), b.position(), weld.position) &&
+                        WeldNormals(a.normal(), b.normal(), weld.normal) &&
+                        WeldUVs(a.uv(), b.uv(), weld.uv));
+            };
+            
+            for (const Vertex& vertex : snapshot.vertices) {
+                const Vector3 position = vertex.position();
+                const double point[3] = { position.x, position.y, position.z };
+                indices.push_back(grid.insert(geometry.vertices, vertex, point, close));
+            }
+            
+            geometry.dedup_welded = grid.welded();
+        } else {
+            geometry.vertices.insert(snapshot.vertices, indices);
+        }
+        
+        geometry.dedup_inserts = snapshot.vertices.size();
+    } else if (!snapshot.masks.empty()) {
+        geometry.positions.reserve(snapshot.points);
+        indices.reserve(snapshot.masks.size() + snapshot.positions.size() +
+                        snapshot.normals.size() + snapshot.uvs.size());
+        
+        WeldGrid position_grid(weld.position);
+        WeldGrid normal_grid(WeldNormalDistance(weld.normal));
+        WeldGrid uv_grid(weld.uv, 2);
+        
+        auto close_positions = [&weld](const Vector3& a, const Vector3& b) {
+            return WeldPositions(a, b, weld.position);
+        };
+        auto close_normals = [&weld](const Vector3& a, const Vector3& b) {
+            return WeldNormals(a, b, weld.normal);
+        };
+        auto close_uvs = [&weld](const Vector2& a, const Vector2& b) {
+            return WeldUVs(a, b, weld.uv);
+        };
+        
+        auto insert_position = [&](const Vector3& position) {
+            if (weld.position <= 0) {
+                return geometry.positions.insert(position);
+            }
+            
+            const double point[3] = { position.x, position.y, position.z };
+            return position_grid.insert(geometry.positions, position, point, close_positions);
+        };
+        auto insert_normal = [&](const Vector3& normal) {
+            if (weld.normal <= 0) {
+                return geometry.normals.insert(normal);
+            }
+            
+            const double point[3] = { normal.x, normal.y, normal.z };
+            return normal_grid.insert(geometry.normals, normal, point, close_normals);
+        };
+        auto insert_uv = [&](const Vector2& uv) {
+            if (weld.uv <= 0) {
+                return geometry.uvs.insert(uv);
+            }
+            
+            const double point[3] = { uv.x, uv.y, 0 };
+            return uv_grid.insert(geometry.uvs, uv, point, close_uvs);
+        };
+        
+        auto position = snapshot.positions.begin();
+        auto normal = snapshot.normals.begin();
+        auto uv = snapshot.uvs.begin();
+        
+        for (unsigned mask : snapshot.masks) {
+            unsigned num_vert = (mask & kQuad) ? 4 : 3;
+            
+            indices.push_back(mask);
+            
+            for (unsigned i = 0; i < num_vert; i++) {
+                indices.push_back(insert_position(*position++));
+            }
+            
+            if (mask & kFaceVertexUv) {
+                for (unsigned i = 0; i < num_vert; i++) {
+                    indices.push_back(insert_uv(*uv++));
+                }
+            }
+            
+            if (mask & kFaceNormal) {
+                indices.push_back(insert_normal(*normal++));
+            }
+            
+            if (mask & kFaceVertexNormal) {
+                for (unsigned i = 0; i < num_vert; i++) {
+                    indices.push_back(insert_normal(*normal++));
+                }
+            }
+        }
+        
+        geometry.dedup_inserts = indices.size() - snapshot.masks.size();
+        geometry.dedup_welded = position_grid.welded() + normal_grid.welded() + uv_grid.welded();
+    }
+    
+    geometry.dedup_bytes = (geometry.positions.bytes() + geometry.normals.bytes() +
+                            geometry.uvs.bytes() + geometry.vertices.bytes());
+    geometry.snapshot = GeometrySnapshot();
+}
+
+void THREESceneSaver::EncodeGeometry(JSONFormat& json, const GeometryBuffer& geometry)
+{
+    if (opt_geometry_type_ == kGeometry) {
+        WriteGeometry(json, geometry);
+    } else {
+        WriteBufferGeometry(json, geometry);
+    }
+}
+
+void THREESceneSaver::WriteGeometry(JSONFormat& json, const GeometryBuffer& geometry)
+{
+    json.StartObject();
+    json.Property("uuid", geometry.uuid);
+    json.Property("type", "Geometry");
+    
+    json.StartObject("data");
+    
+    // faces
+    json.StartArray("faces");
+    json.WriteValues(geometry.indices.data(), geometry.indices.size());
+    json.EndArray();
+    
+    // vertices
+    json.StartArray("vertices");
+    for (auto position : geometry.positions) {
+        json.Write(position.x);
+        json.Write(position.y);
+        json.Write(position.z);
+    }
+    json.EndArray();
+    
+    // normals
+    if (opt_save_normals_) {
+        json.StartArray("normals");
+        for (auto normal : geometry.normals) {
+            json.Write(normal.x);
+            json.Write(normal.y);
+            json.Write(normal.z);
+        }
+        json.EndArray(); // normals
+    }
+    
+    if (opt_save_uvs_ && geometry.has_uvs) {
+        json.StartArray("uvs");
+        json.StartArray(); // uv layer 0
+        for (auto uv : geometry.uvs) {
+            json.Write(uv.x);
+            json.Write(uv.y);
+        }
+        json.EndArray(); // uv layer 0
+        json.EndArray(); // uvs
+    }
+    
+    WriteBounds(json, geometry);
+    
+    json.EndObject(); // data
+    json.EndObject(); // geometry
+}
+
+void THREESceneSaver::WriteBufferGeometry(JSONFormat& json, const GeometryBuffer& geometry)
+{
+    json.StartObject(); // geometry
+    json.Property("uuid", geometry.uuid);
+    json.Property("type", "BufferGeometry");
+    
+    json.StartObject("data");
+    
+    // a single typed array can only hold attributes of the same type
+    bool interleaved = (opt_geometry_interleaved_ && !geometry.quantize_positions &&
+                        !geometry.quantize_normals && !geometry.quantize_uvs);
+    
+    // loaders that know interleaved buffers take the index from data.index,
+    // older ones expect it among the attributes
+    if (interleaved) {
+        WriteInterleavedBuffer(json, geometry);
+        WriteIndex(json, geometry);
+    }
+    
+    json.StartObject("attributes");
+    
+    if (interleaved) {
+        WriteInterleavedAttributes(json, geometry);
+    } else {
+        WriteIndex(json, geometry);
+        WriteAttributes(json, geometry);
+    }
+    
+    json.EndObject(); // attributes
+    
+    WriteBounds(json, geometry);
+    
+    json.EndObject(); // data
+    json.EndObject(); // geometry
+}
+
+// index, 16 bit whenever the vertex count allows it
+void THREESceneSaver::WriteIndex(JSONFormat& json, const GeometryBuffer& geometry)
+{
+    bool is_short = geometry.vertices.size() <= kMaxUint16Vertices;
+    
+    json.StartObject("index");
+    json.Property("itemSize", 1);
+    json.Property("type", is_short ? "Uint16Array" : "Uint32Array");
+    if (opt_geometry_binary_) {
+        auto offset = StartBuffer();
+        if (buffer_file_.IsOpen()) {
+            if (is_short) {
+                for (unsigned index : geometry.indices) {
+                    buffer_file_.WriteUint16((uint16_t)index);
+                }
+            } else {
+                for (unsigned index : geometry.indices) {
+                    buffer_file_.WriteUint32(index);
+                }
+            }
+        }
+        EndBuffer(json, offset);
+    } else {
+        json.StartArray("array");
+        json.WriteValues(geometry.indices.data(), geometry.indices.size());
+        json.EndArray(); // array
+    }
+    json.EndObject(); // index
+}
+
+// position, normal and uv attributes, each in its own typed array
+void THREESceneSaver::WriteAttributes(JSONFormat& json, const GeometryBuffer& geometry)
+{
+    // positions
+    json.StartObject("position");
+    json.Property("itemSize", 3);
+    if (geometry.quantize_positions) {
+        // the objects using the geometry scale them back, see
+        // FoldDequantization
+        const double* center = geometry.position_offset;
+        double scale = geometry.position_scale;
+        
+        json.Property("type", "Int16Array");
+        json.Property("normalized", true);
+        if (opt_geometry_binary_) {
+            auto offset = StartBuffer();
+            if (buffer_file_.IsOpen()) {
+                for (auto vertex : geometry.vertices) {
+                    auto position = vertex.position();
+                    buffer_file_.WriteInt16(QuantizePosition(position.x, center[0], scale));
+                    buffer_file_.WriteInt16(QuantizePosition(position.y, center[1], scale));
+                    buffer_file_.WriteInt16(QuantizePosition(position.z, center[2], scale));
+                }
+            }
+            EndBuffer(json, offset);
+        } else {
+            json.StartArray("array");
+            for (auto vertex : geometry.vertices) {
+                auto position = vertex.position();
+                json.Write((int)QuantizePosition(position.x, center[0], scale));
+                json.Write((int)QuantizePosition(position.y, center[1], scale));
+                json.Write((int)QuantizePosition(position.z, center[2], scale));
+            }
+            json.EndArray(); // array
+        }
+    } else {
+        json.Property("type", "Float32Array");
+        if (opt_geometry_binary_) {
+            auto offset = StartBuffer();
+            if (buffer_file_.IsOpen()) {
+                for (auto vertex : geometry.vertices) {
+                    auto position = vertex.position();
+                    buffer_file_.WriteFloat32(position.x);
+                    buffer_file_.WriteFloat32(position.y);
+                    buffer_file_.WriteFloat32(position.z);
+                }
+            }
+            EndBuffer(json, offset);
+        } else {
+            json.StartArray("array");
+            for (auto vertex : geometry.vertices) {
+                auto position = vertex.position();
+                json.Write((float)position.x);
+                json.Write((float)position.y);
+                json.Write((float)position.z);
+            }
+            json.EndArray(); // array
+        }
+    }
+    json.EndObject(); // position
+    
+    // normals
+    if (opt_save_normals_) {
+        json.StartObject("normal");
+        json.Property("itemSize", 3);
+        if (geometry.quantize_normals) {
+            json.Property("type", "Int8Array");
+            json.Property("normalized", true);
+            if (opt_geometry_binary_) {
+                auto offset = StartBuffer();
+                if (buffer_file_.IsOpen()) {
+                    for (auto vertex : geometry.vertices) {
+                        auto normal = vertex.normal();
+                        double length = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+                        buffer_file_.WriteInt8(QuantizeNormal(normal.x, length));
+                        buffer_file_.WriteInt8(QuantizeNormal(normal.y, length));
+                        buffer_file_.WriteInt8(QuantizeNormal(normal.z, length));
+                    }
+                }
+                EndBuffer(json, offset);
+            } else {
+                json.StartArray("array");
+                for (auto vertex : geometry.vertices) {
+                    auto normal = vertex.normal();
+                    double length = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+                    json.Write((int)QuantizeNormal(normal.x, length));
+                    json.Write((int)QuantizeNormal(normal.y, length));
+                    json.Write((int)QuantizeNormal(normal.z, length));
+                }
+                json.EndArray(); // array
+            }
+        } else {
+            json.Property("type", "Float32Array");
+            if (opt_geometry_binary_) {
+                auto offset = StartBuffer();
+                if (buffer_file_.IsOpen()) {
+                    for (auto vertex : geometry.vertices) {
+                        auto normal = vertex.normal();
+                        buffer_file_.WriteFloat32(normal.x);
+                        buffer_file_.WriteFloat32(normal.y);
+                        buffer_file_.WriteFloat32(normal.z);
+                    }
+                }
+                EndBuffer(json, offset);
+            } else {
+                json.StartArray("array");
+                for (auto vertex : geometry.vertices) {
+                    auto normal = vertex.normal();
+                    json.Write((float)normal.x);
+                    json.Write((float)normal.y);
+                    json.Write((float)normal.z);
+                }
+                json.EndArray(); // array
+            }
+        }
+        json.EndObject(); // normal
+    }
+    
+    // uvs
+    if (opt_save_uvs_ && geometry.has_uvs) {
+        json.StartObject("uv");
+        json.Property("itemSize", 2);
+        if (geometry.quantize_uvs) {
+            json.Property("type", "Uint16Array");
+            json.Property("normalized", true);
+            if (opt_geometry_binary_) {
+                auto offset = StartBuffer();
+                if (buffer_file_.IsOpen()) {
+                    for (auto vertex : geometry.vertices) {
+                        auto uv = vertex.uv();
+                        buffer_file_.WriteUint16(QuantizeUV(uv.x));
+                        buffer_file_.WriteUint16(QuantizeUV(uv.y));
+                    }
+                }
+                EndBuffer(json, offset);
+            } else {
+                json.StartArray("array");
+                for (auto vertex : geometry.vertices) {
+                    auto uv = vertex.uv();
+                    json.Write((unsigned)QuantizeUV(uv.x));
+                    json.Write((unsigned)QuantizeUV(uv.y));
+                }
+                json.EndArray(); // array
+            }
+        } else {
+            json.Property("type", "Float32Array");
+            if (opt_geometry_binary_) {
+                auto offset = StartBuffer();
+                if (buffer_file_.IsOpen()) {
+                    for (auto vertex : geometry.vertices) {
+                        auto uv = vertex.uv();
+                        buffer_file_.WriteFloat32(uv.x);
+                        buffer_file_.WriteFloat32(uv.y);
+                    }
+                }
+                EndBuffer(json, offset);
+            } else {
+                json.StartArray("array");
+                for (auto vertex : geometry.vertices) {
+                    auto uv = vertex.uv();
+                    json.Write(uv.x);
+                    json.Write(uv.y);
+                }
+                json.EndArray(); // array
+            }
+        }
+        json.EndObject(); // uv
+    }
+}
+
+// floats per vertex in the interleaved buffer
+unsigned THREESceneSaver::InterleavedStride(const GeometryBuffer& geometry) const
+{
+    unsigned stride = 3;
+    
+    if (opt_save_normals_) {
+        stride += 3;
+    }
+    
+    if (opt_save_uvs_ && geometry.has_uvs) {
+        stride += 2;
+    }
+    
+    return stride;
+}
+
+std::string THREESceneSaver::InterleavedUUID(const std::string& uuid)
+{
+    return uuid + "-vertices";
+}
+
+/*
+ * All vertex attributes in a single Float32Array, written in one pass over
+ * the vertices: x y z [nx ny nz] [u v] per vertex. The attributes reference
+ * it with their offset into each vertex, see WriteInterleavedAttributes.
+ * BufferGeometryLoader reads the array from data.arrayBuffers, as the
+ * Uint32 words of the floats, and the InterleavedBuffer from
+ * data.interleavedBuffers.
+ */
+void THREESceneSaver::WriteInterleavedBuffer(JSONFormat& json, const GeometryBuffer& geometry)
+{
+    bool normals = opt_save_normals_;
+    bool uvs = opt_save_uvs_ && geometry.has_uvs;
+    
+    std::string uuid = InterleavedUUID(geometry.uuid);
+    std::string buffer_uuid = uuid + "-buffer";
+    unsigned stride = InterleavedStride(geometry);
+    
+    // the floats of one vertex, in attribute order
+    auto pack = [&](const Vertex& vertex, float* floats) {
+        auto position = vertex.position();
+        *floats++ = position.x;
+        *floats++ = position.y;
+        *floats++ = position.z;
+        
+        if (normals) {
+            auto normal = vertex.normal();
+            *floats++ = normal.x;
+            *floats++ = normal.y;
+            *floats++ = normal.z;
+        }
+        
+        if (uvs) {
+            auto uv = vertex.uv();
+            *floats++ = uv.x;
+            *floats++ = uv.y;
+        }
+    };
+    
+    json.StartObject("arrayBuffers");
+    if (opt_geometry_binary_) {
+        json.StartObject(buffer_uuid);
+        auto offset = StartBuffer();
+        if (buffer_file_.IsOpen()) {
+            for (auto vertex : geometry.vertices) {
+                float floats[8];
+                pack(vertex, floats);
+                for (unsigned i = 0; i < stride; ++i) {
+                    buffer_file_.WriteFloat32(floats[i]);
+                }
+            }
+        }
+        EndBuffer(json, offset);
+        json.EndObject(); // buffer
+    } else {
+        // words of a few thousand vertices at a time
+        static const size_t kVerticesPerBatch = 4096;
+        std::vector<unsigned> words;
+        words.reserve(kVerticesPerBatch * stride);
+        
+        json.StartArray(buffer_uuid);
+        for (auto vertex : geometry.vertices) {
+            float floats[8];
+            pack(vertex, floats);
+            for (unsigned i = 0; i < stride; ++i) {
+                words.push_back(FloatBits(floats[i]));
+            }
+            
+            if (words.size() >= kVerticesPerBatch * stride) {
+                json.WriteValues(words.data(), words.size());
+                words.clear();
+            }
+        }
+        json.WriteValues(words.data(), words.size());
+        json.EndArray(); // buffer
+    }
+    json.EndObject(); // arrayBuffers
+    
+    json.StartObject("interleavedBuffers");
+    json.StartObject(uuid);
+    json.Property("uuid", uuid);
+    json.Property("buffer", buffer_uuid);
+    json.Property("type", "Float32Array");
+    json.Property("stride", stride);
+    json.EndObject(); // buffer
+    json.EndObject(); // interleavedBuffers
+}
+
+void THREESceneSaver::WriteInterleavedAttributes(JSONFormat& json, const GeometryBuffer& geometry)
+{
+    std::string uuid = InterleavedUUID(geometry.uuid);
+    unsigned offset = 0;
+    
+    auto attribute = [&](const char* name, unsigned item_size) {
+        json.StartObject(name);
+        json.Property("isInterleavedBufferAttribute", true);
+        json.Property("itemSize", item_size);
+        json.Property("data", uuid);
+        json.Property("offset", offset);
+        json.Property("normalized", false);
+        json.EndObject();
+        
+        offset += item_size;
+    };
+    
+    attribute("position", 3);
+    
+    if (opt_save_normals_) {
+        attribute("normal", 3);
+    }
+    
+    if (opt_save_uvs_ && geometry.has_uvs) {
+        attribute("uv", 2);
+    }
+}
+
+/*
+ * Writes the precomputed bounds into the geometry data, in the space of
+ * the written positions, so three.js does not compute the bounding sphere
+ * on load.
+ */
+void THREESceneSaver::WriteBounds(JSONFormat& json, const GeometryBuffer& geometry)
+{
+    Bounds bounds = geometry.bounds;
+    if (bounds.empty) {
+        return;
+    }
+    
+    if (geometry.quantize_positions) {
+        for (unsigned i = 0; i < 3; ++i) {
+            double offset = geometry.position_offset[i];
+            bounds.min[i] = (bounds.min[i] - offset) / geometry.position_scale;
+            bounds.max[i] = (bounds.max[i] - offset) / geometry.position_scale;
+            bounds.center[i] = (bounds.center[i] - offset) / geometry.position_scale;
+        }
+        bounds.radius /= geometry.position_scale;
+    }
+    
+    // the box of BufferGeometry vertices is made of their Float32 values
+    bool float32 = opt_geometry_type_ == kBufferGeometry && !geometry.quantize_positions;
+    auto corner = [&](const double* values) {
+        for (unsigned i = 0; i < 3; ++i) {
+            if (float32) {
+                json.Write((float)values[i]);
+            } else {
+                json.Write(values[i]);
+            }
+        }
+    };
+    
+    json.StartObject("boundingBox");
+    json.StartArray("min");
+    corner(bounds.min);
+    json.EndArray(); // min
+    json.StartArray("max");
+    corner(bounds.max);
+    json.EndArray(); // max
+    json.EndObject(); // boundingBox
+    
+    json.StartObject("boundingSphere");
+    json.StartArray("center");
+    json.Write(bounds.center[0]);
+    json.Write(bounds.center[1]);
+    json.Write(bounds.center[2]);
+    json.EndArray(); // center
+    json.Property("radius", bounds.radius);
+    json.EndObject(); // boundingSphere
+}
+
+// Returns the byte offset of the array about to be written to the sidecar,
+// aligned to 4 bytes for Float32Array views after Uint16Array indices.
+uint64_t THREESceneSaver::StartBuffer()
+{
+    if (buffer_file_.IsOpen()) {
+        buffer_file_.Align(4);
+    }
+    
+    return buffer_file_.Tell();
+}
+
+// References the array written since StartBuffer from the attribute.
+void THREESceneSaver::EndBuffer(JSONFormat& json, uint64_t offset)
+{
+    json.Property("buffer", buffer_url_);
+    json.Property("byteOffset", (unsigned long long)offset);
+    json.Property("byteLength", (unsigned long long)(buffer_file_.Tell() - offset));
+}
+
+void THREESceneSaver::WriteObject()
+{
+    CLxUser_Item item;
+    GetItem(item);
+    
+    Property("uuid", ItemIdentity());
+    const char* name = ItemName();
+    if (name) {
+        Property("name", name);
+    }
+    
+    LXtMatrix4 transform = {
+        { 1, 0, 0, 0 },
+        { 0, 1, 0, 0 },
+        { 0, 0, 1, 0 },
+        { 0, 0, 0, 1 },
+    };
+    
+    CLxLoc_Locator locator;
+    if (locator.set(item)) {
+        locator.LocalTransform4(chan_xform_, transform);
+    }
+    
+    // poly tag -> item tag
+    std::map<std::string, std::string> materials;
+    auto iter = material_map_.find(ItemIdentity());
+    if (iter != material_map_.end()) {
+        for (auto it = iter->second.begin(); it != iter->second.end(); it++) {
+            materials[names_.Name(it->second)] = names_.Name(it->first);
+        }
+    }
+    
+    // geometries of meshes, uuid suffix and poly tag; split geometries
+    // take one entry per part
+    std::vector<std::pair<std::string, std::string>> meshes;
+    
+    if (ItemIsA(LXsITYPE_MESH) || ItemIsA(LXsITYPE_MESHINST)) {
+        if (ItemIsA(LXsITYPE_MESHINST)) {
+            CLxUser_Item source;
+            scene_service_.GetMeshInstSourceItem((ILxUnknownID)item, source);
+            SetItem(source);
+        }
+        
+        const MeshInfo& info = GetMeshInfo();
+        for (auto it = info.tags.begin(); it != info.tags.end(); it++) {
+            unsigned parts = GeometryParts(ItemIdentity() + it->first);
+            
+            if (parts == 1) {
+                meshes.push_back(std::make_pair(it->first, it->first));
+                continue;
+            }
+            
+            for (unsigned part = 0; part < parts; ++part) {
+                meshes.push_back(std::make_pair(PartUUID(it->first, part), it->first));
+            }
+        }
     }
     
     unsigned child_count;
     item.SubCount(&child_count);
     
-    if (child_count > 0 || poly_tags_.size() > 1) {
+    // A single geometry is used by the object itself, unless the matrix
+    // has to dequantize its positions and would apply to the children too.
+    bool is_mesh = meshes.size() == 1;
+    if (is_mesh) {
+        std::string uuid = ItemIdentity() + meshes.front().first;
+        
+        if (child_count > 0 && geometry_dequantization_.count(GeometryUUID(uuid))) {
+            is_mesh = false;
+        } else {
+            FoldDequantization(uuid, transform);
+        }
+    }
+    
+    StartArray("matrix");
+    for (unsigned col = 0; col < 4; ++col) {
+        for (unsigned row = 0; row < 4; ++row) {
+            Write(transform[col][row]);
+        }
+    }
+    EndArray();
+    
+    if (ItemIsA(LXsITYPE_SCENE)) {
+        Property("type", "Scene");
+    } else if (ItemIsA(LXsITYPE_MESH) || ItemIsA(LXsITYPE_MESHINST)) {
+        if (is_mesh) {
+            Property("type", "Mesh");
+            Property("geometry", GeometryUUID(ItemIdentity() + meshes.front().first));
+            Property("material", materials.begin()->second + '.' + materials.begin()->first);
+        }
+    } else if (ItemIsA(LXsITYPE_GROUPLOCATOR)) {
+        Property("type", "Group");
+    } else if (ItemIsA(LXsITYPE_LOCATOR)) {
+        // don't set type for locator/null mesh
+    }
+    
+    // TODO:
+    //    PerspectiveCamera
+    //    OrthographicCamera
+    //    AmbientLight
+    //    DirectionalLight
+    //    PointLight
+    //    SpotLight
+    //    HemisphereLight
+    //    Line
+    //    Sprite
+    
+    if (!ItemVisible()) {
+        Property("visible", false);
+    }
+    
+    if (child_count > 0 || (meshes.size() > 0 && !is_mesh)) {
         StartArray("children");
         
-        if (poly_tags_.size() > 1) {
-            for (auto it = poly_tags_.begin(); it != poly_tags_.end(); it++) {
+        if (!is_mesh) {
+            for (auto it = meshes.begin(); it != meshes.end(); it++) {
                 std::string poly_mask, item_mask;
-                auto iter = materials.find(*it);
+                auto iter = materials.find(it->second);
                 if (iter != materials.end()) {
-                    poly_mask = *it;
+                    poly_mask = it->second;
                     item_mask = iter->second;
                 } else { // not found
                     iter = materials.find("");
@@ -656,15 +2090,29 @@ void THREESceneSaver::WriteObject()
                 }
                 
                 StartObject();
-                Property("uuid", ItemIdentity() + *it);
+                Property("uuid", ItemIdentity() + it->first);
                 Property("type", "Mesh");
-                Property("geometry", ItemIdentity() + *it);
+                Property("geometry", GeometryUUID(ItemIdentity() + it->first));
                 Property("material", item_mask + '.' + poly_mask);
                 StartArray("matrix");
-                Write(1); Write(0); Write(0); Write(0);
-                Write(0); Write(1); Write(0); Write(0);
-                Write(0); Write(0); Write(1); Write(0);
-                Write(0); Write(0); Write(0); Write(1);
+                LXtMatrix4 dequantize = {
+                    { 1, 0, 0, 0 },
+                    { 0, 1, 0, 0 },
+                    { 0, 0, 1, 0 },
+                    { 0, 0, 0, 1 },
+                };
+                if (FoldDequantization(ItemIdentity() + it->first, dequantize)) {
+                    for (unsigned col = 0; col < 4; ++col) {
+                        for (unsigned row = 0; row < 4; ++row) {
+                            Write(dequantize[col][row]);
+                        }
+                    }
+                } else {
+                    Write(1); Write(0); Write(0); Write(0);
+                    Write(0); Write(1); Write(0); Write(0);
+                    Write(0); Write(0); Write(1); Write(0);
+                    Write(0); Write(0); Write(0); Write(1);
+                }
                 EndArray(); // matrix
                 if (!ItemVisible()) {
                     Property("visible", false);
@@ -693,9 +2141,6 @@ void THREESceneSaver::WriteObject()
     
     SetItem(item);
     
-    poly_tag_ = "";
-    poly_tags_.clear();
-    
     return;
 }
 
@@ -734,6 +2179,58 @@ void THREESceneSaver::GetOptions()
         opt_geometry_type_ = (GeometryType)ruv.GetInt();
     }
 
+    if (ruv.Query(kUserValueGeometryBinary)) {
+        opt_geometry_binary_ = ruv.GetInt() ? true : false;
+    }
+
+    if (ruv.Query(kUserValueGeometryInterleaved)) {
+        opt_geometry_interleaved_ = ruv.GetInt() ? true : false;
+    }
+
+    if (ruv.Query(kUserValueGeometryThreads)) {
+        opt_geometry_threads_ = ruv.GetInt();
+    }
+
+    if (ruv.Query(kUserValueGeometryShare)) {
+        opt_geometry_share_ = ruv.GetInt() ? true : false;
+    }
+
+    if (ruv.Query(kUserValueGeometrySplit)) {
+        opt_geometry_split_ = ruv.GetInt() ? true : false;
+    }
+
+    if (ruv.Query(kUserValueGeometryOptimize)) {
+        opt_geometry_optimize_ = ruv.GetInt() ? true : false;
+    }
+
+    if (ruv.Query(kUserValueGeometryCache)) {
+        opt_geometry_cache_ = ruv.GetInt() ? true : false;
+    }
+
+    if (ruv.Query(kUserValueWeldEnabled)) {
+        opt_weld_enabled_ = ruv.GetInt() ? true : false;
+    }
+
+    if (ruv.Query(kUserValueWeldPosition)) {
+        opt_weld_position_ = ruv.GetFlt();
+    }
+
+    if (ruv.Query(kUserValueWeldNormal)) {
+        opt_weld_normal_ = ruv.GetFlt();
+    }
+
+    if (ruv.Query(kUserValueWeldUV)) {
+        opt_weld_uv_ = ruv.GetFlt();
+    }
+
+    if (ruv.Query(kUserValueQuantizeEnabled)) {
+        opt_quantize_enabled_ = ruv.GetInt() ? true : false;
+    }
+
+    if (ruv.Query(kUserValueQuantizeError)) {
+        opt_quantize_error_ = ruv.GetFlt();
+    }
+
     if (ruv.Query(kUserValuePrecisionEnabled)) {
         opt_precision_enabled_ = ruv.GetInt() ? true : false;
     }
@@ -742,123 +2239,233 @@ void THREESceneSaver::GetOptions()
         opt_precision_value_ = ruv.GetInt();
     }
 
-    if (ruv.Query(kUserValueJSONPretty)) {
-        opt_json_pretty_ = ruv.GetInt() ? true : false;
-    }
+    if (ruv.Query(kUserValuePrecisionFloat32)) {
+        opt_precision_float32_ = ruv.GetInt() ? true : false;
+    }
+
+    if (ruv.Query(kUserValueJSONPretty)) {
+        opt_json_pretty_ = ruv.GetInt() ? true : false;
+    }
+
+    if (ruv.Query(kUserValueStatsFile)) {
+        opt_stats_file_ = ruv.GetInt() ? true : false;
+    }
+
+    if (ruv.Query(kUserValueCompressMethod)) {
+        opt_compress_method_ = (Compressor::Method)ruv.GetInt();
+        
+        // zstd needs to be built in, gzip always is
+        opt_compress_fallback_ = opt_compress_method_ != Compressor::kNone &&
+                                 !Compressor::Available(opt_compress_method_);
+        if (opt_compress_fallback_) {
+            opt_compress_method_ = Compressor::kGzip;
+        }
+    }
+
+    if (ruv.Query(kUserValueCompressLevel)) {
+        opt_compress_level_ = ruv.GetInt();
+    }
+}
+
+/*
+ * Layers in the shader tree are selected by mask strings. The tree is
+ * flattened once per save by IndexShaderTree, ScanShaderTree then collects
+ * the layers matching a set of masks from that index. The Nextlayer()
+ * method steps through that list.
+ */
+void THREESceneSaver::IndexShaderTree()
+{
+    PhaseTimer timer(stats_, ExportStats::kPhaseShaderTree);
+    
+    ClearShaderTree();
+    
+    CLxUser_Item	 render;
+    if (!scene_.GetItem(ItemType(LXsITYPE_POLYRENDER), render)) {
+        return;
+    }
+    
+    scene_.GetChannels(chan_, LXs_ACTIONLAYER_EDIT);
+    
+    /*
+     * Grab the shader tree graph to look up item masks.
+     */
+    CLxUser_SceneGraph scene_graph;
+    scene_.GetGraph(LXsGRAPH_SHADELOC, scene_graph);
+    CLxUser_ItemGraph item_graph;
+    item_graph.set(scene_graph);
+    
+    shader_tree_valid_ = IndexLayers(render, item_graph);
+}
+
+bool THREESceneSaver::IndexLayers(CLxUser_Item& root, CLxUser_ItemGraph& item_graph)
+{
+    unsigned child_count;
+    if (!LXx_OK(root.SubCount(&child_count))) {
+        return false;
+    }
+    
+    CLxUser_Item	 child;
+    for (unsigned i = 0; i < child_count; i++) {
+        if (!root.GetSubItem(i, child)) {
+            return false;
+        }
+        
+        ShaderNode node;
+        node.item = child;
+        
+        if (!child.IsA(ItemType(LXsITYPE_MASK))) {
+            SetItem(child);
+            
+            if (ItemIsA(LXsITYPE_ADVANCEDMATERIAL)) {
+                node.kind = ShaderNode::kMaterial;
+            } else if (ItemIsA(LXsITYPE_IMAGEMAP)) {
+                node.kind = ShaderNode::kImageMap;
+                
+                const char* fx = LayerEffect();
+                if (fx) {
+                    node.effect = fx;
+                }
+                node.identity = ItemIdentity();
+            } else {
+                node.kind = ShaderNode::kOtherLayer;
+            }
+            
+            node.enabled = ChanInt(LXsICHAN_TEXTURELAYER_ENABLE) ? true : false;
+            
+            shader_tree_.push_back(node);
+            continue;
+        }
+        
+        // skip disabled layers
+        unsigned idx = child.ChannelIndex(LXsICHAN_TEXTURELAYER_ENABLE);
+        int enabled;
+        if (idx == -1 || !LXx_OK(chan_.Integer(child, idx, &enabled)) || !enabled) {
+            continue;
+        }
+        
+        idx = child.ChannelIndex(LXsICHAN_MASK_PTAG);
+        const char* poly_tag;
+        if (!LXx_OK(chan_.String(child, idx, &poly_tag))) {
+            return false;
+        }
+        
+        node.kind = ShaderNode::kMask;
+        node.poly_tag = names_.Intern(poly_tag);
+        
+        // item mask
+        unsigned item_count = item_graph.Forward(child);
+        CLxUser_Item layer_mask;
+        if (item_count && item_graph.Forward(child, 0, layer_mask)) {
+            const char* layer_name;
+            layer_mask.UniqueName(&layer_name);
+            
+            node.item_mask = names_.Intern(layer_name);
+        }
+        
+        unsigned index = static_cast<unsigned>(shader_tree_.size());
+        shader_tree_.push_back(node);
+        
+        // index children
+        if (!IndexLayers(child, item_graph)) {
+            return false;
+        }
+        
+        shader_tree_[index].end = static_cast<unsigned>(shader_tree_.size());
+    }
+    
+    return true;
+}
+
+void THREESceneSaver::ClearShaderTree()
+{
+    shader_tree_.clear();
+    shader_tree_valid_ = false;
+    shader_layers_.clear();
+    resolved_masks_.clear();
+    layer_ = nullptr;
+    current_layer_ = 0;
 }
 
-/*
- * Layers in the shader tree are selected by mask strings. The initialization
- * method scans the tree recursively and finds all layers that match the masks.
- * The Nextlayer() method steps through that list.
- */
-bool THREESceneSaver::ScanShaderTree(const char* poly_mask, const char* item_mask, const char* source_mask)
+bool THREESceneSaver::ScanShaderTree(StringInterner::ID poly_mask, StringInterner::ID item_mask, StringInterner::ID source_mask)
 {
-    CLxUser_Item	 render;
-    
-    layer_.clear();
+    layer_ = nullptr;
     current_layer_ = 0;
     
-    if (!scene_.GetItem(ItemType(LXsITYPE_POLYRENDER), render)) {
+    if (!shader_tree_valid_) {
         return false;
     }
     
-    if (!TraverseLayers(render, ShaderMask(), poly_mask, item_mask, source_mask)) {
-        return false;
+    ShaderQuery query(poly_mask, item_mask, source_mask);
+    
+    auto cached = shader_layers_.find(query);
+    if (cached == shader_layers_.end()) {
+        PhaseTimer timer(stats_, ExportStats::kPhaseShaderTree);
+        
+        cached = shader_layers_.insert(std::make_pair(query, std::vector<ShaderLayer>())).first;
+        TraverseLayers(0, static_cast<unsigned>(shader_tree_.size()), ShaderMask(), query, cached->second);
     }
     
+    layer_ = &cached->second;
+    
     return true;
 }
 
 bool THREESceneSaver::GetNextLayer(ShaderLayer& layer)
 {
-    if (current_layer_ >= layer_.size()) {
+    if (!layer_ || current_layer_ >= layer_->size()) {
         return false;
     }
     
-    layer = layer_[current_layer_++];
+    layer = (*layer_)[current_layer_++];
     
     return true;
 }
 
-bool THREESceneSaver::TraverseLayers(CLxUser_Item& root, ShaderMask current_mask, const char* poly_mask, const char* item_mask, const char* source_mask)
+void THREESceneSaver::TraverseLayers(unsigned begin, unsigned end, ShaderMask current_mask, const ShaderQuery& query, std::vector<ShaderLayer>& layers) const
 {
-    unsigned child_count;
-    if (!LXx_OK(root.SubCount(&child_count))) {
-        return false;
-    }
-    
-    /*
-     * Grab the shader tree graph to look up item masks.
-     */
-    CLxUser_SceneGraph scene_graph;
-    scene_.GetGraph(LXsGRAPH_SHADELOC, scene_graph);
-    CLxUser_ItemGraph item_graph;
-    item_graph.set(scene_graph);
+    StringInterner::ID poly_mask = std::get<0>(query);
+    StringInterner::ID item_mask = std::get<1>(query);
+    StringInterner::ID source_mask = std::get<2>(query);
     
-    CLxUser_Item	 child;
-    for (unsigned i = 0; i < child_count; i++) {
-        if (!root.GetSubItem(i, child)) {
-            return false;
-        }
-        
-        if (!child.IsA(ItemType(LXsITYPE_MASK))) {
-            layer_.push_back(ShaderLayer(current_mask, child));
-            continue;
-        }
+    unsigned i = begin;
+    while (i < end) {
+        const ShaderNode& node = shader_tree_[i];
         
-        // skip disabled layers
-        unsigned idx = child.ChannelIndex(LXsICHAN_TEXTURELAYER_ENABLE);
-        int enabled;
-        if (idx == -1 || !LXx_OK(chan_.Integer(child, idx, &enabled)) || !enabled) {
+        if (node.kind != ShaderNode::kMask) {
+            layers.push_back(ShaderLayer(current_mask, &node));
+            i++;
             continue;
         }
         
-        idx = child.ChannelIndex(LXsICHAN_MASK_PTAG);
-        const char* poly_tag;
-        if (!LXx_OK(chan_.String(child, idx, &poly_tag))) {
-            return false;
-        }
-        
-        const char* child_name;
-        child.UniqueName(&child_name);
+        // continue after the subtree of the mask
+        unsigned children = i + 1;
+        i = node.end;
         
         ShaderMask mask;
         
         // check if the layer has a matching poly tag
-        if (poly_tag && strlen(poly_tag) > 0) {
-            if (poly_mask && strcmp(poly_tag, poly_mask) == 0) {
-                mask.second = poly_tag;
+        if (node.poly_tag != StringInterner::kEmpty) {
+            if (node.poly_tag == poly_mask) {
+                mask.second = node.poly_tag;
             } else {
                 continue;
             }
         }
         
         // check if the layer has a matching item mask
-        unsigned item_count = item_graph.Forward(child);
-        CLxUser_Item layer_mask;
-        if (item_count && item_graph.Forward(child, 0, layer_mask)) {
-            const char* layer_name;
-            layer_mask.UniqueName(&layer_name);
-            
-            if (layer_name && strlen(layer_name) > 0) {
-                if (item_mask && strcmp(layer_name, item_mask) == 0) {
-                    mask.first = item_mask;
-                } else if (source_mask && strcmp(layer_name, source_mask) == 0) {
-                    mask.first = source_mask;
-                } else {
-                    continue;
-                }
+        if (node.item_mask != StringInterner::kEmpty) {
+            if (node.item_mask == item_mask) {
+                mask.first = item_mask;
+            } else if (node.item_mask == source_mask) {
+                mask.first = source_mask;
+            } else {
+                continue;
             }
         }
         
         // traverse children
-        if (!TraverseLayers(child, mask, poly_mask, item_mask, source_mask)) {
-            return false;
-        }
+        TraverseLayers(children, node.end, mask, query, layers);
     }
-    
-    return true;
 }
 
 void THREESceneSaver::ss_Verify()
@@ -868,64 +2475,106 @@ void THREESceneSaver::ss_Verify()
 //    MessageArg(1, "Test warning");
 }
 
+/*
+ * The output is opened before ss_Save, so the options that decide how it
+ * is written are read here already.
+ */
+bool THREESceneSaver::ff_Open(const char* filename)
+{
+    GetOptions();
+    compression(opt_compress_method_, opt_compress_level_);
+    
+    return JSONFormat::ff_Open(filename);
+}
+
 LxResult THREESceneSaver::ss_Save()
 {
+    stats_.Start();
+    
     GetOptions();
     if (opt_precision_enabled_) {
         precision(opt_precision_value_);
     }
+    float32(opt_precision_float32_);
     pretty(opt_json_pretty_);
 
     LxResult result(LXe_OK);
     log.Setup();
+    
+    if (opt_compress_fallback_) {
+        log.Warning("zstd is not built in (THREEIO_ZSTD), falling back to gzip");
+    }
+    
+    if (opt_compress_method_ != Compressor::kNone) {
+        std::string message = std::string("Output compressed with ") + Compressor::Name(opt_compress_method_);
+        log.Info(message.c_str());
+    }
+
+    if (ReallySaving() && !OpenBuffers()) {
+        log.Error("could not open binary buffer file");
+        return LXe_FAILED;
+    }
+    
+    OpenGeometryCache();
 
     try {
         scene_ = SceneObject();
         
-        StartObject();
-
-        // metadata
-        StartObject("metadata");
-        Property("version", "4.3");
-        Property("type", "Object");
-        Property("generator", THREE_IO_GENERATOR_NAME);
-        EndObject();
-        
-        // materials
-        WriteMaterials();
-
-        // geometries
-        StartArray("geometries");
-        WriteGeometries();
-        EndArray(); // geometries
-
-        WriteScene();
-        
-        material_map_.clear();
-
-        EndObject(); // root
-    } catch (NgonsException& e) {
-        log.Error("ngons are not supported");
+        WriteDocument();
+    } catch (...) {
+        log.Error("Saver failed with unknown error.");
 
         // Force a failure result code, in case no one set it.
         if (LXx_OK(result)) {
             result = LXe_FAILED;
         }
-    } catch (TrianglesOnlyException& e) {
-        log.Error("when exporting as BufferGeometry, only triangles are supported");
+    }
 
-        // Force a failure result code, in case no one set it.
+    ClearShaderTree();
+    mesh_info_.clear();
+    names_.clear();
+    
+    stats_.json_bytes = Tell();
+    stats_.binary_bytes = buffer_file_.IsOpen() ? buffer_file_.Tell() : 0;
+    
+    bool closed;
+    {
+        PhaseTimer timer(stats_, ExportStats::kPhaseBuffers);
+        closed = CloseBuffers();
+    }
+    
+    if (!closed) {
+        log.Error("could not write binary buffer file");
+        
         if (LXx_OK(result)) {
             result = LXe_FAILED;
         }
-    } catch (...) {
-        log.Error("Saver failed with unknown error.");
-
-        // Force a failure result code, in case no one set it.
+    }
+    
+    // finishing the compressed stream and close(2) report errors of their
+    // own, the save has only succeeded once the file is complete
+    if (ReallySaving() && !Close()) {
+        log.Error("could not write the scene file");
+        
         if (LXx_OK(result)) {
             result = LXe_FAILED;
         }
     }
+    
+    if (!geometry_cache_.Close(LXx_OK(result))) {
+        log.Error("could not write the geometry cache");
+    }
+    
+    stats_.Stop();
+    stats_.peak_rss = PeakResidentBytes();
+    
+    if (ReallySaving()) {
+        LogStats();
+        
+        if (opt_stats_file_ && LXx_OK(result)) {
+            WriteStats();
+        }
+    }
 
     if (LXx_OK(result)) {
         log.Info("Scene saved successfully.");
@@ -934,84 +2583,244 @@ LxResult THREESceneSaver::ss_Save()
     return result;
 }
 
+void THREESceneSaver::LogStats()
+{
+    for (auto& line : stats_.Summary()) {
+        log.Info(line.c_str());
+    }
+}
+
+/*
+ * Writes the stats of the save next to the output, scene.json ->
+ * scene.stats.json, to be compared across exports by scripts.
+ */
+void THREESceneSaver::WriteStats()
+{
+    std::string path = ReplaceExtension(filename_, "stats.json");
+    
+    JSONFormat json;
+    if (!json.ff_Open(path.c_str())) {
+        log.Error("could not open stats file");
+        return;
+    }
+    
+    json.StartObject();
+    json.Property("file", FileName(filename_));
+    json.Property("generator", THREE_IO_GENERATOR_NAME);
+    stats_.Write(json);
+    json.EndObject();
+    
+    if (!json.Close()) {
+        log.Error("could not write stats file");
+    }
+    
+    json.ff_Cleanup();
+}
+
+void THREESceneSaver::WriteDocument()
+{
+    StartObject();
+
+    // metadata
+    StartObject("metadata");
+    Property("version", "4.3");
+    Property("type", "Object");
+    Property("generator", THREE_IO_GENERATOR_NAME);
+    EndObject();
+    
+    // materials
+    WriteMaterials();
+
+    // geometries
+    StartArray("geometries");
+    WriteGeometries();
+    EndArray(); // geometries
+
+    WriteScene();
+    
+    material_map_.clear();
+    shared_geometries_.clear();
+    geometry_alias_.clear();
+    geometry_parts_.clear();
+    geometry_dequantization_.clear();
+
+    EndObject(); // root
+}
+
+bool THREESceneSaver::OpenBuffers()
+{
+    // binary attribute buffers only apply to BufferGeometry
+    opt_geometry_binary_ = opt_geometry_binary_ && opt_geometry_type_ == kBufferGeometry;
+    
+    if (!opt_geometry_binary_) {
+        return true;
+    }
+    
+    // the url stays uncompressed, precompressed files are served with a
+    // Content-Encoding header under their uncompressed name
+    std::string path = ReplaceExtension(filename_, THREE_BUFFER_EXTENSION);
+    buffer_url_ = FileName(path);
+    
+    if (opt_compress_method_ != Compressor::kNone) {
+        path += std::string(".") + Compressor::Extension(opt_compress_method_);
+    }
+    
+    return buffer_file_.Open(path.c_str(), opt_compress_method_, opt_compress_level_);
+}
+
+bool THREESceneSaver::CloseBuffers()
+{
+    if (!buffer_file_.IsOpen()) {
+        return true;
+    }
+    
+    return buffer_file_.Close();
+}
+
 // A point visitor.
 void THREESceneSaver::ss_Point()
 {
+    if (!scan_info_) {
+        return;
+    }
+    
+    double position[3];
+    PntPosition(position);
+    
+    for (unsigned i = 0; i < 3; i++) {
+        scan_info_->min[i] = std::min(scan_info_->min[i], position[i]);
+        scan_info_->max[i] = std::max(scan_info_->max[i], position[i]);
+    }
+}
+
+// The interned material tag of the current polygon.
+StringInterner::ID THREESceneSaver::PolyTagID()
+{
+    const char* tag = PolyTag(LXi_PTAG_MATR);
+    if (!tag) {
+        tag = "";
+    }
+    
+    if (tag != tag_string_) {
+        tag_string_ = tag;
+        tag_id_ = names_.Intern(tag);
+    }
+    
+    return tag_id_;
+}
+
+// Points the geometry buffer at the bucket of the current polygon's
+// material tag. Consecutive polygons mostly share their tag, so the
+// bucket is only looked up by ID when the tag changes.
+void THREESceneSaver::SelectGeometry()
+{
+    StringInterner::ID tag = PolyTagID();
+    
+    if (geometry_ && poly_tag_ == tag) {
+        return;
+    }
+    
+    poly_tag_ = tag;
+    if (poly_tag_ >= tag_geometries_.size()) {
+        tag_geometries_.resize(names_.size(), nullptr);
+    }
+    
+    geometry_ = tag_geometries_[poly_tag_];
+    if (geometry_) {
+        return;
+    }
+    
+    const std::string& name = names_.Name(poly_tag_);
+    geometry_ = &geometries_[name];
+    tag_geometries_[poly_tag_] = geometry_;
+    
+    geometry_->uuid = ItemIdentity() + name;
+    geometry_->has_uvs = has_uvs_;
+    
+    // vertex records only hold the attributes that are saved
+    unsigned layout = LayoutOf(has_uvs_);
+    geometry_->snapshot.vertices = VertexArray(layout);
+    geometry_->vertices = VertexSet(layout);
+    
+    // size the bucket by the polygon count of its tag
+    auto count = current_mesh_->tags.find(name);
+    if (count == current_mesh_->tags.end()) {
+        return;
+    }
+    
+    size_t polys = count->second;
+    auto& snapshot = geometry_->snapshot;
+    snapshot.points = std::min<size_t>(current_mesh_->points, polys * 4);
+    
+    if (poly_pass_ == kPolypassBufferGeometry) {
+        snapshot.vertices.reserve(polys * 3);
+    } else {
+        snapshot.masks.reserve(polys);
+        snapshot.positions.reserve(polys * 4);
+    }
 }
 
 // A polygon visitor.
 void THREESceneSaver::ss_Polygon()
 {
+    stats_.polygons_visited++;
+    
     switch (poly_pass_) {
         case kPolypassGeometry:
         {
-            // skip polygons that do not match the current
-            // material tag filter
-            std::string tag(PolyTag(LXi_PTAG_MATR));
-            if (tag != poly_tag_) {
-                break;
-            }
+            SelectGeometry();
             
             unsigned num_vert = PolyNumVerts();
-
-            if (num_vert != 3 && num_vert != 4) {
-                throw NgonsException();
+            if (num_vert < 3) {
+                stats_.polygons_skipped++;
+                break;
             }
+            
+            poly_points_.resize(num_vert);
+            poly_positions_.clear();
+            poly_uvs_.clear();
+            poly_normals_.clear();
 
-            unsigned mask = kTriangle;
-
-            if (num_vert == 4) {
-                mask += kQuad;
+            // the point of each corner, looked up once for all its values
+            for (unsigned i = 0; i < num_vert; i++) {
+                poly_points_[i] = PolyVertex(i);
             }
-
-            std::vector<unsigned> indices;
-
+            
             // positions
             for (unsigned i = 0; i < num_vert; i++) {
-                PntSet(PolyVertex(i));
+                PntSet(poly_points_[i]);
 
                 double position[3];
                 PntPosition(position);
 
-                if (!ReallySaving()) {
-                    continue;
-                }
-
-                indices.push_back(positions_.insert(position));
+                poly_positions_.push_back(Vector3(position));
             }
             
             // uvs
-            if (opt_save_uvs_ && has_uvs_) {
-                mask += kFaceVertexUv;
-                
+            bool uvs = opt_save_uvs_ && has_uvs_;
+            if (uvs) {
                 for (unsigned i = 0; i < num_vert; i++) {
                     float uv[2];
-                    if (!PolyMapValue(uv, PolyVertex(i))) {
+                    if (!PolyMapValue(uv, poly_points_[i])) {
                         uv[0] = uv[1] = 0.0f;
                     }
                     
-                    if (!ReallySaving()) {
-                        continue;
-                    }
-                    
-                    indices.push_back(uvs_.insert(uv));
+                    poly_uvs_.push_back(Vector2(uv));
                 }
             }
 
+            double face_normal[3];
+            bool has_face_normal = false;
+            bool has_vertex_normals = false;
+            
             if (opt_save_normals_) {
-                // face normal
-                double face_normal[3];
-                if (PolyNormal(face_normal) && ReallySaving()) {
-                    mask += kFaceNormal;
-
-                    indices.push_back(normals_.insert(face_normal));
-                }
+                has_face_normal = PolyNormal(face_normal);
 
                 // vertex normals
                 for (unsigned i = 0; i < num_vert; i++) {
                     double vertex_normal[3];
 
-                    if (!PolyNormal(vertex_normal, PolyVertex(i))) {
+                    if (!PolyNormal(vertex_normal, poly_points_[i])) {
                         if (i == 0) {
                             break;
                         }
@@ -1021,39 +2830,86 @@ void THREESceneSaver::ss_Polygon()
                         vertex_normal[1] = vertex_normal[2] = 0.0;
                     }
                     
-                    if (i == 0) {
-                        mask += kFaceVertexNormal;
-                    }
-
-                    if (!ReallySaving()) {
-                        continue;
-                    }
-
-                    indices.push_back(normals_.insert(vertex_normal));
+                    has_vertex_normals = true;
+                    poly_normals_.push_back(Vector3(vertex_normal));
                 }
             }
 
-            Write(mask);
-            for (unsigned index : indices) {
-                Write(index);
+            if (!ReallySaving()) {
+                break;
+            }
+            
+            // Geometry takes triangles and quads, quads are split along a
+            // fixed diagonal on load, so concave ones are triangulated here
+            poly_triangles_.clear();
+            
+            unsigned num_faces = 1;
+            if (num_vert > 4 || (num_vert == 4 && !IsConvexQuad(poly_positions_))) {
+                num_faces = Triangulate(poly_positions_, poly_triangles_, triangulate_scratch_);
+                
+                triangulated_polygons_++;
+                generated_triangles_ += num_faces;
+            } else {
+                for (unsigned i = 0; i < num_vert; i++) {
+                    poly_triangles_.push_back(i);
+                }
+            }
+            
+            // the values are recorded in the order the mask lists them
+            auto& snapshot = geometry_->snapshot;
+            
+            for (unsigned face = 0; face < num_faces; face++) {
+                unsigned face_verts = num_faces == 1 ? num_vert : 3;
+                const unsigned* corners = &poly_triangles_[face * 3];
+                
+                unsigned mask = kTriangle;
+                if (face_verts == 4) {
+                    mask += kQuad;
+                }
+                
+                for (unsigned i = 0; i < face_verts; i++) {
+                    snapshot.positions.push_back(poly_positions_[corners[i]]);
+                }
+                
+                if (uvs) {
+                    mask += kFaceVertexUv;
+                    
+                    for (unsigned i = 0; i < face_verts; i++) {
+                        snapshot.uvs.push_back(poly_uvs_[corners[i]]);
+                    }
+                }
+                
+                if (has_face_normal) {
+                    mask += kFaceNormal;
+                    
+                    snapshot.normals.push_back(Vector3(face_normal));
+                }
+                
+                if (has_vertex_normals) {
+                    mask += kFaceVertexNormal;
+                    
+                    for (unsigned i = 0; i < face_verts; i++) {
+                        snapshot.normals.push_back(poly_normals_[corners[i]]);
+                    }
+                }
+                
+                snapshot.masks.push_back(mask);
             }
 
             break;
         }
         case kPolypassBufferGeometry:
         {
-            // skip polygons that do not match the current
-            // material tag filter
-            std::string tag(PolyTag(LXi_PTAG_MATR));
-            if (tag != poly_tag_) {
-                break;
-            }
+            SelectGeometry();
             
             unsigned num_vert = PolyNumVerts();
-
-            if (num_vert != 3) {
-                throw TrianglesOnlyException();
+            if (num_vert < 3) {
+                stats_.polygons_skipped++;
+                break;
             }
+            
+            poly_positions_.clear();
+            poly_vertices_.clear();
 
             // vertices
             for (unsigned i = 0; i < num_vert; i++) {
@@ -1083,26 +2939,51 @@ void THREESceneSaver::ss_Polygon()
                     }
                 }
                 
-                if (!ReallySaving()) {
-                    continue;
+                poly_positions_.push_back(Vector3(position));
+                poly_vertices_.push_back(Vertex(position, normal, uv));
+            }
+            
+            if (!ReallySaving()) {
+                break;
+            }
+            
+            auto& vertices = geometry_->snapshot.vertices;
+            
+            if (num_vert == 3) {
+                for (const auto& vertex : poly_vertices_) {
+                    vertices.push_back(vertex);
                 }
-                
-                Vertex vertex(position, normal, uv);
-                auto vertex_index = vertices_.insert(vertex);
-                Write(vertex_index);
+                break;
+            }
+            
+            // the corners of the generated triangles keep the normals and
+            // uvs of the polygon's vertices
+            poly_triangles_.clear();
+            
+            triangulated_polygons_++;
+            generated_triangles_ += Triangulate(poly_positions_, poly_triangles_, triangulate_scratch_);
+            
+            for (unsigned corner : poly_triangles_) {
+                vertices.push_back(poly_vertices_[corner]);
             }
 
             break;
         }
         case kPolypassMaterial:
         {
-            std::string tag(PolyTag(LXi_PTAG_MATR));
+            StringInterner::ID tag = PolyTagID();
             
-            if (poly_tags_.size() == 0 || tag != poly_tag_) {
-                poly_tags_.insert(tag);
+            // consecutive polygons mostly share their tag
+            if (!poly_count_ || poly_tag_ != tag) {
                 poly_tag_ = tag;
+                if (poly_tag_ >= poly_counts_.size()) {
+                    poly_counts_.resize(names_.size(), 0);
+                }
+                poly_count_ = &poly_counts_[poly_tag_];
             }
             
+            (*poly_count_)++;
+            
             break;
         }
     }
@@ -1120,5 +3001,7 @@ LXtTagInfoDesc THREESceneSaver::descInfo[] = {
 void initialize()
 {
     LXx_ADD_SERVER(Saver, THREESceneSaver, THREE_IO_INTERNAL_NAME.c_str());
+    LXx_ADD_SERVER(Saver, GLTFSceneSaver, GLTF_IO_INTERNAL_NAME.c_str());
+    LXx_ADD_SERVER(Saver, GLBSceneSaver, GLB_IO_INTERNAL_NAME.c_str());
 }
 
@@ -1,26 +1,33 @@
 #ifndef __threeio__threesaver__
 #define __threeio__threesaver__
 
+#include <cmath>
 #include <set>
+#include <tuple>
 
 #include <lx_action.hpp>
 #include <lxu_scene.hpp>
 
+#include "bufferedfile.h"
+#include "geometrycache.h"
+#include "interner.h"
 #include "jsonformat.h"
 #include "logmessage.h"
+#include "stats.h"
+#include "triangulate.h"
 #include "types.h"
+#include "vertexcache.h"
+#include "weld.h"
 
 const std::string THREE_FILE_EXTENSION    = "json";
+const std::string THREE_BUFFER_EXTENSION  = "bin";
 
 const std::string THREE_IO_GENERATOR_NAME = "ModoExporter";
 const std::string THREE_IO_INTERNAL_NAME  = "THREE_43";
 const std::string THREE_IO_USER_NAME      = "THREE JSON format 4.3";
 
-class NgonsException : public std::exception {
-};
-
-class TrianglesOnlyException : public std::exception {
-};
+std::string ReplaceExtension(const std::string& path, const std::string& extension);
+std::string FileName(const std::string& path);
 
 class THREESceneSaver : public CLxSceneSaver, public JSONFormat
 {
@@ -36,6 +43,8 @@ public:
         return this;
     }
     
+    virtual bool ff_Open(const char *) override;
+    
     virtual void     ss_Verify();
     virtual LxResult	 ss_Save() override;
     virtual void		 ss_Point() override;
@@ -43,7 +52,7 @@ public:
     
     static LXtTagInfoDesc descInfo[];
     
-private:
+protected:
     
     ThreeLogMessage log;
     
@@ -63,9 +72,26 @@ private:
     constexpr static const char* const kUserValueSaveUVs = "threeio.save.uvs";
     constexpr static const char* const kUserValueEmbedImages = "threeio.embed.images";
     constexpr static const char* const kUserValueGeometryType = "threeio.geometry.type";
+    constexpr static const char* const kUserValueGeometryBinary = "threeio.geometry.binary";
+    constexpr static const char* const kUserValueGeometryInterleaved = "threeio.geometry.interleaved";
+    constexpr static const char* const kUserValueGeometryThreads = "threeio.geometry.threads";
+    constexpr static const char* const kUserValueGeometryShare = "threeio.geometry.share";
+    constexpr static const char* const kUserValueGeometrySplit = "threeio.geometry.split";
+    constexpr static const char* const kUserValueGeometryOptimize = "threeio.geometry.optimize";
+    constexpr static const char* const kUserValueGeometryCache = "threeio.geometry.cache";
+    constexpr static const char* const kUserValueWeldEnabled = "threeio.weld.enabled";
+    constexpr static const char* const kUserValueWeldPosition = "threeio.weld.position";
+    constexpr static const char* const kUserValueWeldNormal = "threeio.weld.normal";
+    constexpr static const char* const kUserValueWeldUV = "threeio.weld.uv";
+    constexpr static const char* const kUserValueQuantizeEnabled = "threeio.quantize.enabled";
+    constexpr static const char* const kUserValueQuantizeError = "threeio.quantize.error";
     constexpr static const char* const kUserValuePrecisionEnabled = "threeio.precision.enabled";
     constexpr static const char* const kUserValuePrecisionValue = "threeio.precision.value";
+    constexpr static const char* const kUserValuePrecisionFloat32 = "threeio.precision.float32";
     constexpr static const char* const kUserValueJSONPretty = "threeio.json.pretty";
+    constexpr static const char* const kUserValueStatsFile = "threeio.stats.file";
+    constexpr static const char* const kUserValueCompressMethod = "threeio.compress.method";
+    constexpr static const char* const kUserValueCompressLevel = "threeio.compress.level";
     
     enum PolyPass
     {
@@ -90,50 +116,246 @@ private:
     bool opt_save_uvs_ = true;
     bool opt_embed_images_ = false;
     GeometryType opt_geometry_type_ = kGeometry;
+    bool opt_geometry_binary_ = false;
+    bool opt_geometry_interleaved_ = false;
+    unsigned opt_geometry_threads_ = 0; // 0: one per core
+    bool opt_geometry_share_ = true;
+    bool opt_geometry_split_ = false;
+    bool opt_geometry_optimize_ = true;
+    bool opt_geometry_cache_ = false;
+    bool opt_weld_enabled_ = false;
+    double opt_weld_position_ = 0.0001; // meters
+    double opt_weld_normal_ = 0.00174533; // radians, 0.1 degrees
+    double opt_weld_uv_ = 0.00001;
+    bool opt_quantize_enabled_ = false;
+    double opt_quantize_error_ = 0.001; // largest position error, in meters
     bool opt_precision_enabled_ = false;
     unsigned opt_precision_value_ = 6;
+    bool opt_precision_float32_ = false;
     bool opt_json_pretty_ = true;
+    bool opt_stats_file_ = false;
+    Compressor::Method opt_compress_method_ = Compressor::kNone;
+    bool opt_compress_fallback_ = false; // the method asked for is not built in
+    int opt_compress_level_ = 0; // 0: the method's default
+    
+    // timings and counters of the current save
+    ExportStats stats_;
+    
+    // binary sidecar of the BufferGeometry attributes
+    BufferedFile buffer_file_;
+    std::string buffer_url_;
     
     CLxUser_SceneGraph scene_graph_;
     CLxUser_ItemGraph  item_graph_;
     
-    UniqueOrderedSet<Vector3> positions_;
-    UniqueOrderedSet<Vector3> normals_;
-    UniqueOrderedSet<Vector2> uvs_;
-    UniqueOrderedSet<Vertex> vertices_;
+    // snapshot size after which the pending meshes are encoded
+    static const size_t kGeometryBatchBytes = 256 * 1024 * 1024;
+    
+    // material tag -> geometry data of the current mesh
+    std::map<std::string, GeometryBuffer> geometries_;
+    GeometryBuffer* geometry_ = nullptr;
+    
+    // 128 bit content hash of an encoded geometry
+    typedef std::pair<uint64_t, uint64_t> GeometryHash;
+    
+    // first geometry with some content, and the bytes it took to write it
+    struct SharedGeometry {
+        std::string uuid;
+        uint64_t bytes = 0;
+        unsigned copies = 0;
+    };
+    
+    std::map<GeometryHash, SharedGeometry> shared_geometries_;
+    std::map<std::string, std::string> geometry_alias_; // uuid -> uuid of the shared geometry
+    
+    // Uint16Array indices up to this many vertices, 65535 is reserved
+    // for primitive restart
+    static const size_t kMaxUint16Vertices = 0xffff;
+    
+    std::map<std::string, unsigned> geometry_parts_; // uuid -> parts it was split into
+    
+    // positions of a geometry written as normalized Int16 are
+    // offset + scale * q, which the objects using it apply in their matrix
+    struct Dequantization {
+        double offset[3];
+        double scale;
+    };
+    
+    std::map<std::string, Dequantization> geometry_dequantization_; // uuid -> dequantization
+    
+    // encoded geometries of the previous save, next to the output
+    GeometryCache geometry_cache_;
+    
+    unsigned index16_count_ = 0;
+    unsigned index32_count_ = 0;
+    unsigned split_count_ = 0;
     
-    // pair of item mask and poly tag
-    typedef std::pair<std::string, std::string> ShaderMask;
-    typedef std::pair<ShaderMask, ILxUnknownID> ShaderLayer;
+    // polygons the file format takes as they are are not counted
+    unsigned triangulated_polygons_ = 0;
+    unsigned generated_triangles_ = 0;
     
-    std::map<std::string, std::set<ShaderMask>> material_map_;
-    std::set<ShaderMask> materials_;
+    // corners of the current polygon, reused to avoid allocations
+    std::vector<LXtPointID> poly_points_;
+    std::vector<Vector3> poly_positions_;
+    std::vector<Vector3> poly_normals_;
+    std::vector<Vector2> poly_uvs_;
+    std::vector<Vertex> poly_vertices_;
+    std::vector<unsigned> poly_triangles_;
+    TriangulateScratch triangulate_scratch_;
+    
+    // pair of item mask and poly tag, interned in names_
+    typedef std::pair<StringInterner::ID, StringInterner::ID> ShaderMask;
+    
+    // Shader tree flattened in depth first order, indexed once per save.
+    // Disabled masks are left out together with their layers.
+    struct ShaderNode {
+        enum Kind {
+            kMask,
+            kMaterial,
+            kImageMap,
+            kOtherLayer
+        };
+        
+        Kind kind;
+        ILxUnknownID item;
+        
+        // masks: filters, kEmpty if not set, and the index past the subtree
+        StringInterner::ID poly_tag = StringInterner::kEmpty;
+        StringInterner::ID item_mask = StringInterner::kEmpty;
+        unsigned end = 0;
+        
+        // layers
+        bool enabled = false;
+        std::string effect;
+        std::string identity;
+    };
+    
+    typedef std::pair<ShaderMask, const ShaderNode*> ShaderLayer;
+    
+    // poly tag, item name and mesh instance source name
+    typedef std::tuple<StringInterner::ID, StringInterner::ID, StringInterner::ID> ShaderQuery;
+    
+    // mask of the top most material for a query and the image maps above it
+    struct ResolvedMask {
+        ShaderMask mask;
+        std::string diffuse_map, specular_map, emissive_map, bump_map;
+    };
+    
+    // top most material of a mask and the image maps above it
+    struct MaterialLayers {
+        CLxUser_Item material, diffuse_map, specular_map, emissive_map, bump_map;
+    };
+    
+    // poly tags and item mask names of the current save
+    StringInterner names_;
+    
+    // masks sorted by their names and without duplicates, the order
+    // materials are written in
+    std::map<std::string, std::vector<ShaderMask>> material_map_; // item identity -> masks
+    std::vector<ShaderMask> materials_;
     std::set<std::string> images_;
-    std::string poly_tag_;
-    std::set<std::string> poly_tags_;
+    StringInterner::ID poly_tag_ = StringInterner::kEmpty;
+    
+    // the material tag string of the last polygon and its ID; the SDK
+    // hands out the same string for the polygons of a mesh sharing a tag,
+    // so it is only interned again when the pointer changes
+    const char* tag_string_ = nullptr;
+    StringInterner::ID tag_id_ = StringInterner::kEmpty;
+    
+    // polygon pass state by tag ID: polygons of the mesh being scanned,
+    // and the bucket in geometries_
+    std::vector<unsigned> poly_counts_;
+    std::vector<GeometryBuffer*> tag_geometries_;
+    
+    // Per save metadata of a mesh, gathered by a single sweep on first use
+    // and shared by the material, geometry and object writers.
+    struct MeshInfo {
+        std::map<std::string, unsigned> tags; // material tag -> polygon count
+        unsigned points = 0;
+        double min[3] = { HUGE_VAL, HUGE_VAL, HUGE_VAL };
+        double max[3] = { -HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+        std::string uv_map; // first texture uv map, empty if none
+    };
+    
+    std::map<std::string, MeshInfo> mesh_info_; // mesh identity -> metadata
+    MeshInfo* scan_info_ = nullptr;
+    const MeshInfo* current_mesh_ = nullptr;
+    unsigned* poly_count_ = nullptr;
     bool has_uvs_ = false;
     
     CLxUser_Scene scene_;
     CLxUser_SceneService scene_service_;
-    std::vector<ShaderLayer> layer_;
+    std::vector<ShaderNode> shader_tree_;
+    bool shader_tree_valid_ = false;
+    std::map<ShaderQuery, std::vector<ShaderLayer>> shader_layers_;
+    std::map<ShaderQuery, ResolvedMask> resolved_masks_;
+    const std::vector<ShaderLayer>* layer_ = nullptr;
     unsigned current_layer_ = 0;
     
+    virtual void GetOptions();
+    virtual void WriteDocument();
+    virtual bool OpenBuffers();
+    virtual bool CloseBuffers();
+    
     void WriteObject();
     void WriteMaterials();
+    void ScanMaterials();
+    const ResolvedMask& ResolveMask(StringInterner::ID, StringInterner::ID, StringInterner::ID);
+    void SortMasks(std::vector<ShaderMask>&) const;
+    std::string MaskName(const ShaderMask&) const;
+    bool ResolveMaterial(const ShaderMask, MaterialLayers&);
     void WriteMaterial(const ShaderMask);
     void WriteTextures();
     void WriteScene();
     void WriteGeometries();
-    void WriteGeometry();
-    void WriteBufferGeometry();
+    void EncodeGeometries(std::vector<GeometryBuffer>&, unsigned threads);
+    void ScanGeometry();
+    void SnapshotGeometry();
+    const MeshInfo& GetMeshInfo();
+    unsigned LayoutOf(bool has_uvs) const;
+    WeldTolerance Weld() const;
+    void BuildGeometry(GeometryBuffer&) const;
+    uint64_t CountDedup(const GeometryBuffer&);
+    void OptimizeGeometry(GeometryBuffer&, VertexCacheStats&, VertexCacheStats&) const;
+    void LogVertexCache(const std::string&, const VertexCacheStats&, const VertexCacheStats&);
+    void SplitGeometry(const GeometryBuffer&, std::vector<GeometryBuffer>&) const;
+    void LogTriangulation();
+    void QuantizeGeometry(GeometryBuffer&) const;
+    bool FoldDequantization(const std::string&, LXtMatrix4) const;
+    static std::string PartUUID(const std::string&, unsigned);
+    unsigned GeometryParts(const std::string&) const;
+    GeometryHash HashGeometry(const GeometryBuffer&) const;
+    void OpenGeometryCache();
+    uint64_t CacheOptions() const;
+    GeometryCache::Key CacheKey(const GeometryBuffer&) const;
+    std::string GeometryUUID(const std::string&) const;
+    void EncodeGeometry(JSONFormat&, const GeometryBuffer&);
+    void WriteGeometry(JSONFormat&, const GeometryBuffer&);
+    void WriteBufferGeometry(JSONFormat&, const GeometryBuffer&);
+    void WriteIndex(JSONFormat&, const GeometryBuffer&);
+    void WriteAttributes(JSONFormat&, const GeometryBuffer&);
+    unsigned InterleavedStride(const GeometryBuffer&) const;
+    static std::string InterleavedUUID(const std::string&);
+    void WriteInterleavedBuffer(JSONFormat&, const GeometryBuffer&);
+    void WriteInterleavedAttributes(JSONFormat&, const GeometryBuffer&);
+    void WriteBounds(JSONFormat&, const GeometryBuffer&);
+    
+    StringInterner::ID PolyTagID();
+    void SelectGeometry();
+    void LogStats();
+    void WriteStats();
     
+    uint64_t StartBuffer();
+    void EndBuffer(JSONFormat&, uint64_t);
     const bool ItemVisibleForSave() const;
     const bool ItemSupported() const;
-    void GetOptions();
     
-    bool ScanShaderTree(const char*, const char*, const char* = 0);
+    void IndexShaderTree();
+    bool IndexLayers(CLxUser_Item&, CLxUser_ItemGraph&);
+    void ClearShaderTree();
+    bool ScanShaderTree(StringInterner::ID, StringInterner::ID, StringInterner::ID = StringInterner::kEmpty);
     bool GetNextLayer(ShaderLayer& layer);
-    bool TraverseLayers(CLxUser_Item&, ShaderMask, const char*, const char*, const char*);
+    void TraverseLayers(unsigned, unsigned, ShaderMask, const ShaderQuery&, std::vector<ShaderLayer>&) const;
 
 };
 
@@ -0,0 +1,151 @@
+#include "stats.h"
+#include "jsonformat.h"
+
+#include <cstdio>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+const char* ExportStats::PhaseName(Phase phase)
+{
+    switch (phase) {
+        case kPhaseOther: return "other";
+        case kPhaseMaterials: return "materials";
+        case kPhaseShaderTree: return "shader_tree";
+        case kPhaseMeshInfo: return "mesh_info";
+        case kPhasePolygons: return "polygons";
+        case kPhaseGeometries: return "geometries";
+        case kPhaseBuild: return "build";
+        case kPhaseEncode: return "encode";
+        case kPhaseScene: return "scene";
+        case kPhaseBuffers: return "buffers";
+        default: return "";
+    }
+}
+
+void ExportStats::Start()
+{
+    *this = ExportStats();
+    
+    running_ = true;
+    start_ = mark_ = Clock::now();
+}
+
+void ExportStats::Stop()
+{
+    if (!running_) {
+        return;
+    }
+    
+    Switch(current_);
+    running_ = false;
+    
+    std::chrono::duration<double> total = mark_ - start_;
+    total_ = total.count();
+}
+
+void ExportStats::Switch(Phase phase)
+{
+    if (running_) {
+        Clock::time_point now = Clock::now();
+        std::chrono::duration<double> elapsed = now - mark_;
+        
+        seconds_[current_] += elapsed.count();
+        mark_ = now;
+    }
+    
+    current_ = phase;
+}
+
+double ExportStats::Seconds(Phase phase) const
+{
+    return seconds_[phase];
+}
+
+double ExportStats::TotalSeconds() const
+{
+    return total_;
+}
+
+std::vector<std::string> ExportStats::Summary() const
+{
+    std::vector<std::string> lines;
+    char line[512];
+    
+    // phases that took no measurable time are left out
+    int length = snprintf(line, sizeof line, "Time: %.3f s total", TotalSeconds());
+    for (unsigned phase = 0; phase < kPhaseCount; ++phase) {
+        if (seconds_[phase] >= 0.0005 && length < (int)sizeof line) {
+            length += snprintf(line + length, sizeof line - length, ", %s %.3f s",
+                               PhaseName(static_cast<Phase>(phase)), seconds_[phase]);
+        }
+    }
+    lines.push_back(line);
+    
+    uint64_t inserted = dedup_hits + dedup_misses;
+    snprintf(line, sizeof line, "Polygons: %llu visited, %llu skipped; dedup: %llu hits (%llu welded), %llu misses (%.1f%% shared)",
+             (unsigned long long)polygons_visited, (unsigned long long)polygons_skipped,
+             (unsigned long long)dedup_hits, (unsigned long long)dedup_welded, (unsigned long long)dedup_misses,
+             inserted > 0 ? 100.0 * dedup_hits / inserted : 0.0);
+    lines.push_back(line);
+    
+    snprintf(line, sizeof line, "Memory: largest dedup set %llu entries, dedup sets peak %.1f MB, process peak %.1f MB",
+             (unsigned long long)dedup_peak_entries, dedup_peak_bytes / (1024.0 * 1024.0),
+             peak_rss / (1024.0 * 1024.0));
+    lines.push_back(line);
+    
+    snprintf(line, sizeof line, "Output: %llu bytes JSON, %llu bytes binary",
+             (unsigned long long)json_bytes, (unsigned long long)binary_bytes);
+    lines.push_back(line);
+    
+    return lines;
+}
+
+void ExportStats::Write(JSONFormat& json) const
+{
+    json.StartObject("seconds");
+    json.Property("total", TotalSeconds());
+    for (unsigned phase = 0; phase < kPhaseCount; ++phase) {
+        json.Property(PhaseName(static_cast<Phase>(phase)), seconds_[phase]);
+    }
+    json.EndObject();
+    
+    json.StartObject("polygons");
+    json.Property("visited", (unsigned long long)polygons_visited);
+    json.Property("skipped", (unsigned long long)polygons_skipped);
+    json.EndObject();
+    
+    json.StartObject("dedup");
+    json.Property("hits", (unsigned long long)dedup_hits);
+    json.Property("misses", (unsigned long long)dedup_misses);
+    json.Property("welded", (unsigned long long)dedup_welded);
+    json.Property("peakEntries", (unsigned long long)dedup_peak_entries);
+    json.Property("peakBytes", (unsigned long long)dedup_peak_bytes);
+    json.EndObject();
+    
+    json.StartObject("bytes");
+    json.Property("json", (unsigned long long)json_bytes);
+    json.Property("binary", (unsigned long long)binary_bytes);
+    json.EndObject();
+    
+    json.Property("peakResidentBytes", (unsigned long long)peak_rss);
+}
+
+uint64_t PeakResidentBytes()
+{
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    
+#ifdef __APPLE__
+    return static_cast<uint64_t>(usage.ru_maxrss); // bytes
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024; // kilobytes
+#endif
+#endif
+}
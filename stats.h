@@ -0,0 +1,104 @@
+#ifndef __threeio__stats__
+#define __threeio__stats__
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class JSONFormat;
+
+/*
+ * Wall time and counters of one save. Time is attributed to one phase at a
+ * time: a PhaseTimer pauses the phase it interrupts, so nested phases are
+ * not counted twice and all phases add up to the total. Timers and counters
+ * belong to the saver's thread, work on other threads is accounted to the
+ * phase that waits for it.
+ */
+class ExportStats
+{
+public:
+    enum Phase {
+        kPhaseOther,
+        kPhaseMaterials,
+        kPhaseShaderTree,
+        kPhaseMeshInfo,
+        kPhasePolygons,
+        kPhaseGeometries,
+        kPhaseBuild,
+        kPhaseEncode,
+        kPhaseScene,
+        kPhaseBuffers,
+        kPhaseCount
+    };
+    
+    static const char* PhaseName(Phase);
+    
+    // clears everything and starts the clock in kPhaseOther
+    void Start();
+    void Stop();
+    
+    double Seconds(Phase) const;
+    double TotalSeconds() const;
+    
+    uint64_t polygons_visited = 0;
+    uint64_t polygons_skipped = 0;     // fewer than 3 corners
+    uint64_t dedup_hits = 0;           // values already in a geometry
+    uint64_t dedup_misses = 0;         // values added to a geometry
+    uint64_t dedup_welded = 0;         // hits on a value within tolerance
+    uint64_t dedup_peak_entries = 0;   // largest single dedup set
+    uint64_t dedup_peak_bytes = 0;     // dedup sets of a batch, together
+    uint64_t json_bytes = 0;
+    uint64_t binary_bytes = 0;
+    uint64_t peak_rss = 0;             // bytes, 0 if not available
+    
+    // a few lines for the export log
+    std::vector<std::string> Summary() const;
+    
+    // an object with the same numbers, for the stats file
+    void Write(JSONFormat&) const;
+    
+private:
+    
+    friend class PhaseTimer;
+    
+    typedef std::chrono::steady_clock Clock;
+    
+    Phase current_ = kPhaseOther;
+    bool running_ = false;
+    Clock::time_point start_;
+    Clock::time_point mark_;
+    double seconds_[kPhaseCount] = {};
+    double total_ = 0;
+    
+    // accounts the time since the last switch to the current phase
+    void Switch(Phase);
+};
+
+// Attributes the time until it goes out of scope to a phase.
+class PhaseTimer
+{
+public:
+    PhaseTimer(ExportStats& stats, ExportStats::Phase phase) : stats_(stats), previous_(stats.current_)
+    {
+        stats_.Switch(phase);
+    }
+    
+    ~PhaseTimer()
+    {
+        stats_.Switch(previous_);
+    }
+    
+private:
+    
+    ExportStats& stats_;
+    ExportStats::Phase previous_;
+    
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+};
+
+// Peak resident memory of the process in bytes, 0 if not available.
+uint64_t PeakResidentBytes();
+
+#endif // /* defined(__threeio__stats__) */
@@ -0,0 +1,175 @@
+#include "triangulate.h"
+
+#include <cmath>
+
+namespace {
+
+double Cross(const Point2& a, const Point2& b, const Point2& c)
+{
+    return (b.u - a.u) * (c.v - a.v) - (b.v - a.v) * (c.u - a.u);
+}
+
+bool InTriangle(const Point2& p, const Point2& a, const Point2& b, const Point2& c)
+{
+    return Cross(a, b, p) >= 0 && Cross(b, c, p) >= 0 && Cross(c, a, p) >= 0;
+}
+
+/*
+ * Projects the polygon onto the axis plane its Newell normal is closest
+ * to, oriented so that it winds counter clockwise, writing one point per
+ * corner to projected. Returns false for polygons without area.
+ */
+bool Project(const std::vector<Vector3>& points, Point2* projected)
+{
+    double normal[3] = { 0, 0, 0 };
+    
+    for (size_t i = 0; i < points.size(); ++i) {
+        const Vector3& a = points[i];
+        const Vector3& b = points[(i + 1) % points.size()];
+        
+        normal[0] += (a.y - b.y) * (a.z + b.z);
+        normal[1] += (a.z - b.z) * (a.x + b.x);
+        normal[2] += (a.x - b.x) * (a.y + b.y);
+    }
+    
+    unsigned axis = 0;
+    for (unsigned i = 1; i < 3; ++i) {
+        if (std::fabs(normal[i]) > std::fabs(normal[axis])) {
+            axis = i;
+        }
+    }
+    
+    if (normal[axis] == 0) {
+        return false;
+    }
+    
+    // the remaining two axes in cyclic order keep the winding for a
+    // positive normal, swapping them flips it
+    bool flip = normal[axis] < 0;
+    
+    for (const Vector3& p : points) {
+        double c[3] = { p.x, p.y, p.z };
+        double u = c[(axis + 1) % 3];
+        double v = c[(axis + 2) % 3];
+        
+        *projected++ = flip ? Point2{ v, u } : Point2{ u, v };
+    }
+    
+    return true;
+}
+
+bool IsConvex(const Point2* points, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        if (Cross(points[(i + count - 1) % count], points[i], points[(i + 1) % count]) < 0) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+void Fan(size_t count, std::vector<unsigned>& triangles)
+{
+    for (unsigned i = 1; i + 1 < count; ++i) {
+        triangles.push_back(0);
+        triangles.push_back(i);
+        triangles.push_back(i + 1);
+    }
+}
+
+}
+
+bool IsConvexQuad(const std::vector<Vector3>& points)
+{
+    Point2 projected[4];
+    
+    if (points.size() != 4 || !Project(points, projected)) {
+        // nothing to choose between for degenerate quads
+        return points.size() == 4;
+    }
+    
+    return IsConvex(projected, 4);
+}
+
+unsigned Triangulate(const std::vector<Vector3>& points, std::vector<unsigned>& triangles,
+                     TriangulateScratch& scratch)
+{
+    size_t count = points.size();
+    if (count < 3) {
+        return 0;
+    }
+    
+    std::vector<Point2>& projected = scratch.projected;
+    projected.resize(count);
+    
+    if (count == 3 || !Project(points, projected.data()) || (count == 4 && IsConvex(projected.data(), 4))) {
+        Fan(count, triangles);
+        return static_cast<unsigned>(count - 2);
+    }
+    
+    // corners not clipped yet
+    std::vector<unsigned>& remaining = scratch.remaining;
+    remaining.clear();
+    for (unsigned i = 0; i < count; ++i) {
+        remaining.push_back(i);
+    }
+    
+    while (remaining.size() > 3) {
+        size_t size = remaining.size();
+        size_t ear = size;
+        
+        for (size_t i = 0; i < size && ear == size; ++i) {
+            const Point2& a = projected[remaining[(i + size - 1) % size]];
+            const Point2& b = projected[remaining[i]];
+            const Point2& c = projected[remaining[(i + 1) % size]];
+            
+            // reflex or degenerate corner
+            if (Cross(a, b, c) <= 0) {
+                continue;
+            }
+            
+            // an ear must not contain any other corner, only reflex corners
+            // can lie inside of it
+            bool empty = true;
+            for (size_t j = 0; j < size && empty; ++j) {
+                if (j == i || j == (i + size - 1) % size || j == (i + 1) % size) {
+                    continue;
+                }
+                
+                const Point2& p = projected[remaining[j]];
+                const Point2& prev = projected[remaining[(j + size - 1) % size]];
+                const Point2& next = projected[remaining[(j + 1) % size]];
+                
+                if (Cross(prev, p, next) <= 0 && InTriangle(p, a, b, c)) {
+                    // corners shared with the ear, e.g. of duplicate points,
+                    // do not block it
+                    empty = (p.u == a.u && p.v == a.v) || (p.u == b.u && p.v == b.v) ||
+                            (p.u == c.u && p.v == c.v);
+                }
+            }
+            
+            if (empty) {
+                ear = i;
+            }
+        }
+        
+        // self intersecting or numerically degenerate polygons may have no
+        // proper ear left, clip the first corner to make progress
+        if (ear == size) {
+            ear = 0;
+        }
+        
+        triangles.push_back(remaining[(ear + size - 1) % size]);
+        triangles.push_back(remaining[ear]);
+        triangles.push_back(remaining[(ear + 1) % size]);
+        
+        remaining.erase(remaining.begin() + ear);
+    }
+    
+    triangles.push_back(remaining[0]);
+    triangles.push_back(remaining[1]);
+    triangles.push_back(remaining[2]);
+    
+    return static_cast<unsigned>(count - 2);
+}
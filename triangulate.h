@@ -0,0 +1,28 @@
+#ifndef __threeio__triangulate__
+#define __threeio__triangulate__
+
+#include <vector>
+
+#include "types.h"
+
+struct Point2 {
+    double u, v;
+};
+
+// Storage Triangulate works in, kept by the caller so that its capacity
+// carries over from one polygon to the next.
+struct TriangulateScratch {
+    std::vector<Point2> projected;
+    std::vector<unsigned> remaining;
+};
+
+// Whether a planar quad can be split along either diagonal.
+bool IsConvexQuad(const std::vector<Vector3>& points);
+
+// Splits a polygon into triangles, appending their corners as indices into
+// points. Convex quads are split into a fan, everything else is ear
+// clipped on the plane of the polygon. Returns the number of triangles.
+unsigned Triangulate(const std::vector<Vector3>& points, std::vector<unsigned>& triangles,
+                     TriangulateScratch& scratch);
+
+#endif // /* defined(__threeio__triangulate__) */
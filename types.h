@@ -9,12 +9,40 @@
 #ifndef __threeio__types__
 #define __threeio__types__
 
+#include <algorithm>
+#include <cmath>
 #include <vector>
 #include <map>
+#include <string>
+#include <cstdint>
+#include <cstring>
 
 #include <lx_mesh.hpp>
 #include <lx_visitor.hpp>
 
+// Hashing works on the bit patterns of the components, so it agrees
+// with the exact comparisons below. Adding 0.0 folds -0.0 into 0.0,
+// which compare equal.
+inline uint64_t HashBits(double v)
+{
+    v += 0.0;
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof bits);
+    return bits;
+}
+
+inline uint64_t HashCombine(uint64_t seed, uint64_t v)
+{
+    // 64 bit finalizer of MurmurHash3
+    v ^= seed + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+    v ^= v >> 33;
+    v *= 0xff51afd7ed558ccdULL;
+    v ^= v >> 33;
+    v *= 0xc4ceb9fe1a85ec53ULL;
+    v ^= v >> 33;
+    return v;
+}
+
 struct Vector2
 {
     Vector2(float x, float y) : x(x), y(y) {
@@ -23,13 +51,13 @@ struct Vector2
     Vector2(float v[2]) : x(v[0]), y(v[1]) {
     }
     
-    bool operator==(const Vector2& rhs)
+    bool operator==(const Vector2& rhs) const
     {
         return (x == rhs.x &&
                 y == rhs.y);
     }
     
-    bool operator!=(const Vector2& rhs)
+    bool operator!=(const Vector2& rhs) const
     {
         return !(*this == rhs);
     }
@@ -45,6 +73,11 @@ struct Vector2
         return false;
     }
     
+    uint64_t hash() const
+    {
+        return HashCombine(HashBits(x), HashBits(y));
+    }
+    
     const float x, y;
 };
 
@@ -56,14 +89,14 @@ struct Vector3
     Vector3(double v[3]) : x(v[0]), y(v[1]), z(v[2]) {
     }
     
-    bool operator==(const Vector3& rhs)
+    bool operator==(const Vector3& rhs) const
     {
         return (x == rhs.x &&
                 y == rhs.y &&
                 z == rhs.z);
     }
     
-    bool operator!=(const Vector3& rhs)
+    bool operator!=(const Vector3& rhs) const
     {
         return !(*this == rhs);
     }
@@ -82,80 +115,448 @@ struct Vector3
         return false;
     }
     
+    uint64_t hash() const
+    {
+        return HashCombine(HashCombine(HashBits(x), HashBits(y)), HashBits(z));
+    }
+    
     const double x, y, z;
 };
 
+// Attributes a packed vertex record holds besides its position. Records
+// only store the attributes that are saved.
+enum VertexLayout {
+    kVertexPositions = 0,
+    kVertexNormals = 1,
+    kVertexUVs = 2,
+    kVertexAll = kVertexNormals | kVertexUVs
+};
+
+inline unsigned VertexFloats(unsigned layout)
+{
+    return 3 + ((layout & kVertexNormals) ? 3 : 0) + ((layout & kVertexUVs) ? 2 : 0);
+}
+
+// Bit pattern of a float, -0.0f folded into 0.0f like HashBits.
+inline uint32_t FloatBits(float v)
+{
+    v += 0.0f;
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof bits);
+    return bits;
+}
+
+// Hashes the floats of a record two at a time.
+inline uint64_t HashFloats(const float* values, unsigned count)
+{
+    uint64_t hash = count;
+    unsigned i = 0;
+    for (; i + 1 < count; i += 2) {
+        hash = HashCombine(hash, FloatBits(values[i]) | (uint64_t(FloatBits(values[i + 1])) << 32));
+    }
+    if (i < count) {
+        hash = HashCombine(hash, FloatBits(values[i]));
+    }
+    return hash;
+}
+
+// A BufferGeometry vertex in the Float32 precision its attributes are
+// written with: position, normal and uv, 32 bytes.
 struct Vertex {
-    Vertex(double p[3], double n[3], float uv[2]) : position_(p), normal_(n), uv_(uv) {
+    Vertex(double p[3], double n[3], float uv[2])
+    : data_{ float(p[0]), float(p[1]), float(p[2]), float(n[0]), float(n[1]), float(n[2]), uv[0], uv[1] } {
+    }
+    
+    // from a packed record, attributes it does not hold are 0
+    Vertex(const float* record, unsigned layout) : data_{ record[0], record[1], record[2], 0, 0, 0, 0, 0 } {
+        const float* attribute = record + 3;
+        if (layout & kVertexNormals) {
+            std::copy(attribute, attribute + 3, data_ + 3);
+            attribute += 3;
+        }
+        if (layout & kVertexUVs) {
+            std::copy(attribute, attribute + 2, data_ + 6);
+        }
     }
     
-    bool operator==(const Vertex& rhs)
+    bool operator==(const Vertex& rhs) const
     {
-        return position_ == rhs.position() &&
-               normal_ == rhs.normal() &&
-               uv_ == rhs.uv();
+        for (unsigned i = 0; i < 8; ++i) {
+            if (data_[i] != rhs.data_[i]) {
+                return false;
+            }
+        }
+        return true;
     }
     
-    bool operator!=(const Vertex& rhs)
+    bool operator!=(const Vertex& rhs) const
     {
         return !(*this == rhs);
     }
     
     bool operator<(const Vertex& rhs) const
     {
-        if (position_ < rhs.position()) {
-            return true;
+        return std::lexicographical_compare(data_, data_ + 8, rhs.data_, rhs.data_ + 8);
+    }
+    
+    uint64_t hash() const
+    {
+        return HashFloats(data_, 8);
+    }
+    
+    // writes the attributes of layout to a record of VertexFloats(layout)
+    void Pack(float* record, unsigned layout) const
+    {
+        record = std::copy(data_, data_ + 3, record);
+        if (layout & kVertexNormals) {
+            record = std::copy(data_ + 3, data_ + 6, record);
         }
+        if (layout & kVertexUVs) {
+            std::copy(data_ + 6, data_ + 8, record);
+        }
+    }
+    
+    const Vector3 position() const {
+        return Vector3(data_[0], data_[1], data_[2]);
+    }
+    
+    const Vector3 normal() const {
+        return Vector3(data_[3], data_[4], data_[5]);
+    }
+    
+    const Vector2 uv() const {
+        return Vector2(data_[6], data_[7]);
+    }
+    
+private:
+    float data_[8];
+};
+
+// Hashing and comparison of the packed records of one layout, with the
+// record size known at compile time.
+template <unsigned Layout>
+struct VertexKey {
+    static const unsigned kFloats = 3 + ((Layout & kVertexNormals) ? 3 : 0) + ((Layout & kVertexUVs) ? 2 : 0);
+    
+    static uint64_t Hash(const float* record)
+    {
+        return HashFloats(record, kFloats);
+    }
+    
+    static bool Equal(const float* a, const float* b)
+    {
+        for (unsigned i = 0; i < kFloats; ++i) {
+            if (a[i] != b[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Vertex records of one layout, back to back in a single Float32 array.
+class VertexArray {
+public:
+    explicit VertexArray(unsigned layout = kVertexAll) : layout_(layout), stride_(VertexFloats(layout)) {
+    }
+    
+    unsigned layout() const { return layout_; }
+    
+    void push_back(const Vertex& vertex) {
+        size_t at = data_.size();
+        data_.resize(at + stride_);
+        vertex.Pack(&data_[at], layout_);
+    }
+    
+    void push_back(const float* record) {
+        data_.insert(data_.end(), record, record + stride_);
+    }
+    
+    void reserve(size_t count) {
+        data_.reserve(count * stride_);
+    }
+    
+    void clear() {
+        data_.clear();
+    }
+    
+    bool empty() const { return data_.empty(); }
+    size_t size() const { return data_.size() / stride_; }
+    Vertex operator[](size_t index) const { return Vertex(record(index), layout_); }
+    const float* record(size_t index) const { return &data_[index * stride_]; }
+    
+    size_t bytes() const {
+        return data_.capacity() * sizeof(float);
+    }
+    
+    // iterates Vertex values, unpacked on the fly
+    class const_iterator {
+    public:
+        const_iterator(const VertexArray* array, size_t index) : array_(array), index_(index) {
+        }
+        
+        Vertex operator*() const { return (*array_)[index_]; }
+        const_iterator& operator++() { ++index_; return *this; }
+        bool operator==(const const_iterator& rhs) const { return index_ == rhs.index_; }
+        bool operator!=(const const_iterator& rhs) const { return index_ != rhs.index_; }
+        
+    private:
+        const VertexArray* array_;
+        size_t index_;
+    };
+    
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, size()); }
+    
+private:
+    
+    unsigned layout_;
+    unsigned stride_;
+    std::vector<float> data_;
+};
+
+/*
+ * Assigns each distinct vertex record the index of its first insertion,
+ * like UniqueOrderedHashSet, over a VertexArray. The slots only hold 32
+ * bit indices into the array, so a vertex is stored once and in the size
+ * of its layout. Inserting dispatches on the layout once and then hashes
+ * and compares records of a size known at compile time.
+ */
+class VertexHashSet {
+public:
+    explicit VertexHashSet(unsigned layout = kVertexAll) : values_(layout) {
+    }
+    
+    unsigned layout() const { return values_.layout(); }
+    
+    unsigned insert(const Vertex& vertex) {
+        float record[8];
+        vertex.Pack(record, layout());
         
-        if (normal_ < rhs.normal()) {
-            return true;
+        switch (layout()) {
+            case kVertexPositions: return Insert<kVertexPositions>(record);
+            case kVertexNormals: return Insert<kVertexNormals>(record);
+            case kVertexUVs: return Insert<kVertexUVs>(record);
+            default: return Insert<kVertexAll>(record);
         }
+    }
+    
+    // inserts the records of values, which must have the same layout,
+    // and appends their indices
+    void insert(const VertexArray& values, std::vector<unsigned>& indices) {
+        switch (layout()) {
+            case kVertexPositions: InsertAll<kVertexPositions>(values, indices); break;
+            case kVertexNormals: InsertAll<kVertexNormals>(values, indices); break;
+            case kVertexUVs: InsertAll<kVertexUVs>(values, indices); break;
+            default: InsertAll<kVertexAll>(values, indices); break;
+        }
+    }
+    
+    // Sizes the index for count values, to avoid rehashing while inserting.
+    void reserve(size_t count) {
+        values_.reserve(count);
         
-        if (uv_ < rhs.uv()) {
-            return true;
+        size_t slots = kMinSlots;
+        while (slots < count * 2) {
+            slots *= 2;
         }
         
-        return false;
+        if (slots > slots_.size()) {
+            slots_.resize(slots);
+            Rehash();
+        }
     }
     
-    const Vector3 position() const {
-        return position_;
+    void clear() {
+        slots_.clear();
+        values_.clear();
     }
     
-    const Vector3 normal() const {
-        return normal_;
+    size_t size() const { return values_.size(); }
+    Vertex operator[](size_t index) const { return values_[index]; }
+    const VertexArray& values() const { return values_; }
+    
+    // memory held by values and index
+    size_t bytes() const {
+        return values_.bytes() + slots_.capacity() * sizeof(unsigned);
     }
     
-    const Vector2 uv() const {
-        return uv_;
+    typedef VertexArray::const_iterator const_iterator;
+    
+    const_iterator begin() const { return values_.begin(); }
+    const_iterator end() const { return values_.end(); }
+    
+private:
+    
+    static const unsigned kEmpty = ~0u;
+    static const size_t kMinSlots = 64;
+    
+    std::vector<unsigned> slots_;
+    VertexArray values_;
+    
+    template <unsigned Layout>
+    unsigned Insert(const float* record) {
+        typedef VertexKey<Layout> Key;
+        
+        if ((values_.size() + 1) * 2 > slots_.size()) {
+            slots_.resize(slots_.empty() ? kMinSlots : slots_.size() * 2);
+            Rehash();
+        }
+        
+        size_t mask = slots_.size() - 1;
+        size_t i = Key::Hash(record) & mask;
+        while (true) {
+            unsigned index = slots_[i];
+            if (index == kEmpty) {
+                index = (unsigned)values_.size();
+                slots_[i] = index;
+                values_.push_back(record);
+                return index;
+            }
+            
+            if (Key::Equal(values_.record(index), record)) {
+                return index;
+            }
+            
+            i = (i + 1) & mask;
+        }
+    }
+    
+    template <unsigned Layout>
+    void InsertAll(const VertexArray& values, std::vector<unsigned>& indices) {
+        for (size_t i = 0; i < values.size(); ++i) {
+            indices.push_back(Insert<Layout>(values.record(i)));
+        }
+    }
+    
+    // slot count must be a power of two
+    void Rehash() {
+        slots_.assign(slots_.size(), static_cast<unsigned>(kEmpty));
+        
+        size_t mask = slots_.size() - 1;
+        unsigned floats = VertexFloats(layout());
+        for (unsigned index = 0; index < values_.size(); ++index) {
+            size_t i = HashFloats(values_.record(index), floats) & mask;
+            while (slots_[i] != kEmpty) {
+                i = (i + 1) & mask;
+            }
+            slots_[i] = index;
+        }
+    }
+};
+
+// The std::map based index of vertex records, like UniqueOrderedMap. Keys
+// are the records unpacked, with the attributes the layout lacks at 0.
+class VertexMap {
+public:
+    explicit VertexMap(unsigned layout = kVertexAll) : values_(layout) {
+    }
+    
+    unsigned layout() const { return values_.layout(); }
+    
+    unsigned insert(const Vertex& vertex) {
+        float record[8];
+        vertex.Pack(record, layout());
+        return Insert(record);
+    }
+    
+    // inserts the records of values, which must have the same layout,
+    // and appends their indices
+    void insert(const VertexArray& values, std::vector<unsigned>& indices) {
+        for (size_t i = 0; i < values.size(); ++i) {
+            indices.push_back(Insert(values.record(i)));
+        }
+    }
+    
+    void reserve(size_t count) {
+        values_.reserve(count);
+    }
+    
+    void clear() {
+        map_.clear();
+        values_.clear();
     }
     
+    size_t size() const { return values_.size(); }
+    Vertex operator[](size_t index) const { return values_[index]; }
+    const VertexArray& values() const { return values_; }
+    
+    // memory held, estimating a tree node as the entry and four words
+    size_t bytes() const {
+        return (values_.bytes() +
+                map_.size() * (sizeof(std::map<Vertex, unsigned>::value_type) + 4 * sizeof(void*)));
+    }
+    
+    typedef VertexArray::const_iterator const_iterator;
+    
+    const_iterator begin() const { return values_.begin(); }
+    const_iterator end() const { return values_.end(); }
+    
 private:
-    Vector3 position_;
-    Vector3 normal_;
-    Vector2 uv_;
+    
+    std::map<Vertex, unsigned> map_;
+    VertexArray values_;
+    
+    unsigned Insert(const float* record) {
+        Vertex key(record, layout());
+        
+        auto iter = map_.find(key);
+        if (iter != map_.end()) {
+            return iter->second;
+        }
+        
+        unsigned index = (unsigned)values_.size();
+        map_.insert(std::make_pair(key, index));
+        values_.push_back(record);
+        return index;
+    }
 };
 
+// BufferGeometry vertex dedup, std::map based with THREEIO_DEDUP_STD_MAP
+// like UniqueOrderedSet
+#ifdef THREEIO_DEDUP_STD_MAP
+typedef VertexMap VertexSet;
+#else
+typedef VertexHashSet VertexSet;
+#endif
+
+// Assigns each distinct value the index of its first insertion and keeps
+// the values in that order. Two interchangeable indexes are available:
+// UniqueOrderedHashSet (default) and the std::map based UniqueOrderedMap,
+// selected by defining THREEIO_DEDUP_STD_MAP.
 template <class T>
-struct UniqueOrderedSet {
+struct UniqueOrderedMap {
 public:
-    unsigned insert(T vector) {
-        auto iter = map_.find(vector);
+    unsigned insert(const T& value) {
+        auto iter = map_.find(value);
         if (iter != map_.end()) {
             return iter->second;
         } else {
-            map_[vector] = index_;
-            order_.push_back(vector);
+            map_.insert(std::make_pair(value, index_));
+            order_.push_back(value);
             return index_++;
         }
     }
     
+    void reserve(size_t count) {
+        order_.reserve(count);
+    }
+    
     void clear() {
         map_.clear();
         order_.clear();
         index_ = 0;
     }
     
+    size_t size() const { return order_.size(); }
+    const T& operator[](size_t index) const { return order_[index]; }
+    
+    // memory held, estimating a tree node as the entry and four words
+    size_t bytes() const {
+        return (order_.capacity() * sizeof(T) +
+                map_.size() * (sizeof(typename std::map<T, unsigned>::value_type) + 4 * sizeof(void*)));
+    }
+    
     typedef typename std::vector<T>::iterator iterator;
     typedef typename std::vector<T>::const_iterator const_iterator;
     
@@ -169,10 +570,295 @@ public:
 private:
     
     std::map<T, unsigned> map_;
-    std::vector<T> order_; // TODO: disposed?
+    std::vector<T> order_;
     unsigned index_ = 0;
 };
 
+// Open addressing (linear probing) hash index over a contiguous value
+// array. Slots only hold indices into order_, so each value is stored once.
+template <class T>
+struct UniqueOrderedHashSet {
+public:
+    unsigned insert(const T& value) {
+        if ((order_.size() + 1) * 2 > slots_.size()) {
+            rehash(slots_.empty() ? kMinSlots : slots_.size() * 2);
+        }
+        
+        size_t mask = slots_.size() - 1;
+        size_t i = value.hash() & mask;
+        while (true) {
+            unsigned index = slots_[i];
+            if (index == kEmpty) {
+                index = (unsigned)order_.size();
+                slots_[i] = index;
+                order_.push_back(value);
+                return index;
+            }
+            
+            if (order_[index] == value) {
+                return index;
+            }
+            
+            i = (i + 1) & mask;
+        }
+    }
+    
+    // Sizes the index for count values, to avoid rehashing while inserting.
+    void reserve(size_t count) {
+        order_.reserve(count);
+        
+        size_t slots = kMinSlots;
+        while (slots < count * 2) {
+            slots *= 2;
+        }
+        
+        if (slots > slots_.size()) {
+            rehash(slots);
+        }
+    }
+    
+    void clear() {
+        slots_.clear();
+        order_.clear();
+    }
+    
+    size_t size() const { return order_.size(); }
+    const T& operator[](size_t index) const { return order_[index]; }
+    
+    // memory held by values and index
+    size_t bytes() const {
+        return order_.capacity() * sizeof(T) + slots_.capacity() * sizeof(unsigned);
+    }
+    
+    typedef typename std::vector<T>::iterator iterator;
+    typedef typename std::vector<T>::const_iterator const_iterator;
+    
+    iterator begin() { return order_.begin(); }
+    const_iterator begin() const { return order_.begin(); }
+    const_iterator cbegin() const { return order_.cbegin(); }
+    iterator end() { return order_.end(); }
+    const_iterator end() const { return order_.end(); }
+    const_iterator cend() const { return order_.cend(); }
+    
+private:
+    
+    static const unsigned kEmpty = ~0u;
+    static const size_t kMinSlots = 64;
+    
+    std::vector<unsigned> slots_;
+    std::vector<T> order_;
+    
+    // slot count must be a power of two
+    void rehash(size_t count) {
+        slots_.assign(count, static_cast<unsigned>(kEmpty));
+        
+        size_t mask = count - 1;
+        for (unsigned index = 0; index < order_.size(); ++index) {
+            size_t i = order_[index].hash() & mask;
+            while (slots_[i] != kEmpty) {
+                i = (i + 1) & mask;
+            }
+            slots_[i] = index;
+        }
+    }
+};
+
+#ifdef THREEIO_DEDUP_STD_MAP
+template <class T>
+using UniqueOrderedSet = UniqueOrderedMap<T>;
+#else
+template <class T>
+using UniqueOrderedSet = UniqueOrderedHashSet<T>;
+#endif
+
+// Axis aligned bounding box and bounding sphere of a geometry's positions,
+// written so that three.js does not compute them on load.
+struct Bounds {
+    bool empty = true;
+    double min[3] = { 0, 0, 0 };
+    double max[3] = { 0, 0, 0 };
+    double center[3] = { 0, 0, 0 };
+    double radius = 0;
+};
+
+inline Vector3 PositionOf(const Vector3& position)
+{
+    return position;
+}
+
+inline Vector3 PositionOf(const Vertex& vertex)
+{
+    return vertex.position();
+}
+
+/*
+ * Two passes over the points: the box and the extreme points along each
+ * axis, then Ritter's sphere grown from the most distant pair of extremes.
+ * The sphere around the box center, which three.js would compute, is
+ * used instead when it is tighter.
+ */
+template <class Points>
+Bounds ComputeBounds(const Points& points)
+{
+    Bounds bounds;
+    
+    auto begin = points.begin();
+    if (begin == points.end()) {
+        return bounds;
+    }
+    
+    bounds.empty = false;
+    
+    Vector3 first = PositionOf(*begin);
+    double lo[3][3], hi[3][3]; // extreme points along each axis
+    
+    for (unsigned axis = 0; axis < 3; ++axis) {
+        lo[axis][0] = hi[axis][0] = first.x;
+        lo[axis][1] = hi[axis][1] = first.y;
+        lo[axis][2] = hi[axis][2] = first.z;
+    }
+    
+    for (const auto& point : points) {
+        Vector3 position = PositionOf(point);
+        double p[3] = { position.x, position.y, position.z };
+        
+        for (unsigned axis = 0; axis < 3; ++axis) {
+            if (p[axis] < lo[axis][axis]) {
+                std::copy(p, p + 3, lo[axis]);
+            }
+            if (p[axis] > hi[axis][axis]) {
+                std::copy(p, p + 3, hi[axis]);
+            }
+        }
+    }
+    
+    auto distance2 = [](const double* a, const double* b) {
+        double dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+        return dx * dx + dy * dy + dz * dz;
+    };
+    
+    unsigned widest = 0;
+    for (unsigned axis = 0; axis < 3; ++axis) {
+        bounds.min[axis] = lo[axis][axis];
+        bounds.max[axis] = hi[axis][axis];
+        
+        if (distance2(lo[axis], hi[axis]) > distance2(lo[widest], hi[widest])) {
+            widest = axis;
+        }
+    }
+    
+    double center[3];
+    double box_center[3];
+    for (unsigned i = 0; i < 3; ++i) {
+        center[i] = (lo[widest][i] + hi[widest][i]) / 2;
+        box_center[i] = (bounds.min[i] + bounds.max[i]) / 2;
+    }
+    
+    double radius2 = distance2(center, hi[widest]);
+    double radius = std::sqrt(radius2);
+    double box_radius2 = 0;
+    
+    for (const auto& point : points) {
+        Vector3 position = PositionOf(point);
+        double p[3] = { position.x, position.y, position.z };
+        
+        box_radius2 = std::max(box_radius2, distance2(box_center, p));
+        
+        double d2 = distance2(center, p);
+        if (d2 > radius2) {
+            // move the sphere towards the point until it is on the surface
+            double d = std::sqrt(d2);
+            double grown = (radius + d) / 2;
+            double shift = (grown - radius) / d;
+            
+            for (unsigned i = 0; i < 3; ++i) {
+                center[i] += (p[i] - center[i]) * shift;
+            }
+            
+            radius = grown;
+            radius2 = radius * radius;
+        }
+    }
+    
+    double box_radius = std::sqrt(box_radius2);
+    if (box_radius <= radius) {
+        std::copy(box_center, box_center + 3, bounds.center);
+        bounds.radius = box_radius;
+    } else {
+        std::copy(center, center + 3, bounds.center);
+        bounds.radius = radius;
+    }
+    
+    return bounds;
+}
+
+// Face data as read from the mesh, in visiting order and not yet
+// deduplicated. Recording it is the only part of the geometry export that
+// needs the SDK, the rest can run on worker threads.
+struct GeometrySnapshot {
+    // Geometry: type mask of each face, the values follow in the order
+    // the mask lists them
+    std::vector<unsigned> masks;
+    std::vector<Vector3> positions;
+    std::vector<Vector3> normals;
+    std::vector<Vector2> uvs;
+    
+    // BufferGeometry: triangle corners
+    VertexArray vertices;
+    
+    // expected number of distinct points, to size the dedup index
+    size_t points = 0;
+    
+    size_t bytes() const
+    {
+        return (masks.size() * sizeof(unsigned) +
+                (positions.size() + normals.size()) * sizeof(Vector3) +
+                uvs.size() * sizeof(Vector2) +
+                vertices.bytes());
+    }
+};
+
+// Geometry data of all polygons sharing one material tag. The polygon
+// visitor buckets each polygon into the snapshot of its tag, so a mesh is
+// traversed once no matter how many materials it uses.
+struct GeometryBuffer {
+    std::string uuid;
+    bool has_uvs = false;
+    GeometrySnapshot snapshot;
+    
+    UniqueOrderedSet<Vector3> positions;
+    UniqueOrderedSet<Vector3> normals;
+    UniqueOrderedSet<Vector2> uvs;
+    VertexSet vertices;
+    
+    // Geometry: face stream (type mask followed by its indices),
+    // BufferGeometry: triangle indices into vertices
+    std::vector<unsigned> indices;
+    
+    // values BuildGeometry passed to the dedup sets, and the memory the
+    // sets held afterwards
+    size_t dedup_inserts = 0;
+    size_t dedup_bytes = 0;
+    
+    // values merged with a different one within the weld tolerance
+    size_t dedup_welded = 0;
+    
+    size_t dedup_entries() const
+    {
+        return positions.size() + normals.size() + uvs.size() + vertices.size();
+    }
+    
+    Bounds bounds;
+    
+    // BufferGeometry attributes written as normalized integers, positions
+    // relative to their bounding box: offset + scale * q
+    bool quantize_positions = false;
+    double position_offset[3] = { 0, 0, 0 };
+    double position_scale = 1;
+    bool quantize_normals = false;
+    bool quantize_uvs = false;
+};
+
 class MeshMapVisitor : public CLxImpl_AbstractVisitor
 {
 public:
@@ -181,13 +867,13 @@ public:
         mesh_map_ = theMeshMap;
     }
     
-    const std::vector<const std::string> names() const {
+    const std::vector<std::string> names() const {
         return names_;
     }
     
 private:
     CLxUser_MeshMap *mesh_map_;
-    std::vector<const std::string> names_;
+    std::vector<std::string> names_;
     
     virtual LxResult Evaluate ()
     {
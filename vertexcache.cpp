@@ -0,0 +1,217 @@
+#include "vertexcache.h"
+
+#include <cmath>
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned>& indices, size_t vertex_count, unsigned cache_size)
+{
+    VertexCacheStats stats;
+    
+    if (indices.size() < 3 || vertex_count == 0) {
+        return stats;
+    }
+    
+    // a vertex is in the cache if it entered within the last cache_size misses
+    std::vector<size_t> entered(vertex_count, 0);
+    size_t misses = 0;
+    
+    for (unsigned index : indices) {
+        if (entered[index] == 0 || misses - entered[index] + 1 > cache_size) {
+            misses++;
+            entered[index] = misses;
+        }
+    }
+    
+    stats.acmr = double(misses) / double(indices.size() / 3);
+    stats.atvr = double(misses) / double(vertex_count);
+    
+    return stats;
+}
+
+// Scoring parameters from the paper, for a modelled LRU cache of 32.
+static const unsigned kCacheSize = 32;
+static const unsigned kMaxValence = 64;
+
+struct VertexScoreTable {
+    float cache[kCacheSize];
+    float valence[kMaxValence];
+    
+    VertexScoreTable()
+    {
+        const float kLastTriScore = 0.75f;
+        const float kCacheDecayPower = 1.5f;
+        const float kValenceBoostScale = 2.0f;
+        const float kValenceBoostPower = 0.5f;
+        
+        for (unsigned i = 0; i < kCacheSize; ++i) {
+            if (i < 3) {
+                // the last triangle's vertices get a fixed score, so no
+                // preference for the order they were used in
+                cache[i] = kLastTriScore;
+            } else {
+                float scaled = 1.0f - float(i - 3) / float(kCacheSize - 3);
+                cache[i] = std::pow(scaled, kCacheDecayPower);
+            }
+        }
+        
+        // boost vertices with few triangles left, to get rid of lone
+        // triangles early
+        valence[0] = 0.0f;
+        for (unsigned i = 1; i < kMaxValence; ++i) {
+            valence[i] = kValenceBoostScale * std::pow(float(i), -kValenceBoostPower);
+        }
+    }
+    
+    float score(int cache_position, unsigned live_triangles) const
+    {
+        if (live_triangles == 0) {
+            return -1.0f;
+        }
+        
+        float result = cache_position >= 0 ? cache[cache_position] : 0.0f;
+        return result + valence[live_triangles < kMaxValence ? live_triangles : kMaxValence - 1];
+    }
+};
+
+void OptimizeVertexCache(std::vector<unsigned>& indices, size_t vertex_count)
+{
+    static const VertexScoreTable table;
+    
+    size_t triangle_count = indices.size() / 3;
+    if (triangle_count < 2 || vertex_count == 0) {
+        return;
+    }
+    
+    // triangles of each vertex, the live ones first
+    std::vector<unsigned> live(vertex_count, 0);
+    for (size_t i = 0; i < triangle_count * 3; ++i) {
+        live[indices[i]]++;
+    }
+    
+    std::vector<unsigned> offsets(vertex_count + 1, 0);
+    for (size_t v = 0; v < vertex_count; ++v) {
+        offsets[v + 1] = offsets[v] + live[v];
+    }
+    
+    std::vector<unsigned> adjacency(triangle_count * 3);
+    {
+        std::vector<unsigned> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t t = 0; t < triangle_count; ++t) {
+            for (unsigned k = 0; k < 3; ++k) {
+                adjacency[fill[indices[t * 3 + k]]++] = static_cast<unsigned>(t);
+            }
+        }
+    }
+    
+    std::vector<int> cache_position(vertex_count, -1);
+    std::vector<float> vertex_score(vertex_count);
+    for (size_t v = 0; v < vertex_count; ++v) {
+        vertex_score[v] = table.score(-1, live[v]);
+    }
+    
+    std::vector<float> triangle_score(triangle_count);
+    std::vector<bool> emitted(triangle_count, false);
+    
+    size_t best = 0;
+    for (size_t t = 0; t < triangle_count; ++t) {
+        const unsigned* tri = &indices[t * 3];
+        triangle_score[t] = vertex_score[tri[0]] + vertex_score[tri[1]] + vertex_score[tri[2]];
+        
+        if (triangle_score[t] > triangle_score[best]) {
+            best = t;
+        }
+    }
+    
+    std::vector<unsigned> cache;
+    std::vector<unsigned> next_cache;
+    cache.reserve(kCacheSize + 3);
+    next_cache.reserve(kCacheSize + 3);
+    
+    std::vector<unsigned> output;
+    output.reserve(triangle_count * 3);
+    
+    size_t next_unemitted = 0;
+    
+    while (true) {
+        const unsigned* tri = &indices[best * 3];
+        
+        output.push_back(tri[0]);
+        output.push_back(tri[1]);
+        output.push_back(tri[2]);
+        emitted[best] = true;
+        
+        // retire the triangle from the live lists of its vertices
+        for (unsigned k = 0; k < 3; ++k) {
+            unsigned v = tri[k];
+            unsigned* list = &adjacency[offsets[v]];
+            
+            for (unsigned i = 0; i < live[v]; ++i) {
+                if (list[i] == best) {
+                    list[i] = list[live[v] - 1];
+                    list[live[v] - 1] = static_cast<unsigned>(best);
+                    break;
+                }
+            }
+            
+            live[v]--;
+        }
+        
+        // move the triangle's vertices to the front of the modelled cache
+        next_cache.clear();
+        next_cache.push_back(tri[0]);
+        next_cache.push_back(tri[1]);
+        next_cache.push_back(tri[2]);
+        for (unsigned v : cache) {
+            if (v != tri[0] && v != tri[1] && v != tri[2]) {
+                next_cache.push_back(v);
+            }
+        }
+        
+        for (unsigned i = 0; i < next_cache.size(); ++i) {
+            unsigned v = next_cache[i];
+            cache_position[v] = i < kCacheSize ? static_cast<int>(i) : -1;
+            vertex_score[v] = table.score(cache_position[v], live[v]);
+        }
+        
+        // rescore the live triangles around the cache, including the
+        // vertices that just dropped out of it, and pick the best
+        float best_score = -1.0f;
+        bool found = false;
+        for (unsigned v : next_cache) {
+            const unsigned* list = &adjacency[offsets[v]];
+            
+            for (unsigned i = 0; i < live[v]; ++i) {
+                unsigned t = list[i];
+                const unsigned* other = &indices[t * 3];
+                float score = vertex_score[other[0]] + vertex_score[other[1]] + vertex_score[other[2]];
+                triangle_score[t] = score;
+                
+                if (score > best_score) {
+                    best_score = score;
+                    best = t;
+                    found = true;
+                }
+            }
+        }
+        
+        if (next_cache.size() > kCacheSize) {
+            next_cache.resize(kCacheSize);
+        }
+        cache.swap(next_cache);
+        
+        // nothing connected to the cache, continue with the next triangle
+        // in input order
+        if (!found) {
+            while (next_unemitted < triangle_count && emitted[next_unemitted]) {
+                next_unemitted++;
+            }
+            
+            if (next_unemitted == triangle_count) {
+                break;
+            }
+            
+            best = next_unemitted;
+        }
+    }
+    
+    indices.swap(output);
+}
@@ -0,0 +1,24 @@
+#ifndef __threeio__vertex_cache__
+#define __threeio__vertex_cache__
+
+#include <cstddef>
+#include <vector>
+
+// Post-transform cache behaviour of an indexed triangle list, simulated
+// with a FIFO cache as found on most mobile GPUs.
+struct VertexCacheStats {
+    double acmr = 0; // transformed vertices per triangle, 0.5 at best
+    double atvr = 0; // transformed vertices per vertex, 1.0 at best
+};
+
+const unsigned kVertexCacheSimulationSize = 16;
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned>& indices, size_t vertex_count,
+                                    unsigned cache_size = kVertexCacheSimulationSize);
+
+// Reorders the triangles of an indexed triangle list for the post-transform
+// vertex cache, using Tom Forsyth's linear-speed optimization
+// (https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html).
+void OptimizeVertexCache(std::vector<unsigned>& indices, size_t vertex_count);
+
+#endif // /* defined(__threeio__vertex_cache__) */
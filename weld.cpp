@@ -0,0 +1,128 @@
+#include "weld.h"
+
+// cell size in multiples of the weld distance
+static const double kCellScale = 4;
+
+// keeps cell coordinates of far away or non-finite points representable
+static const double kMaxCell = 4611686018427387904.0; // 2^62
+
+WeldGrid::WeldGrid(double distance, int axes) : inverse_(distance > 0 ? 1 / (distance * kCellScale) : 0), axes_(axes)
+{
+}
+
+void WeldGrid::reserve(size_t count)
+{
+    next_.reserve(count);
+    
+    size_t cells = kMinCells;
+    while (cells < count * 2) {
+        cells *= 2;
+    }
+    
+    if (cells > cells_.size()) {
+        Rehash(cells);
+    }
+}
+
+void WeldGrid::Locate(const double p[3], int64_t base[3], int step[3]) const
+{
+    for (int axis = 0; axis < 3; ++axis) {
+        step[axis] = 0;
+        
+        if (axis >= axes_) {
+            base[axis] = 0;
+            continue;
+        }
+        
+        if (inverse_ == 0) {
+            base[axis] = static_cast<int64_t>(HashBits(p[axis]));
+            continue;
+        }
+        
+        double t = p[axis] * inverse_;
+        if (!(t > -kMaxCell)) {
+            t = t != t ? 0 : -kMaxCell;
+        } else if (t > kMaxCell) {
+            t = kMaxCell;
+        }
+        
+        double cell = std::floor(t);
+        double offset = (t - cell) * kCellScale; // in weld distances
+        
+        base[axis] = static_cast<int64_t>(cell);
+        if (offset <= 1) {
+            step[axis] = -1;
+        } else if (kCellScale - offset <= 1) {
+            step[axis] = 1;
+        }
+    }
+}
+
+unsigned WeldGrid::Head(int64_t x, int64_t y, int64_t z) const
+{
+    if (cells_.empty()) {
+        return kNone;
+    }
+    
+    size_t mask = cells_.size() - 1;
+    size_t i = HashCombine(HashCombine(x, y), z) & mask;
+    while (cells_[i].head != kNone) {
+        const Cell& cell = cells_[i];
+        if (cell.x == x && cell.y == y && cell.z == z) {
+            return cell.head;
+        }
+        
+        i = (i + 1) & mask;
+    }
+    
+    return kNone;
+}
+
+void WeldGrid::Add(const int64_t key[3], unsigned index)
+{
+    if ((used_ + 1) * 2 > cells_.size()) {
+        Rehash(cells_.empty() ? kMinCells : cells_.size() * 2);
+    }
+    
+    if (next_.size() <= index) {
+        next_.resize(index + 1, static_cast<unsigned>(kNone));
+    }
+    
+    size_t mask = cells_.size() - 1;
+    size_t i = HashCombine(HashCombine(key[0], key[1]), key[2]) & mask;
+    while (cells_[i].head != kNone) {
+        Cell& cell = cells_[i];
+        if (cell.x == key[0] && cell.y == key[1] && cell.z == key[2]) {
+            next_[index] = cell.head;
+            cell.head = index;
+            return;
+        }
+        
+        i = (i + 1) & mask;
+    }
+    
+    cells_[i] = { key[0], key[1], key[2], index };
+    next_[index] = kNone;
+    used_++;
+}
+
+// cell count must be a power of two
+void WeldGrid::Rehash(size_t count)
+{
+    std::vector<Cell> cells(count, Cell{ 0, 0, 0, kNone });
+    
+    size_t mask = count - 1;
+    for (const Cell& cell : cells_) {
+        if (cell.head == kNone) {
+            continue;
+        }
+        
+        size_t i = HashCombine(HashCombine(cell.x, cell.y), cell.z) & mask;
+        while (cells[i].head != kNone) {
+            i = (i + 1) & mask;
+        }
+        cells[i] = cell;
+    }
+    
+    cells_.swap(cells);
+}
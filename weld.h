@@ -0,0 +1,148 @@
+#ifndef __threeio__weld__
+#define __threeio__weld__
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "types.h"
+
+// Largest differences at which attribute values are merged into one,
+// 0 merges identical values only.
+struct WeldTolerance {
+    double position = 0; // distance
+    double normal = 0;   // angle between the normals, in radians
+    double uv = 0;       // distance in uv space
+    
+    bool enabled() const
+    {
+        return position > 0 || normal > 0 || uv > 0;
+    }
+};
+
+inline bool WeldPositions(const Vector3& a, const Vector3& b, double tolerance)
+{
+    if (tolerance <= 0) {
+        return a == b;
+    }
+    
+    double dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+    return dx * dx + dy * dy + dz * dz <= tolerance * tolerance;
+}
+
+inline bool WeldNormals(const Vector3& a, const Vector3& b, double tolerance)
+{
+    if (tolerance <= 0) {
+        return a == b;
+    }
+    
+    double dot = a.x * b.x + a.y * b.y + a.z * b.z;
+    double lengths = std::sqrt((a.x * a.x + a.y * a.y + a.z * a.z) * (b.x * b.x + b.y * b.y + b.z * b.z));
+    return dot >= std::cos(std::min(tolerance, M_PI)) * lengths;
+}
+
+inline bool WeldUVs(const Vector2& a, const Vector2& b, double tolerance)
+{
+    if (tolerance <= 0) {
+        return a == b;
+    }
+    
+    double du = double(a.x) - b.x, dv = double(a.y) - b.y;
+    return du * du + dv * dv <= tolerance * tolerance;
+}
+
+// Distance between unit normals at the given angle, to search them in a grid.
+inline double WeldNormalDistance(double angle)
+{
+    return angle > 0 ? 2 * std::sin(std::min(angle, M_PI) / 2) : 0;
+}
+
+/*
+ * Uniform spatial hash grid that finds earlier points within a distance
+ * of a new one. Cells are a few times the distance wide, so a point only
+ * needs its own cell and the neighbors across the boundaries it is close
+ * to, at most eight. Points are the indices of values in a dedup set.
+ * A distance of 0 keys the cells on the exact components instead. Points
+ * with fewer than three axes leave the remaining components at 0.
+ */
+class WeldGrid
+{
+public:
+    static const unsigned kNone = ~0u;
+    
+    explicit WeldGrid(double distance, int axes = 3);
+    
+    void reserve(size_t count);
+    
+    // values that were merged with a value that is not identical to them
+    size_t welded() const { return welded_; }
+    
+    /*
+     * Returns the index in values of the earliest value at point p that
+     * close accepts, or inserts value into values and returns its index.
+     */
+    template <class Set, class T, class Close>
+    unsigned insert(Set& values, const T& value, const double p[3], Close close)
+    {
+        int64_t base[3];
+        int step[3];
+        Locate(p, base, step);
+        
+        unsigned found = kNone;
+        for (int i = 0; i < 8; ++i) {
+            if (((i & 1) && !step[0]) || ((i & 2) && !step[1]) || ((i & 4) && !step[2])) {
+                continue;
+            }
+            
+            unsigned index = Head(base[0] + ((i & 1) ? step[0] : 0),
+                                  base[1] + ((i & 2) ? step[1] : 0),
+                                  base[2] + ((i & 4) ? step[2] : 0));
+            for (; index != kNone; index = next_[index]) {
+                if (index < found && close(values[index], value)) {
+                    found = index;
+                }
+            }
+        }
+        
+        if (found != kNone) {
+            if (values[found] != value) {
+                welded_++;
+            }
+            return found;
+        }
+        
+        size_t size = values.size();
+        found = values.insert(value);
+        if (values.size() > size) {
+            Add(base, found);
+        }
+        
+        return found;
+    }
+    
+private:
+    
+    struct Cell {
+        int64_t x, y, z;
+        unsigned head;
+    };
+    
+    static const size_t kMinCells = 64;
+    
+    double inverse_;             // 1 / cell size, 0 keys on the components
+    int axes_;
+    std::vector<Cell> cells_;    // open addressing, head kNone if empty
+    size_t used_ = 0;
+    std::vector<unsigned> next_; // next point in the same cell, by index
+    size_t welded_ = 0;
+    
+    // cell of p, and per axis the direction of a neighbor within distance
+    void Locate(const double p[3], int64_t base[3], int step[3]) const;
+    
+    unsigned Head(int64_t x, int64_t y, int64_t z) const;
+    void Add(const int64_t cell[3], unsigned index);
+    void Rehash(size_t count);
+};
+
+#endif // /* defined(__threeio__weld__) */